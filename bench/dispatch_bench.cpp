@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+// Measures the cost of passing a controller sample from the listener through
+// the handler down to the input device, with the boost::signals2 wiring used
+// before and with statically bound slots used now. The receivers do almost
+// nothing, so the numbers show the dispatch overhead itself. The last case
+// runs the real PSMoveHandler with a null input device.
+
+#include "psmove_handler.hpp"
+#include "psmove_listener.hpp"
+#include "static_slot.hpp"
+#include <boost/signals2.hpp>
+#include <boost/bind/bind.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <time.h>
+
+using namespace boost::placeholders;
+using namespace psmoveinput;
+
+#define DEF_ITERATIONS 10000000
+
+// stands in for InputDevice
+class NullDevice
+{
+public:
+    NullDevice() : sum_(0) {}
+
+    void reportMove(int dx, int dy) { sum_ += dx + dy; }
+    void reportKey(int code, bool pressed) { sum_ += code + (pressed ? 1 : 0); }
+
+    long long sum_;
+};
+
+// stands in for PSMoveHandler wired with boost::signals2, as before
+class SignalsHandler
+{
+public:
+    void onGyroscope(int gx, int gy, const timespec &tp) { move_(gx, gy + (tp.tv_nsec & 1)); }
+    void onButtons(int buttons, ControllerId id) { key_(buttons, id == ControllerId::FIRST); }
+
+    boost::signals2::signal<void (int, int)> move_;
+    boost::signals2::signal<void (int, bool)> key_;
+};
+
+// the same handler with statically bound slots
+class SlotsHandler
+{
+public:
+    void onGyroscope(int gx, int gy, const timespec &tp) { move_(gx, gy + (tp.tv_nsec & 1)); }
+    void onButtons(int buttons, ControllerId id) { key_(buttons, id == ControllerId::FIRST); }
+
+    StaticSlot<void (int, int)> move_;
+    StaticSlot<void (int, bool)> key_;
+};
+
+static double nowNs()
+{
+    timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * 1e9 + tp.tv_nsec;
+}
+
+static void report(const char *name, double start, double end, long iterations, long long sum)
+{
+    std::cout << name << ": " << (end - start) / iterations << " ns/sample"
+              << " (checksum " << sum << ")" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = (argc > 1) ? std::atol(argv[1]) : DEF_ITERATIONS;
+    timespec tp;
+    double start;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+
+    std::cout << "build type " << PSMOVEINPUT_BUILD_TYPE << ", optimized with -O2" << std::endl;
+
+    // boost::signals2: listener -> handler -> device
+    {
+        NullDevice device;
+        SignalsHandler handler;
+        boost::signals2::signal<void (int, int, const timespec &)> gyro;
+        boost::signals2::signal<void (int, ControllerId)> buttons;
+
+        handler.move_.connect(boost::bind(&NullDevice::reportMove, &device, _1, _2));
+        handler.key_.connect(boost::bind(&NullDevice::reportKey, &device, _1, _2));
+        gyro.connect(boost::bind(&SignalsHandler::onGyroscope, &handler, _1, _2, _3));
+        buttons.connect(boost::bind(&SignalsHandler::onButtons, &handler, _1, _2));
+
+        start = nowNs();
+        for (long i = 0; i < iterations; i++)
+        {
+            gyro(i & 0xFF, -(i & 0x7F), tp);
+            buttons(i & 0xF, ControllerId::FIRST);
+        }
+        report("boost::signals2", start, nowNs(), iterations, device.sum_);
+    }
+
+    // statically bound slots: listener -> handler -> device
+    {
+        NullDevice device;
+        SlotsHandler handler;
+        StaticSlot<void (int, int, const timespec &)> gyro;
+        StaticSlot<void (int, ControllerId)> buttons;
+
+        handler.move_ = StaticSlot<void (int, int)>::bind<NullDevice, &NullDevice::reportMove>(&device);
+        handler.key_ = StaticSlot<void (int, bool)>::bind<NullDevice, &NullDevice::reportKey>(&device);
+        gyro = StaticSlot<void (int, int, const timespec &)>::bind<SlotsHandler, &SlotsHandler::onGyroscope>(&handler);
+        buttons = StaticSlot<void (int, ControllerId)>::bind<SlotsHandler, &SlotsHandler::onButtons>(&handler);
+
+        start = nowNs();
+        for (long i = 0; i < iterations; i++)
+        {
+            gyro(i & 0xFF, -(i & 0x7F), tp);
+            buttons(i & 0xF, ControllerId::FIRST);
+        }
+        report("StaticSlot", start, nowNs(), iterations, device.sum_);
+    }
+
+    // real handler, samples 4 ms apart
+    {
+        Log log(LogParams("/dev/null", LogLevel::ERROR));
+        key_map keymap1{{Btn_CROSS, KEY_X}};
+        key_map keymap2;
+        MoveCoeffs coeffs{0.1, 0.1};
+        NullDevice device;
+        PSMoveHandler handler(keymap1, keymap2, coeffs, 0, 100, log);
+        gyro_slot gyro = gyro_slot::bind<PSMoveHandler, &PSMoveHandler::onGyroscope>(&handler);
+        button_slot buttons = button_slot::bind<PSMoveHandler, &PSMoveHandler::onButtons>(&handler);
+
+        handler.setMoveSlot(move_slot::bind<NullDevice, &NullDevice::reportMove>(&device));
+        handler.setKeySlot(key_slot::bind<NullDevice, &NullDevice::reportKey>(&device));
+
+        start = nowNs();
+        for (long i = 0; i < iterations; i++)
+        {
+            tp = timespecAddNs(tp, 4000000);
+            gyro(ControllerId::FIRST, i & 0xFF, -(i & 0x7F), tp);
+            buttons(((i & 0x100) != 0) ? Btn_CROSS : 0, ControllerId::FIRST);
+        }
+        report("PSMoveHandler", start, nowNs(), iterations, device.sum_);
+    }
+
+    return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+// Measures throughput of the handler to input device path: samples per second,
+// nanoseconds and heap allocations per sample of PSMoveHandler::onGyroscope(),
+// onGesture() and onButtons() with a null device, and of InputDevice writing
+// to an in-memory file or, if asked to, to a real uinput device. Controller
+// counts and key map sizes are swept; samples are fed round robin to all
+// controllers from a single thread, as the reactor does.
+//
+// Results go to stdout as CSV, one line per case, so that runs can be compared
+// by scripts; the target is always built with -O2, the build type is
+// reported. The exit status is 1 if any case allocates memory per sample,
+// which the per-sample path never should.
+//
+// usage: psmoveinput-bench-handler [samples per case] [--uinput]
+// --uinput creates a real device, whose key presses reach the focused window
+
+#include "psmove_handler.hpp"
+#include "input_device.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace psmoveinput;
+
+#define DEF_SAMPLES         1000000
+// samples are 4 ms apart, as they are with a single controller
+#define SAMPLE_INTERVAL_NS  4000000LL
+// the in-memory file is rewound every that many samples
+#define REWIND_INTERVAL     4096
+// the frame case toggles buttons every that many samples
+#define FRAME_BUTTON_PERIOD 16
+
+// heap allocations made by the process so far
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *ptr = malloc((size > 0) ? size : 1);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// stands in for InputDevice
+class NullDevice
+{
+public:
+    NullDevice() : sum_(0) {}
+
+    void reportMove(int dx, int dy) { sum_ += dx + dy; }
+    void reportKey(int code, bool pressed) { sum_ += code + (pressed ? 1 : 0); }
+    void reportMWheel(int value) { sum_ += value; }
+
+    long long sum_;
+};
+
+// every button and gesture a key map can refer to
+static const int mappable[] = {Btn_TRIANGLE, Btn_CIRCLE, Btn_CROSS, Btn_SQUARE, Btn_SELECT,
+                               Btn_START, Btn_PS, Btn_MOVE, Btn_T, BTN_GESTURE_UP,
+                               BTN_GESTURE_DOWN, BTN_GESTURE_LEFT, BTN_GESTURE_RIGHT};
+#define MAPPABLE_COUNT  static_cast<int>(sizeof (mappable) / sizeof (mappable[0]))
+
+static const int controllerCounts[] = {1, 2, 4, 8, MAX_CONTROLLERS};
+// beyond MAPPABLE_COUNT buttons get several keys each
+static const int keymapSizes[] = {1, 4, MAPPABLE_COUNT, 2 * MAPPABLE_COUNT};
+
+struct Case
+{
+    std::string name;
+    std::string sink;
+    int controllers;
+    int keymap;
+};
+
+class Bench
+{
+public:
+    Bench(long samples) : samples_(samples), log_(LogParams("/dev/null", LogLevel::ERROR)), failed_(false) {}
+
+    void run(bool uinput)
+    {
+        std::cout << "case,sink,controllers,keymap,samples,ns_per_sample,samples_per_sec,allocs_per_sample,build" << std::endl;
+
+        for (int controllers : controllerCounts)
+        {
+            for (int keymap : keymapSizes)
+            {
+                runHandler(controllers, keymap);
+            }
+        }
+
+        int fd = memfd_create("psmoveinput-bench", MFD_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cerr << "failed to create in-memory file: " << strerror(errno) << std::endl;
+            failed_ = true;
+        }
+        else
+        {
+            InputDevice device("psmoveinput-bench", fd, log_);
+            runDevice(device, "memory", fd);
+        }
+
+        if (uinput == true)
+        {
+            try
+            {
+                key_array keys;
+                for (int i = 0; i < 2 * MAPPABLE_COUNT; i++)
+                {
+                    keys.push_back(keyCode(i));
+                }
+                InputDevice device("psmoveinput-bench", keys, log_);
+                runDevice(device, "uinput", -1);
+            }
+            catch (std::exception &e)
+            {
+                std::cerr << e.what() << ", uinput cases skipped" << std::endl;
+            }
+        }
+    }
+
+    bool failed() { return failed_; }
+
+protected:
+    long samples_;
+    Log log_;
+    bool failed_;
+    double start_;
+    unsigned long allocations_;
+
+    static int keyCode(int index) { return KEY_1 + index; }
+
+    static controller_settings makeSettings(int controllers, int keymap)
+    {
+        controller_settings settings(controllers);
+
+        for (ControllerSettings &controller : settings)
+        {
+            controller.role = ControllerRole::POINTER;
+            controller.coeffs = MoveCoeffs{0.1, 0.1};
+            for (int i = 0; i < keymap; i++)
+            {
+                controller.keymap.push_back(KeyMapEntry{mappable[i % MAPPABLE_COUNT], keyCode(i)});
+            }
+        }
+
+        return settings;
+    }
+
+    // buttons mapped by a key map of given size
+    static int mappedButtons(int keymap)
+    {
+        int buttons = 0;
+
+        for (int i = 0; (i < keymap) && (i < MAPPABLE_COUNT); i++)
+        {
+            buttons |= mappable[i];
+        }
+
+        return buttons & BTN_GESTURE_MASK;
+    }
+
+    static double nowNs()
+    {
+        timespec tp;
+        clock_gettime(CLOCK_MONOTONIC, &tp);
+        return tp.tv_sec * 1e9 + tp.tv_nsec;
+    }
+
+    void begin()
+    {
+        allocations_ = allocations;
+        start_ = nowNs();
+    }
+
+    void end(const Case &c)
+    {
+        double elapsed = nowNs() - start_;
+        double allocs = static_cast<double>(allocations - allocations_) / samples_;
+
+        std::cout << c.name << "," << c.sink << "," << c.controllers << "," << c.keymap << ","
+                  << samples_ << "," << elapsed / samples_ << "," << static_cast<long>(samples_ * 1e9 / elapsed) << ","
+                  << allocs << "," << PSMOVEINPUT_BUILD_TYPE " -O2" << std::endl;
+        if (allocs > 0.0)
+        {
+            failed_ = true;
+        }
+    }
+
+    void runHandler(int controllers, int keymap)
+    {
+        controller_settings settings = makeSettings(controllers, keymap);
+        int buttons = mappedButtons(keymap);
+        timespec tp;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+
+        // pointer movement
+        {
+            NullDevice device;
+            PSMoveHandler handler(settings, 0, 100, log_);
+            handler.setMoveSlot(move_slot::bind<NullDevice, &NullDevice::reportMove>(&device));
+            handler.setKeySlot(key_slot::bind<NullDevice, &NullDevice::reportKey>(&device));
+
+            begin();
+            for (long i = 0; i < samples_; i++)
+            {
+                tp = timespecAddNs(tp, SAMPLE_INTERVAL_NS / controllers);
+                handler.onGyroscope(controllerId(i % controllers), i & 0xFF, -(i & 0x7F), tp);
+            }
+            end(Case{"gyroscope", "null", controllers, keymap});
+        }
+
+        // gestures changing direction every sample
+        {
+            NullDevice device;
+            PSMoveHandler handler(settings, 0, 100, log_);
+            handler.setMoveSlot(move_slot::bind<NullDevice, &NullDevice::reportMove>(&device));
+            handler.setKeySlot(key_slot::bind<NullDevice, &NullDevice::reportKey>(&device));
+
+            begin();
+            for (long i = 0; i < samples_; i++)
+            {
+                int g = ((i / controllers) & 1) ? 5000 : -5000;
+                tp = timespecAddNs(tp, SAMPLE_INTERVAL_NS / controllers);
+                handler.onGesture(controllerId(i % controllers), g, -g, tp);
+            }
+            end(Case{"gesture", "null", controllers, keymap});
+        }
+
+        // every mapped button changing its state every sample
+        {
+            NullDevice device;
+            PSMoveHandler handler(settings, 0, 100, log_);
+            handler.setMoveSlot(move_slot::bind<NullDevice, &NullDevice::reportMove>(&device));
+            handler.setKeySlot(key_slot::bind<NullDevice, &NullDevice::reportKey>(&device));
+
+            begin();
+            for (long i = 0; i < samples_; i++)
+            {
+                handler.onButtons(((i / controllers) & 1) ? buttons : 0, controllerId(i % controllers));
+            }
+            end(Case{"buttons", "null", controllers, keymap});
+        }
+    }
+
+    // fd is rewound now and then, so that the in-memory file does not grow
+    void runDevice(InputDevice &device, const char *sink, int fd)
+    {
+        // a single event per write
+        begin();
+        for (long i = 0; i < samples_; i++)
+        {
+            device.reportMove(i & 0xFF, -(i & 0x7F));
+            if ((fd >= 0) && ((i % REWIND_INTERVAL) == 0))
+            {
+                lseek(fd, 0, SEEK_SET);
+            }
+        }
+        end(Case{"write", sink, 1, 0});
+
+        // the whole path: a frame per sample, buttons change now and then
+        for (int controllers : controllerCounts)
+        {
+            for (int keymap : keymapSizes)
+            {
+                PSMoveHandler handler(makeSettings(controllers, keymap), 0, 100, log_);
+                int buttons = mappedButtons(keymap);
+                timespec tp;
+
+                handler.setMoveSlot(move_slot::bind<InputDevice, &InputDevice::reportMove>(&device));
+                handler.setKeySlot(key_slot::bind<InputDevice, &InputDevice::reportKey>(&device));
+                handler.setMWheelSlot(mwheel_slot::bind<InputDevice, &InputDevice::reportMWheel>(&device));
+                clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+
+                begin();
+                for (long i = 0; i < samples_; i++)
+                {
+                    ControllerId id = controllerId(i % controllers);
+                    long n = i / controllers;
+
+                    tp = timespecAddNs(tp, SAMPLE_INTERVAL_NS / controllers);
+                    device.beginFrame();
+                    handler.onGyroscope(id, (n & 1) ? 3000 : -3000, n & 0x7F, tp);
+                    handler.onButtons(((n / FRAME_BUTTON_PERIOD) & 1) ? buttons : 0, id);
+                    device.endFrame();
+                    if ((fd >= 0) && ((i % REWIND_INTERVAL) == 0))
+                    {
+                        lseek(fd, 0, SEEK_SET);
+                    }
+                }
+                end(Case{"frame", sink, controllers, keymap});
+
+                // keys still pressed are not left to the next case
+                handler.reset();
+            }
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+    long samples = DEF_SAMPLES;
+    bool uinput = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--uinput") == 0)
+        {
+            uinput = true;
+        }
+        else
+        {
+            samples = std::atol(argv[i]);
+        }
+    }
+    if (samples <= 0)
+    {
+        std::cerr << "usage: " << argv[0] << " [samples per case] [--uinput]" << std::endl;
+        return 2;
+    }
+
+    Bench bench(samples);
+    bench.run(uinput);
+
+    return (bench.failed() == true) ? 1 : 0;
+}
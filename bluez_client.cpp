@@ -0,0 +1,784 @@
+/*
+ * Copyright (C) 2012 - 2024 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "bluez_client.hpp"
+#include "common.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/thread/locks.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace psmoveinput
+{
+
+#define SYSTEM_BUS_ADDRESS      "unix:path=/var/run/dbus/system_bus_socket"
+#define SYSTEM_BUS_ADDRESS_ENV  "DBUS_SYSTEM_BUS_ADDRESS"
+#define DBUS_TIMEOUT            1000    // ms, for connection set up and sending
+#define DBUS_MAX_MESSAGE        65536
+#define DBUS_MAX_AUTH_LINE      512
+// a whole message of the largest size with room to spare
+#define DBUS_MAX_BUFFER         (4 * DBUS_MAX_MESSAGE)
+
+// D-Bus wire protocol
+#define DBUS_LITTLE_ENDIAN      'l'
+#define DBUS_BIG_ENDIAN         'B'
+#define DBUS_VERSION            1
+#define DBUS_HEADER_SIZE        16
+#define DBUS_METHOD_CALL        1
+#define DBUS_METHOD_RETURN      2
+#define DBUS_ERROR              3
+#define DBUS_NO_REPLY_EXPECTED  0x01
+#define DBUS_FIELD_PATH         1
+#define DBUS_FIELD_INTERFACE    2
+#define DBUS_FIELD_MEMBER       3
+#define DBUS_FIELD_REPLY_SERIAL 5
+#define DBUS_FIELD_DESTINATION  6
+
+#define BLUEZ_SERVICE           "org.bluez"
+#define BLUEZ_DEVICE_INTERFACE  "org.bluez.Device1"
+#define BLUEZ_DEFAULT_ADAPTER   "hci0"
+#define HID_UNIQ_KEY            "HID_UNIQ="
+
+static void pad(std::string &buf, size_t alignment)
+{
+    while ((buf.size() % alignment) != 0)
+    {
+        buf.push_back('\0');
+    }
+}
+
+// messages are always sent in little endian byte order
+static void putUint32(std::string &buf, uint32_t value)
+{
+    pad(buf, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        buf.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+static void setUint32(std::string &buf, size_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        buf[offset + i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static uint32_t getUint32(const std::string &buf, size_t offset, bool littleEndian)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint32_t byte = static_cast<unsigned char>(buf[offset + i]);
+        value |= littleEndian ? (byte << (i * 8)) : (byte << ((3 - i) * 8));
+    }
+    return value;
+}
+
+// header field holding a string or an object path
+static void putField(std::string &buf, char code, char type, const std::string &value)
+{
+    pad(buf, 8);
+    buf.push_back(code);
+    // variant signature
+    buf.push_back(1);
+    buf.push_back(type);
+    buf.push_back('\0');
+    putUint32(buf, value.size());
+    buf += value;
+    buf.push_back('\0');
+}
+
+// whether a HID device with given address is a child of the connection in given sysfs directory
+static bool ownsDevice(const std::string &connection, const std::string &btaddr)
+{
+    bool found = false;
+    DIR *dir = opendir(connection.c_str());
+
+    if (dir == nullptr)
+    {
+        return false;
+    }
+
+    dirent *entry;
+    while ((found == false) && ((entry = readdir(dir)) != nullptr))
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        std::ifstream uevent(connection + "/" + entry->d_name + "/uevent");
+        std::string line;
+        while (std::getline(uevent, line))
+        {
+            if ((line.compare(0, sizeof (HID_UNIQ_KEY) - 1, HID_UNIQ_KEY) == 0) &&
+                (boost::algorithm::iequals(line.substr(sizeof (HID_UNIQ_KEY) - 1), btaddr) == true))
+            {
+                found = true;
+                break;
+            }
+        }
+    }
+    closedir(dir);
+
+    return found;
+}
+
+BluezClient::BluezClient(const std::string &sysfsRoot, int replyTimeout) :
+    fd_(-1),
+    wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    serial_(0),
+    sysfsRoot_(sysfsRoot),
+    replyTimeout_(replyTimeout),
+    worker_(nullptr),
+    stop_(false)
+{
+}
+
+BluezClient::~BluezClient()
+{
+    close();
+    if (wakeFd_ >= 0)
+    {
+        ::close(wakeFd_);
+    }
+}
+
+bool BluezClient::open(const std::string &address)
+{
+    close();
+
+    address_ = address;
+    if (address_.empty() == true)
+    {
+        const char *env = getenv(SYSTEM_BUS_ADDRESS_ENV);
+        address_ = (env != nullptr) ? env : SYSTEM_BUS_ADDRESS;
+    }
+
+    // the worker is not running yet, so the socket is ours for now
+    bool ok = openSocket();
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    stop_ = false;
+    worker_ = new boost::thread(&BluezClient::work, this);
+
+    return ok;
+}
+
+void BluezClient::close()
+{
+    boost::thread *worker = nullptr;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        worker = worker_;
+        worker_ = nullptr;
+        stop_ = true;
+    }
+
+    if (worker != nullptr)
+    {
+        uint64_t value = 1;
+        write(wakeFd_, &value, sizeof (value));
+        cond_.notify_all();
+        worker->join();
+        delete worker;
+        read(wakeFd_, &value, sizeof (value));
+    }
+
+    requests_.clear();
+    closeSocket();
+}
+
+bool BluezClient::isOpen()
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return (worker_ != nullptr);
+}
+
+bool BluezClient::disconnect(const std::string &btaddr)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (worker_ == nullptr)
+    {
+        return false;
+    }
+
+    // pressing the disconnect key again while BlueZ is busy changes nothing
+    if (std::find(requests_.begin(), requests_.end(), btaddr) == requests_.end())
+    {
+        requests_.push_back(btaddr);
+        cond_.notify_one();
+    }
+
+    return true;
+}
+
+void BluezClient::work()
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    while (stop_ == false)
+    {
+        if (requests_.empty() == true)
+        {
+            cond_.wait(lock);
+            continue;
+        }
+
+        // the request stays queued while it is handled, so that it is not queued twice
+        std::string btaddr = requests_.front();
+        lock.unlock();
+        bool done = disconnectDevice(btaddr);
+        if ((done == false) && (stop_ == false) && fallback_)
+        {
+            fallback_(btaddr);
+        }
+        lock.lock();
+        if (requests_.empty() == false)
+        {
+            requests_.pop_front();
+        }
+    }
+}
+
+bool BluezClient::disconnectDevice(const std::string &btaddr)
+{
+    // BlueZ object path of the device is /org/bluez/<adapter>/dev_XX_XX_XX_XX_XX_XX
+    std::string address = btaddr;
+    std::replace(address.begin(), address.end(), ':', '_');
+    std::transform(address.begin(), address.end(), address.begin(),
+                   [](unsigned char c) { return std::toupper(c); });
+    std::string device = "dev_" + address;
+
+    // the bus might have been restarted since we connected
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if ((fd_ < 0) && (openSocket() == false))
+        {
+            return false;
+        }
+
+        /* The call is made on the adapter the controller is connected to. If it
+           is not known, adapters are tried in turn, the wrong ones answer with
+           an error. */
+        CallResult result = CallResult::ERROR;
+        for (const std::string &adapter : getAdapters(btaddr))
+        {
+            std::string path = "/org/bluez/" + adapter + "/" + device;
+            result = callMethod(path, BLUEZ_DEVICE_INTERFACE, "Disconnect", BLUEZ_SERVICE);
+            if (result != CallResult::ERROR)
+            {
+                break;
+            }
+        }
+
+        if (result != CallResult::BROKEN)
+        {
+            return (result == CallResult::OK);
+        }
+        closeSocket();
+    }
+
+    return false;
+}
+
+BluezClient::CallResult BluezClient::callMethod(const std::string &path,
+                                                const std::string &interface,
+                                                const std::string &member,
+                                                const std::string &destination)
+{
+    std::string msg = methodCall(path, interface, member, destination);
+    uint32_t serial = serial_;
+    timespec start;
+    timespec now;
+
+    if (send(msg) == false)
+    {
+        return CallResult::BROKEN;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (true)
+    {
+        int type;
+        uint32_t replySerial;
+
+        // everything else the bus sends us (e.g. NameAcquired or late replies) is of no interest
+        while (nextMessage(type, replySerial) == true)
+        {
+            if (((type == DBUS_METHOD_RETURN) || (type == DBUS_ERROR)) && (replySerial == serial))
+            {
+                return (type == DBUS_METHOD_RETURN) ? CallResult::OK : CallResult::ERROR;
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long left = replyTimeout_ - timespecDiffMs(now, start);
+        if ((fd_ >= 0) && (left > 0) && (stop_ == false))
+        {
+            receive(static_cast<int>(left));
+        }
+        if (fd_ < 0)
+        {
+            return CallResult::BROKEN;
+        }
+        if ((left <= 0) || (stop_ == true))
+        {
+            return CallResult::TIMEOUT;
+        }
+    }
+}
+
+bool BluezClient::openSocket()
+{
+    if ((connectSocket(address_) == false) ||
+        (authenticate() == false) ||
+        (hello() == false))
+    {
+        closeSocket();
+        return false;
+    }
+
+    return true;
+}
+
+void BluezClient::closeSocket()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    received_.clear();
+}
+
+bool BluezClient::connectSocket(const std::string &address)
+{
+    sockaddr_un addr;
+    socklen_t len = 0;
+
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+
+    // address is a ';' separated list of transports with ',' separated keys,
+    // e.g. unix:path=/run/dbus/system_bus_socket,guid=...
+    size_t start = 0;
+    while ((len == 0) && (start < address.size()))
+    {
+        size_t end = address.find(';', start);
+        std::string entry = address.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+        start = (end == std::string::npos) ? address.size() : end + 1;
+
+        if (entry.compare(0, 5, "unix:") != 0)
+        {
+            continue;
+        }
+
+        size_t keyStart = 5;
+        while (keyStart < entry.size())
+        {
+            size_t keyEnd = entry.find(',', keyStart);
+            std::string key = entry.substr(keyStart, (keyEnd == std::string::npos) ? std::string::npos : keyEnd - keyStart);
+            keyStart = (keyEnd == std::string::npos) ? entry.size() : keyEnd + 1;
+
+            bool abstract = (key.compare(0, 9, "abstract=") == 0);
+            if ((key.compare(0, 5, "path=") != 0) && (abstract == false))
+            {
+                continue;
+            }
+
+            std::string path = key.substr(abstract ? 9 : 5);
+            if (path.size() + 1 > sizeof (addr.sun_path))
+            {
+                continue;
+            }
+            // abstract socket names start with a zero byte
+            memcpy(addr.sun_path + (abstract ? 1 : 0), path.data(), path.size());
+            len = offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 1 : 0);
+            break;
+        }
+    }
+
+    if (len == 0)
+    {
+        return false;
+    }
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    if (connect(fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0)
+    {
+        return false;
+    }
+
+    // nothing ever blocks, waiting is done with poll() and a timeout
+    int flags = fcntl(fd_, F_GETFL);
+    return ((flags >= 0) && (fcntl(fd_, F_SETFL, flags | O_NONBLOCK) == 0));
+}
+
+bool BluezClient::authenticate()
+{
+    // EXTERNAL authentication: the bus checks our credentials
+    // against the uid we claim, which is sent hex encoded
+    char uid[16];
+    snprintf(uid, sizeof (uid), "%u", static_cast<unsigned int>(geteuid()));
+
+    std::string auth;
+    auth.push_back('\0');
+    auth += "AUTH EXTERNAL ";
+    for (const char *c = uid; *c != 0; c++)
+    {
+        char hex[3];
+        snprintf(hex, sizeof (hex), "%02x", static_cast<unsigned char>(*c));
+        auth += hex;
+    }
+    auth += "\r\n";
+
+    if (send(auth) == false)
+    {
+        return false;
+    }
+
+    // wait for OK <guid>
+    size_t eol;
+    while ((eol = received_.find("\r\n")) == std::string::npos)
+    {
+        if ((received_.size() > DBUS_MAX_AUTH_LINE) || (receive(DBUS_TIMEOUT) == false))
+        {
+            return false;
+        }
+    }
+    bool ok = (received_.compare(0, 3, "OK ") == 0);
+    received_.erase(0, eol + 2);
+
+    return (ok && send("BEGIN\r\n"));
+}
+
+bool BluezClient::hello()
+{
+    // the bus does not let us do anything else before we have said hello
+    std::string msg = methodCall("/org/freedesktop/DBus", "org.freedesktop.DBus", "Hello",
+                                 "org.freedesktop.DBus");
+    uint32_t serial = serial_;
+
+    if (send(msg) == false)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        int type;
+        uint32_t replySerial;
+
+        while (nextMessage(type, replySerial) == true)
+        {
+            if (((type == DBUS_METHOD_RETURN) || (type == DBUS_ERROR)) && (replySerial == serial))
+            {
+                return (type == DBUS_METHOD_RETURN);
+            }
+        }
+
+        if ((fd_ < 0) || (receive(DBUS_TIMEOUT) == false))
+        {
+            return false;
+        }
+    }
+}
+
+bool BluezClient::send(const std::string &msg)
+{
+    size_t sent = 0;
+
+    while (sent < msg.size())
+    {
+        ssize_t ret = ::send(fd_, msg.data() + sent, msg.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (ret >= 0)
+        {
+            sent += ret;
+            continue;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            // the bus does not keep up, wait for room in the socket buffer
+            pollfd pfds[2];
+            pfds[0].fd = fd_;
+            pfds[0].events = POLLOUT;
+            pfds[0].revents = 0;
+            pfds[1].fd = wakeFd_;
+            pfds[1].events = POLLIN;
+            pfds[1].revents = 0;
+            if ((poll(pfds, 2, DBUS_TIMEOUT) > 0) &&
+                ((pfds[0].revents & POLLOUT) != 0) &&
+                ((pfds[1].revents & POLLIN) == 0))
+            {
+                continue;
+            }
+        }
+
+        // the rest of a message cut short would be taken for the start of the next one
+        closeSocket();
+        return false;
+    }
+
+    return true;
+}
+
+bool BluezClient::receive(int timeout)
+{
+    pollfd pfds[2];
+    pfds[0].fd = fd_;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    pfds[1].fd = wakeFd_;
+    pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
+
+    if ((poll(pfds, 2, timeout) <= 0) || ((pfds[1].revents & POLLIN) != 0))
+    {
+        return false;
+    }
+
+    char buf[4096];
+    ssize_t ret = recv(fd_, buf, sizeof (buf), MSG_DONTWAIT);
+    if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    {
+        return true;
+    }
+    // nothing we wait for is that long, so it is somebody flooding us
+    if ((ret <= 0) || (received_.size() + ret > DBUS_MAX_BUFFER))
+    {
+        closeSocket();
+        return false;
+    }
+    received_.append(buf, ret);
+
+    return true;
+}
+
+bool BluezClient::nextMessage(int &type, uint32_t &replySerial)
+{
+    if ((fd_ < 0) || (received_.size() < DBUS_HEADER_SIZE))
+    {
+        return false;
+    }
+
+    bool littleEndian = (received_[0] == DBUS_LITTLE_ENDIAN);
+    uint32_t bodyLen = getUint32(received_, 4, littleEndian);
+    uint32_t fieldsLen = getUint32(received_, 12, littleEndian);
+
+    if (((received_[0] != DBUS_LITTLE_ENDIAN) && (received_[0] != DBUS_BIG_ENDIAN)) ||
+        (received_[3] != DBUS_VERSION) ||
+        (bodyLen > DBUS_MAX_MESSAGE) || (fieldsLen > DBUS_MAX_MESSAGE))
+    {
+        // garbage, there's no way to find the next message
+        closeSocket();
+        return false;
+    }
+
+    size_t end = DBUS_HEADER_SIZE + fieldsLen;
+    size_t headerLen = (end + 7) & ~static_cast<size_t>(7);
+    size_t total = headerLen + bodyLen;
+    if (received_.size() < total)
+    {
+        return false;
+    }
+
+    type = received_[1];
+    replySerial = 0;
+
+    /* Header fields are (code, variant) structures aligned to 8 bytes. Lengths
+       they carry are checked against the end of the fields, so that a broken
+       message cannot make us read past what has been received. */
+    size_t pos = DBUS_HEADER_SIZE;
+    bool valid = true;
+    while (valid && (pos < end))
+    {
+        // code, signature length, single type signature and its terminating zero
+        if ((pos + 4 > end) || (received_[pos + 1] != 1))
+        {
+            valid = false;
+            break;
+        }
+        int code = received_[pos];
+        char sig = received_[pos + 2];
+        pos += 4;
+
+        if ((sig == 'u') || (sig == 's') || (sig == 'o'))
+        {
+            pos = (pos + 3) & ~static_cast<size_t>(3);
+            if (pos + 4 > end)
+            {
+                valid = false;
+                break;
+            }
+            uint32_t value = getUint32(received_, pos, littleEndian);
+            pos += 4;
+            if (sig == 'u')
+            {
+                if (code == DBUS_FIELD_REPLY_SERIAL)
+                {
+                    replySerial = value;
+                }
+            }
+            else if (value < end - pos)
+            {
+                pos += value + 1;
+            }
+            else
+            {
+                valid = false;
+            }
+        }
+        else if ((sig == 'g') && (pos < end))
+        {
+            size_t len = static_cast<unsigned char>(received_[pos]);
+            if (len + 2 <= end - pos)
+            {
+                pos += len + 2;
+            }
+            else
+            {
+                valid = false;
+            }
+        }
+        else
+        {
+            // nothing else is ever put into message headers
+            valid = false;
+        }
+        pos = (pos + 7) & ~static_cast<size_t>(7);
+    }
+
+    if (valid == false)
+    {
+        closeSocket();
+        return false;
+    }
+
+    received_.erase(0, total);
+    return true;
+}
+
+std::string BluezClient::methodCall(const std::string &path,
+                                    const std::string &interface,
+                                    const std::string &member,
+                                    const std::string &destination)
+{
+    std::string msg;
+
+    serial_++;
+    if (serial_ == 0)
+    {
+        serial_ = 1;
+    }
+
+    msg.push_back(DBUS_LITTLE_ENDIAN);
+    msg.push_back(DBUS_METHOD_CALL);
+    msg.push_back(0);           // flags, a reply is always expected
+    msg.push_back(DBUS_VERSION);
+    putUint32(msg, 0);          // body length, there is no body
+    putUint32(msg, serial_);
+    putUint32(msg, 0);          // header fields length, set below
+
+    putField(msg, DBUS_FIELD_PATH, 'o', path);
+    putField(msg, DBUS_FIELD_INTERFACE, 's', interface);
+    putField(msg, DBUS_FIELD_MEMBER, 's', member);
+    putField(msg, DBUS_FIELD_DESTINATION, 's', destination);
+    setUint32(msg, 12, msg.size() - DBUS_HEADER_SIZE);
+
+    // header is padded to 8 bytes even without a body
+    pad(msg, 8);
+
+    return msg;
+}
+
+std::vector<std::string> BluezClient::getAdapters(const std::string &btaddr)
+{
+    std::vector<std::string> adapters;
+    std::string path = sysfsRoot_ + "/class/bluetooth";
+
+    /* Adapters are listed along with their connections, e.g. hci0 and hci0:11.
+       HID device of a controller is a child of its connection, and its
+       HID_UNIQ is the Bluetooth address, so this is how the adapter owning
+       the controller is found. */
+    DIR *dir = opendir(path.c_str());
+    if (dir != nullptr)
+    {
+        dirent *entry;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            std::string name = entry->d_name;
+            size_t colon = name.find(':');
+            if (name.compare(0, 3, "hci") != 0)
+            {
+                continue;
+            }
+            if (colon == std::string::npos)
+            {
+                adapters.push_back(name);
+            }
+            else if (ownsDevice(path + "/" + name, btaddr) == true)
+            {
+                adapters.assign(1, name.substr(0, colon));
+                break;
+            }
+        }
+        closedir(dir);
+    }
+
+    if (adapters.empty() == true)
+    {
+        adapters.push_back(BLUEZ_DEFAULT_ADAPTER);
+    }
+    std::sort(adapters.begin(), adapters.end());
+
+    return adapters;
+}
+
+} // namespace psmoveinput
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2012 - 2024 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_BLUEZ_CLIENT_HPP
+#define PSMOVEINPUT_BLUEZ_CLIENT_HPP
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace psmoveinput
+{
+
+// how long BlueZ is given to answer a Disconnect call
+#define BLUEZ_REPLY_TIMEOUT 5000 // ms
+
+// called with the Bluetooth address of a controller BlueZ has failed to disconnect
+typedef boost::function<void (const std::string &btaddr)> bluez_fallback;
+
+// BluezClient asks BlueZ to disconnect controllers over D-Bus. It speaks just
+// enough of the D-Bus wire protocol to connect to the bus and make
+// org.bluez.Device1.Disconnect calls. Calls are made by a worker thread, which
+// waits for the replies and reconnects to the bus if needed, so disconnecting
+// a controller never blocks the caller. Controllers BlueZ fails to disconnect
+// are handed over to the fallback.
+class BluezClient
+{
+public:
+    BluezClient(const std::string &sysfsRoot = "/sys", int replyTimeout = BLUEZ_REPLY_TIMEOUT);
+    virtual ~BluezClient();
+
+    // connect to the bus with given address, e.g. unix:path=/run/dbus/system_bus_socket;
+    // the system bus is used if the address is empty; the worker is started even
+    // if the bus is not available, and keeps trying to connect to it
+    bool open(const std::string &address = "");
+    void close();
+    bool isOpen();
+
+    void setFallback(const bluez_fallback &fallback) { fallback_ = fallback; }
+
+    // ask BlueZ to disconnect the device with given Bluetooth address; returns
+    // false if the worker is not running, otherwise the fallback is called
+    // from the worker if BlueZ does not disconnect the device
+    bool disconnect(const std::string &btaddr);
+
+    BluezClient(const BluezClient &) = delete;
+    BluezClient &operator = (const BluezClient &) = delete;
+
+protected:
+    // the socket and everything below it is only used by the worker once it runs
+    // outcome of a method call
+    enum class CallResult : unsigned char
+    {
+        OK = 0,     // method returned
+        ERROR,      // error reply
+        BROKEN,     // connection to the bus is lost
+        TIMEOUT     // no reply in time, or the worker is being stopped
+    };
+
+    int fd_;
+    // wakes the worker up from waiting on the socket when it is being stopped
+    int wakeFd_;
+    uint32_t serial_;
+    std::string address_;
+    std::string sysfsRoot_;
+    int replyTimeout_;
+    // received data, which does not make up a whole message yet
+    std::string received_;
+    bluez_fallback fallback_;
+    boost::thread *worker_;
+    // Bluetooth addresses waiting for the worker, guarded by mutex_
+    std::deque<std::string> requests_;
+    std::atomic<bool> stop_;
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+
+    void work();
+    bool disconnectDevice(const std::string &btaddr);
+    CallResult callMethod(const std::string &path,
+                          const std::string &interface,
+                          const std::string &member,
+                          const std::string &destination);
+    bool openSocket();
+    void closeSocket();
+    bool connectSocket(const std::string &address);
+    bool authenticate();
+    bool hello();
+    bool send(const std::string &msg);
+    bool receive(int timeout);
+    bool nextMessage(int &type, uint32_t &replySerial);
+    std::string methodCall(const std::string &path,
+                           const std::string &interface,
+                           const std::string &member,
+                           const std::string &destination);
+    std::vector<std::string> getAdapters(const std::string &btaddr);
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_BLUEZ_CLIENT_HPP
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_BOUNDED_QUEUE_HPP
+#define PSMOVEINPUT_BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace psmoveinput
+{
+
+#define QUEUE_CACHE_LINE 64
+
+// Lock-free bounded queue for multiple producers and multiple consumers.
+// Each cell carries a sequence number telling whether it is ready to be
+// written or read on the current lap, so producers and consumers only contend
+// on a single atomic increment. push() fails instead of blocking when the
+// queue is full.
+template <typename T>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to the next power of two
+    explicit BoundedQueue(size_t capacity) :
+        mask_(roundUp(capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        head_(0),
+        tail_(0)
+    {
+        for (size_t i = 0; i <= mask_; i++)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    bool push(const T &value)
+    {
+        Cell *cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            long diff = static_cast<long>(seq) - static_cast<long>(pos);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the cell has not been consumed on the previous lap yet
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        Cell *cell;
+        size_t pos = head_.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            long diff = static_cast<long>(seq) - static_cast<long>(pos + 1);
+            if (diff == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // empty
+                return false;
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = cell->data;
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate number of queued elements
+    size_t size() const
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_relaxed);
+        return (tail > head) ? (tail - head) : 0;
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator = (const BoundedQueue &) = delete;
+
+protected:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    static size_t roundUp(size_t n)
+    {
+        size_t ret = 2;
+        while (ret < n)
+        {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    // keep producer and consumer positions on separate cache lines;
+    // padding instead of alignas, so that heap-allocated owners do not
+    // require over-aligned new
+    char pad0_[QUEUE_CACHE_LINE];
+    std::atomic<size_t> head_;
+    char pad1_[QUEUE_CACHE_LINE - sizeof (std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+    char pad2_[QUEUE_CACHE_LINE - sizeof (std::atomic<size_t>)];
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_BOUNDED_QUEUE_HPP
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_CLOCK_HPP
+#define PSMOVEINPUT_CLOCK_HPP
+
+#include "common.hpp"
+#include <time.h>
+
+namespace psmoveinput
+{
+
+// Clocks are template parameters of the components that need to know the
+// current time, so they are resolved at compile time and calling now()
+// costs exactly what calling clock_gettime() directly does.
+
+// the clock everything in psmoveinput is timed with
+struct MonotonicClock
+{
+    void now(timespec &tp) { clock_gettime(CLOCK_MONOTONIC_RAW, &tp); }
+};
+
+// virtual time, which only moves when it is told to,
+// so that time dependent code can be driven faster than real time
+class ManualClock
+{
+public:
+    // time never starts at zero, since zero time points mean "not set yet"
+    ManualClock() : time_{1, 0} {}
+
+    void now(timespec &tp) { tp = time_; }
+    void set(const timespec &tp) { time_ = tp; }
+    void advanceNs(long long ns) { time_ = timespecAddNs(time_, ns); }
+    void advanceMs(long ms) { advanceNs(ms * 1000000LL); }
+
+protected:
+    timespec time_;
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_CLOCK_HPP
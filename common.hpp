@@ -24,12 +24,17 @@
 #define PSMOVEINPUT_COMMON_HPP
 
 #include <vector>
+#include <time.h>
 
 // common definitions used by several psmoveinput components
 
 namespace psmoveinput
 {
 
+// USB ids of PSMove controller, reported by our input device as well
+#define PSMOVE_VENDOR_ID 0x054C
+#define PSMOVE_PRODUCT_ID 0x03D5
+
 // log levels
 enum class LogLevel : unsigned char
 {
@@ -62,13 +67,128 @@ enum class OpMode : unsigned char
     CLIENT
 };
 
+// the way controller threads wait for new data from the controller
+enum class ReadMode : unsigned char
+{
+    EVENT = 0,  // sleep on controller's hidraw node until a report arrives
+    POLL        // check for new data every POLL_TIMEOUT ms
+};
+
+// the way controllers are serviced
+enum class ThreadModel : unsigned char
+{
+    PER_CONTROLLER = 0, // each controller has its own thread
+    REACTOR             // listener thread services all controllers from a single epoll loop
+};
+
+// gyroscope half-frames of each controller report handed over to PSMoveHandler
+enum class FrameMode : unsigned char
+{
+    SECOND_HALF = 0,    // only the most recent half-frame
+    BOTH_HALVES         // both half-frames, each with its own timestamp
+};
+
+// the thread that runs PSMoveHandler and writes to the input device
+enum class OutputMode : unsigned char
+{
+    DIRECT = 0, // controller threads themselves
+    PIPELINE    // dedicated output thread fed by controller threads via ring buffers
+};
+
+// what controller thread does when output ring buffer is full
+enum class OverflowPolicy : unsigned char
+{
+    DROP = 0,   // drop motion-only samples, wait for room for button changes
+    BLOCK       // wait for room for every sample
+};
+
+// upper limit for the number of controllers set in the config file
+#define MAX_CONTROLLERS 16
+#define DEF_CONTROLLERS 2
+
+// controller index in the pool; controllers beyond the second one have
+// no names of their own and are referred to as controllerId(index),
+// any index from FIRST to LAST is a valid value
 enum class ControllerId : unsigned char
 {
-    FIRST,
-    SECOND
+    FIRST = 0,
+    SECOND = 1,
+    LAST = MAX_CONTROLLERS - 1
 };
 
-#define MAX_CONTROLLERS 2
+inline int controllerIndex(ControllerId id)
+{
+    return static_cast<int>(id);
+}
+
+// index has to be less than MAX_CONTROLLERS
+inline ControllerId controllerId(int index)
+{
+    return static_cast<ControllerId>(index);
+}
+
+// what controller's movements are used for
+enum class ControllerRole : unsigned char
+{
+    POINTER = 0,    // moves the pointer
+    GESTURE,        // movements are turned into gesture buttons
+    KEYS            // only buttons are reported
+};
+
+// everything configured for a single controller of the pool
+struct ControllerSettings
+{
+    ControllerRole role;
+    key_map keymap;
+    MoveCoeffs coeffs;
+};
+
+typedef std::vector<ControllerSettings> controller_settings;
+
+// scheduling policy of time critical threads
+enum class SchedPolicy : unsigned char
+{
+    OTHER = 0,  // default time-sharing scheduling
+    FIFO,       // SCHED_FIFO real-time scheduling
+    RR          // SCHED_RR real-time scheduling
+};
+
+// scheduling settings of a single kind of thread
+struct SchedParams
+{
+    SchedPolicy policy;
+    int priority;           // real-time priority, 1 - 99
+    std::vector<int> cpus;  // CPUs the thread may run on, any if empty
+};
+
+// milliseconds elapsed between two time points
+inline long timespecDiffMs(const timespec &to, const timespec &from)
+{
+    return (to.tv_sec - from.tv_sec) * 1000 + (to.tv_nsec - from.tv_nsec) / 1000000;
+}
+
+// nanoseconds elapsed between two time points
+inline long long timespecDiffNs(const timespec &to, const timespec &from)
+{
+    return (to.tv_sec - from.tv_sec) * 1000000000LL + (to.tv_nsec - from.tv_nsec);
+}
+
+// time point shifted by given number of nanoseconds (which may be negative)
+inline timespec timespecAddNs(const timespec &tp, long long ns)
+{
+    long long total = tp.tv_nsec + ns;
+    timespec ret;
+
+    ret.tv_sec = tp.tv_sec + total / 1000000000LL;
+    ret.tv_nsec = total % 1000000000LL;
+    if (ret.tv_nsec < 0)
+    {
+        ret.tv_sec--;
+        ret.tv_nsec += 1000000000LL;
+    }
+
+    return ret;
+}
 
 } // namespace psmoveinput
 
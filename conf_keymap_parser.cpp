@@ -28,31 +28,43 @@
 namespace psmoveinput
 {
 
+// psmoveapi buttons and gestures by their option names
+static const std::pair<const char *, int> buttonNames[] = {
+    std::make_pair(OPT_BTN_TRIANGLE, Btn_TRIANGLE),
+    std::make_pair(OPT_BTN_CIRCLE, Btn_CIRCLE),
+    std::make_pair(OPT_BTN_CROSS, Btn_CROSS),
+    std::make_pair(OPT_BTN_SQUARE, Btn_SQUARE),
+    std::make_pair(OPT_BTN_SELECT, Btn_SELECT),
+    std::make_pair(OPT_BTN_START, Btn_START),
+    std::make_pair(OPT_BTN_PS, Btn_PS),
+    std::make_pair(OPT_BTN_MOVE, Btn_MOVE),
+    std::make_pair(OPT_BTN_T, Btn_T)
+};
+
+static const std::pair<const char *, int> gestureNames[] = {
+    std::make_pair(OPT_GESTURE_UP, BTN_GESTURE_UP),
+    std::make_pair(OPT_GESTURE_DOWN, BTN_GESTURE_DOWN),
+    std::make_pair(OPT_GESTURE_LEFT, BTN_GESTURE_LEFT),
+    std::make_pair(OPT_GESTURE_RIGHT, BTN_GESTURE_RIGHT)
+};
+
+std::string controllerOptionName(const std::string &prefix, int index, const std::string &suffix)
+{
+    std::string name = prefix;
+
+    if (index != 0)
+    {
+        name += "_" + std::to_string(index);
+    }
+    if (suffix.empty() == false)
+    {
+        name += "_" + suffix;
+    }
+
+    return name;
+}
+
 KeyMapParser::KeyMapParser() :
-    psmap_ {
-        std::make_pair(OPT_PSBTN_TRIANGLE, Btn_TRIANGLE),
-        std::make_pair(OPT_PSBTN_CIRCLE, Btn_CIRCLE),
-        std::make_pair(OPT_PSBTN_CROSS, Btn_CROSS),
-        std::make_pair(OPT_PSBTN_SQUARE, Btn_SQUARE),
-        std::make_pair(OPT_PSBTN_SELECT, Btn_SELECT),
-        std::make_pair(OPT_PSBTN_START, Btn_START),
-        std::make_pair(OPT_PSBTN_PS, Btn_PS),
-        std::make_pair(OPT_PSBTN_MOVE, Btn_MOVE),
-        std::make_pair(OPT_PSBTN_T, Btn_T),
-        std::make_pair(OPT_PSBTN_1_TRIANGLE, Btn_TRIANGLE),
-        std::make_pair(OPT_PSBTN_1_CIRCLE, Btn_CIRCLE),
-        std::make_pair(OPT_PSBTN_1_CROSS, Btn_CROSS),
-        std::make_pair(OPT_PSBTN_1_SQUARE, Btn_SQUARE),
-        std::make_pair(OPT_PSBTN_1_SELECT, Btn_SELECT),
-        std::make_pair(OPT_PSBTN_1_START, Btn_START),
-        std::make_pair(OPT_PSBTN_1_PS, Btn_PS),
-        std::make_pair(OPT_PSBTN_1_MOVE, Btn_MOVE),
-        std::make_pair(OPT_PSBTN_1_T, Btn_T),
-        std::make_pair(OPT_GESTURE_UP, BTN_GESTURE_UP),
-        std::make_pair(OPT_GESTURE_DOWN, BTN_GESTURE_DOWN),
-        std::make_pair(OPT_GESTURE_LEFT, BTN_GESTURE_LEFT),
-        std::make_pair(OPT_GESTURE_RIGHT, BTN_GESTURE_RIGHT)
-    },
     linmap_ {
         std::make_pair("KEY_ESC", KEY_ESC),
         std::make_pair("KEY_1", KEY_1),
@@ -160,6 +172,26 @@ KeyMapParser::KeyMapParser() :
         std::make_pair("MWHEEL_DOWN", KEY_PSMOVE_MWHEEL_DOWN)
     }
 {
+    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        for (auto button : buttonNames)
+        {
+            addOption(controllerOptionName(OPT_PSBTN_PREFIX, i, button.first), button.second, i);
+        }
+        for (auto gesture : gestureNames)
+        {
+            // gesture options always carry controller index
+            addOption(std::string(OPT_GESTURE_PREFIX) + "_" + std::to_string(i) + "_" + gesture.first,
+                      gesture.second, i);
+        }
+    }
+
+    // gesture options without index belong to the second controller
+    for (auto gesture : gestureNames)
+    {
+        addOption(std::string(OPT_GESTURE_PREFIX) + "_" + gesture.first,
+                  gesture.second, OPT_GESTURE_DEF_CONTROLLER);
+    }
 }
 
 KeyMapParser::~KeyMapParser()
@@ -173,7 +205,7 @@ KeyMapEntry KeyMapParser::createEntry(const std::string &optname, const std::str
     auto psit = psmap_.find(optname);
     if (psit != psmap_.end())
     {
-        newEntry.pscode = psit->second;
+        newEntry.pscode = psit->second.pscode;
         auto linit = linmap_.find(optval.c_str());
         if (linit != linmap_.end())
         {
@@ -184,4 +216,28 @@ KeyMapEntry KeyMapParser::createEntry(const std::string &optname, const std::str
     return newEntry;
 }
 
+int KeyMapParser::getController(const std::string &optname)
+{
+    auto psit = psmap_.find(optname);
+    return (psit != psmap_.end()) ? psit->second.controller : -1;
+}
+
+std::vector<std::string> KeyMapParser::getOptionNames()
+{
+    std::vector<std::string> names;
+
+    for (auto option : psmap_)
+    {
+        names.push_back(option.first);
+    }
+
+    return names;
+}
+
+void KeyMapParser::addOption(const std::string &optname, int pscode, int controller)
+{
+    KeyOption option = {pscode, controller};
+    psmap_[optname] = option;
+}
+
 } // namespace psmoveinput
@@ -26,10 +26,15 @@
 #include "common.hpp"
 #include <string>
 #include <map>
+#include <vector>
 
 namespace psmoveinput
 {
 
+// name of a per-controller option, e.g. PSBTN_CROSS for controller 0
+// and PSBTN_2_CROSS for controller 2; suffix may be empty, e.g. ROLE_2
+std::string controllerOptionName(const std::string &prefix, int index, const std::string &suffix);
+
 class KeyMapParser
 {
 public:
@@ -38,10 +43,23 @@ public:
 
     // given the option string and option value, produce key map entry
     KeyMapEntry createEntry(const std::string &optname, const std::string &optval);
+    // index of the controller given key map option belongs to,
+    // -1 if this is not a key map option
+    int getController(const std::string &optname);
+    // names of all key map options for all controllers
+    std::vector<std::string> getOptionNames();
 
 protected:
-    std::map<std::string, int> psmap_;
+    struct KeyOption
+    {
+        int pscode;
+        int controller;
+    };
+
+    std::map<std::string, KeyOption> psmap_;
     std::map<std::string, int> linmap_;
+
+    void addOption(const std::string &optname, int pscode, int controller);
 };
 
 } // namespace psmoveinput
@@ -21,12 +21,17 @@
 
 
 #include "config.hpp"
+#include <climits>
+#include <cstdio>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <linux/input.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <sched.h>
 
 namespace psmoveinput
 {
@@ -39,11 +44,12 @@ Config::Config() :
     version_(false),
     ok_(false),
     loglevel_set_(false),
-    pidfile_set_(false),
     loglevel_(DEF_LOGLEVEL),
     logfile_set_(false),
+    pidfile_set_(false),
     config_file_(DEF_CONFIGFILE),
     config_file_set_(false),
+    controllerCount_(DEF_CONTROLLERS),
     opmode_(OpMode::STANDALONE),
     opmode_set_(false),
     foreground_(false),
@@ -53,7 +59,15 @@ Config::Config() :
     ledTimeout_(DEF_LED_UPDATE_TIMEOUT),
     moveThreshold_(DEF_MOVE_THRESHOLD),
     gestureThreshold_(DEF_GESTURE_THRESHOLD),
-    gestureTimeout_(DEF_GESTURE_TIMEOUT)
+    gestureTimeout_(DEF_GESTURE_TIMEOUT),
+    readMode_(DEF_READ_MODE),
+    frameMode_(DEF_SENSOR_FRAMES),
+    threadModel_(DEF_THREAD_MODEL),
+    outputMode_(DEF_OUTPUT_MODE),
+    outputQueueSize_(DEF_OUTPUT_QUEUE_SIZE),
+    overflowPolicy_(DEF_OUTPUT_OVERFLOW),
+    lockMemory_(DEF_MLOCKALL),
+    replayFast_(false)
 {
     // default pid file location
     pidfile_ = expandTilde(DEF_PIDFILE);
@@ -61,6 +75,23 @@ Config::Config() :
     // default log file location
     logfile_ = expandTilde(DEF_LOGFILE);
 
+    // default move coefficients
+    coeffs_.cx = DEF_MOVEC_X;
+    coeffs_.cy = DEF_MOVEC_Y;
+
+    // default scheduling settings; log writer is never given real-time priority
+    controllerSched_.policy = DEF_SCHED_POLICY;
+    controllerSched_.priority = DEF_SCHED_PRIORITY;
+    outputSched_ = controllerSched_;
+    logSched_.policy = SchedPolicy::OTHER;
+    logSched_.priority = 0;
+
+    // default controller pool
+    for (int i = 0; i < controllerCount_; i++)
+    {
+        controllers_.push_back(defaultSettings(i));
+    }
+
     // command line options description
     optdesc_.add_options()
         (OPT_HELP, OPT_HELP_DESC)
@@ -70,7 +101,10 @@ Config::Config() :
         (OPT_LOG_FILE, po::value<std::string>(), OPT_LOG_FILE_DESC)
         (OPT_CONFIG, po::value<std::string>(), OPT_CONFIG_DESC)
         (OPT_MODE, po::value<std::string>(), OPT_MODE_DESC)
-        (OPT_FOREGROUND, OPT_FOREGROUND_DESC);
+        (OPT_FOREGROUND, OPT_FOREGROUND_DESC)
+        (OPT_RECORD, po::value<std::string>(), OPT_RECORD_DESC)
+        (OPT_REPLAY, po::value<std::string>(), OPT_REPLAY_DESC)
+        (OPT_REPLAY_FAST, OPT_REPLAY_FAST_DESC);
 
     // config file options description
     configdesc_.add_options()
@@ -79,36 +113,48 @@ Config::Config() :
         (OPT_CONF_LOG_FILE, po::value<std::string>())
         (OPT_MOVEC_X, po::value<double>())
         (OPT_MOVEC_Y, po::value<double>())
-        (OPT_PSBTN_TRIANGLE, po::value<std::string>())
-        (OPT_PSBTN_CIRCLE, po::value<std::string>())
-        (OPT_PSBTN_CROSS, po::value<std::string>())
-        (OPT_PSBTN_SQUARE, po::value<std::string>())
-        (OPT_PSBTN_SELECT, po::value<std::string>())
-        (OPT_PSBTN_START, po::value<std::string>())
-        (OPT_PSBTN_PS, po::value<std::string>())
-        (OPT_PSBTN_MOVE, po::value<std::string>())
-        (OPT_PSBTN_T, po::value<std::string>())
-        (OPT_PSBTN_1_TRIANGLE, po::value<std::string>())
-        (OPT_PSBTN_1_CIRCLE, po::value<std::string>())
-        (OPT_PSBTN_1_CROSS, po::value<std::string>())
-        (OPT_PSBTN_1_SQUARE, po::value<std::string>())
-        (OPT_PSBTN_1_SELECT, po::value<std::string>())
-        (OPT_PSBTN_1_START, po::value<std::string>())
-        (OPT_PSBTN_1_PS, po::value<std::string>())
-        (OPT_PSBTN_1_MOVE, po::value<std::string>())
-        (OPT_PSBTN_1_T, po::value<std::string>())
         (OPT_CONF_MODE, po::value<std::string>())
         (OPT_CONF_POLL_TIMEOUT, po::value<int>())
         (OPT_CONF_CONN_TIMEOUT, po::value<int>())
         (OPT_CONF_DISCONNECT_TIMEOUT, po::value<int>())
+        (OPT_CONF_DISCONNECT_TIMEOUT_MS, po::value<int>())
         (OPT_CONF_LED_UPDATE_TIMEOUT, po::value<int>())
         (OPT_CONF_MOVE_THRESHOLD, po::value<int>())
-        (OPT_GESTURE_UP, po::value<std::string>())
-        (OPT_GESTURE_DOWN, po::value<std::string>())
-        (OPT_GESTURE_LEFT, po::value<std::string>())
-        (OPT_GESTURE_RIGHT, po::value<std::string>())
         (OPT_CONF_GESTURE_THRESHOLD, po::value<int>())
-        (OPT_CONF_GESTURE_TIMEOUT, po::value<int>());
+        (OPT_CONF_GESTURE_TIMEOUT, po::value<int>())
+        (OPT_CONF_READ_MODE, po::value<std::string>())
+        (OPT_CONF_SENSOR_FRAMES, po::value<std::string>())
+        (OPT_CONF_THREAD_MODEL, po::value<std::string>())
+        (OPT_CONF_OUTPUT_MODE, po::value<std::string>())
+        (OPT_CONF_OUTPUT_QUEUE_SIZE, po::value<int>())
+        (OPT_CONF_OUTPUT_OVERFLOW, po::value<std::string>())
+        (OPT_CONF_SCHED_POLICY, po::value<std::string>())
+        (OPT_CONF_SCHED_PRIORITY, po::value<int>())
+        (OPT_CONF_CONTROLLER_CPUS, po::value<std::string>())
+        (OPT_CONF_OUTPUT_CPUS, po::value<std::string>())
+        (OPT_CONF_LOG_CPUS, po::value<std::string>())
+        (OPT_CONF_MLOCKALL, po::value<std::string>())
+        (OPT_CONF_CONTROLLERS, po::value<int>());
+
+    // per-controller options
+    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        configdesc_.add_options()
+            (controllerOptionName(OPT_CONF_ROLE, i, "").c_str(), po::value<std::string>());
+        // the first controller's coefficients are registered above,
+        // they are used by all controllers without coefficients of their own
+        if (i != 0)
+        {
+            configdesc_.add_options()
+                (controllerOptionName(OPT_MOVEC_PREFIX, i, "X").c_str(), po::value<double>())
+                (controllerOptionName(OPT_MOVEC_PREFIX, i, "Y").c_str(), po::value<double>());
+        }
+    }
+    for (const std::string &name : keymap_parser_.getOptionNames())
+    {
+        configdesc_.add_options()
+            (name.c_str(), po::value<std::string>());
+    }
 }
 
 Config::~Config()
@@ -140,14 +186,20 @@ void Config::parse(int argc, char **argv)
 
 key_map Config::getKeyMap(ControllerId controller)
 {
-    if (controller == ControllerId::FIRST)
-    {
-        return keymaps_[0];
-    }
-    else
-    {
-        return keymaps_[1];
-    }
+    int index = controllerIndex(controller);
+    return (index < controllerCount_) ? controllers_[index].keymap : key_map();
+}
+
+ControllerRole Config::getRole(ControllerId controller)
+{
+    int index = controllerIndex(controller);
+    return (index < controllerCount_) ? controllers_[index].role : ControllerRole::KEYS;
+}
+
+MoveCoeffs Config::getMoveCoeffs(ControllerId controller)
+{
+    int index = controllerIndex(controller);
+    return (index < controllerCount_) ? controllers_[index].coeffs : coeffs_;
 }
 
 void Config::handleCmdLine()
@@ -196,6 +248,18 @@ void Config::handleCmdLine()
             {
                 foreground_ = true;
             }
+            if (opts_.count(OPT_RECORD_ONLYLONG))
+            {
+                recordFile_ = expandTilde(opts_[OPT_RECORD_ONLYLONG].as<std::string>());
+            }
+            if (opts_.count(OPT_REPLAY_ONLYLONG))
+            {
+                replayFile_ = expandTilde(opts_[OPT_REPLAY_ONLYLONG].as<std::string>());
+            }
+            if (opts_.count(OPT_REPLAY_FAST_ONLYLONG))
+            {
+                replayFast_ = true;
+            }
             ok_ = true;
         }
         catch(std::exception &e)
@@ -269,15 +333,20 @@ void Config::parseConfig()
         // store timeouts
         if (conf_opts_.count(OPT_CONF_POLL_TIMEOUT))
         {
-            pollTimeout_= conf_opts_[OPT_CONF_POLL_TIMEOUT].as<int>();
+            pollTimeout_= getTimeout(OPT_CONF_POLL_TIMEOUT, 1);
         }
         if (conf_opts_.count(OPT_CONF_CONN_TIMEOUT))
         {
-            connTimeout_= conf_opts_[OPT_CONF_CONN_TIMEOUT].as<int>();
+            connTimeout_= getTimeout(OPT_CONF_CONN_TIMEOUT, 1);
         }
         if (conf_opts_.count(OPT_CONF_DISCONNECT_TIMEOUT))
         {
-            disconnectTimeout_= conf_opts_[OPT_CONF_DISCONNECT_TIMEOUT].as<int>();
+            disconnectTimeout_= getTimeout(OPT_CONF_DISCONNECT_TIMEOUT, 1000);
+        }
+        // millisecond disconnect timeout takes precedence over the one in seconds
+        if (conf_opts_.count(OPT_CONF_DISCONNECT_TIMEOUT_MS))
+        {
+            disconnectTimeout_= getTimeout(OPT_CONF_DISCONNECT_TIMEOUT_MS, 1);
         }
         if (conf_opts_.count(OPT_CONF_LED_UPDATE_TIMEOUT))
         {
@@ -287,6 +356,60 @@ void Config::parseConfig()
         {
             gestureTimeout_ = conf_opts_[OPT_CONF_GESTURE_TIMEOUT].as<int>();
         }
+        // store controller read mode
+        if (conf_opts_.count(OPT_CONF_READ_MODE))
+        {
+            getReadModeFromString(conf_opts_[OPT_CONF_READ_MODE].as<std::string>());
+        }
+        // store sensor frame mode
+        if (conf_opts_.count(OPT_CONF_SENSOR_FRAMES))
+        {
+            getFrameModeFromString(conf_opts_[OPT_CONF_SENSOR_FRAMES].as<std::string>());
+        }
+        // store thread model
+        if (conf_opts_.count(OPT_CONF_THREAD_MODEL))
+        {
+            getThreadModelFromString(conf_opts_[OPT_CONF_THREAD_MODEL].as<std::string>());
+        }
+        // store output pipeline settings
+        if (conf_opts_.count(OPT_CONF_OUTPUT_MODE))
+        {
+            getOutputModeFromString(conf_opts_[OPT_CONF_OUTPUT_MODE].as<std::string>());
+        }
+        if (conf_opts_.count(OPT_CONF_OUTPUT_QUEUE_SIZE))
+        {
+            outputQueueSize_ = conf_opts_[OPT_CONF_OUTPUT_QUEUE_SIZE].as<int>();
+        }
+        if (conf_opts_.count(OPT_CONF_OUTPUT_OVERFLOW))
+        {
+            getOverflowPolicyFromString(conf_opts_[OPT_CONF_OUTPUT_OVERFLOW].as<std::string>());
+        }
+        // store scheduling settings
+        if (conf_opts_.count(OPT_CONF_SCHED_POLICY))
+        {
+            getSchedPolicyFromString(conf_opts_[OPT_CONF_SCHED_POLICY].as<std::string>());
+        }
+        if (conf_opts_.count(OPT_CONF_SCHED_PRIORITY))
+        {
+            controllerSched_.priority = conf_opts_[OPT_CONF_SCHED_PRIORITY].as<int>();
+            outputSched_.priority = controllerSched_.priority;
+        }
+        if (conf_opts_.count(OPT_CONF_CONTROLLER_CPUS))
+        {
+            controllerSched_.cpus = getCpusFromString(conf_opts_[OPT_CONF_CONTROLLER_CPUS].as<std::string>());
+        }
+        if (conf_opts_.count(OPT_CONF_OUTPUT_CPUS))
+        {
+            outputSched_.cpus = getCpusFromString(conf_opts_[OPT_CONF_OUTPUT_CPUS].as<std::string>());
+        }
+        if (conf_opts_.count(OPT_CONF_LOG_CPUS))
+        {
+            logSched_.cpus = getCpusFromString(conf_opts_[OPT_CONF_LOG_CPUS].as<std::string>());
+        }
+        if (conf_opts_.count(OPT_CONF_MLOCKALL))
+        {
+            lockMemory_ = (conf_opts_[OPT_CONF_MLOCKALL].as<std::string>() == OPT_YES);
+        }
         // store move threshold
         if (conf_opts_.count(OPT_CONF_MOVE_THRESHOLD))
         {
@@ -298,50 +421,55 @@ void Config::parseConfig()
             gestureThreshold_= conf_opts_[OPT_CONF_GESTURE_THRESHOLD].as<int>();
         }
 
+        // number of controllers in the pool
+        if (conf_opts_.count(OPT_CONF_CONTROLLERS))
+        {
+            controllerCount_ = conf_opts_[OPT_CONF_CONTROLLERS].as<int>();
+            if (controllerCount_ < 1)
+            {
+                controllerCount_ = 1;
+            }
+            else if (controllerCount_ > MAX_CONTROLLERS)
+            {
+                controllerCount_ = MAX_CONTROLLERS;
+            }
+        }
+
+        // per-controller settings; options of controllers beyond the pool size are ignored
+        controllers_.clear();
+        for (int i = 0; i < MAX_CONTROLLERS; i++)
+        {
+            ControllerSettings settings = defaultSettings(i);
+
+            std::string name = controllerOptionName(OPT_CONF_ROLE, i, "");
+            if (conf_opts_.count(name))
+            {
+                getRoleFromString(conf_opts_[name].as<std::string>(), settings);
+            }
+            name = controllerOptionName(OPT_MOVEC_PREFIX, i, "X");
+            if (conf_opts_.count(name))
+            {
+                settings.coeffs.cx = conf_opts_[name].as<double>();
+            }
+            name = controllerOptionName(OPT_MOVEC_PREFIX, i, "Y");
+            if (conf_opts_.count(name))
+            {
+                settings.coeffs.cy = conf_opts_[name].as<double>();
+            }
+
+            controllers_.push_back(settings);
+        }
+
         // add key map entries one by one
-        const std::vector<boost::shared_ptr<po::option_description>> &opts = configdesc_.options();
-        for (boost::shared_ptr<po::option_description> opt : opts)
-        {
-            const std::string &longname = opt->long_name();
-            // filter out non-key options
-            if ( (longname != OPT_CONF_PID) &&
-                 (longname != OPT_CONF_LOG) &&
-                 (longname != OPT_CONF_LOG_FILE) &&
-                 (longname != OPT_MOVEC_X) &&
-                 (longname != OPT_MOVEC_Y) &&
-                 (longname != OPT_CONF_MODE) &&
-                 (longname != OPT_CONF_POLL_TIMEOUT) &&
-                 (longname != OPT_CONF_CONN_TIMEOUT) &&
-                 (longname != OPT_CONF_DISCONNECT_TIMEOUT) &&
-                 (longname != OPT_CONF_LED_UPDATE_TIMEOUT) &&
-                 (longname != OPT_CONF_MOVE_THRESHOLD) &&
-                 (longname != OPT_CONF_GESTURE_THRESHOLD) &&
-                 (longname != OPT_CONF_GESTURE_TIMEOUT) &&
-                 conf_opts_.count(longname) )
+        for (const std::string &name : keymap_parser_.getOptionNames())
+        {
+            if (conf_opts_.count(name))
             {
                 KeyMapEntry entry;
-                entry = keymap_parser_.createEntry(longname, conf_opts_[longname].as<std::string>());
+                entry = keymap_parser_.createEntry(name, conf_opts_[name].as<std::string>());
                 if ((entry.pscode != 0) && (entry.lincode != KEY_RESERVED))
                 {
-                    if ((longname == OPT_PSBTN_TRIANGLE) ||
-                        (longname == OPT_PSBTN_CIRCLE) ||
-                        (longname == OPT_PSBTN_CROSS) ||
-                        (longname == OPT_PSBTN_SQUARE) ||
-                        (longname == OPT_PSBTN_SELECT) ||
-                        (longname == OPT_PSBTN_START) ||
-                        (longname == OPT_PSBTN_PS) ||
-                        (longname == OPT_PSBTN_MOVE) ||
-                        (longname == OPT_PSBTN_T))
-                    {
-                        // first controller
-                        keymaps_[0].push_back(entry);
-                    }
-                    // gesture options go to the second controller map
-                    else
-                    {
-                        // second controller
-                        keymaps_[1].push_back(entry);
-                    }
+                    controllers_[keymap_parser_.getController(name)].keymap.push_back(entry);
                 }
                 else
                 {
@@ -351,6 +479,8 @@ void Config::parseConfig()
                 }
             }
         }
+
+        controllers_.resize(controllerCount_);
     }
     catch(boost::bad_any_cast &e)
     {
@@ -403,6 +533,183 @@ void Config::getModeFromString(const std::string &mode)
     }
 }
 
+void Config::getReadModeFromString(const std::string &mode)
+{
+    if (mode == OPT_READ_MODE_EVENT)
+    {
+        readMode_ = ReadMode::EVENT;
+    }
+    else if (mode == OPT_READ_MODE_POLL)
+    {
+        readMode_ = ReadMode::POLL;
+    }
+}
+
+void Config::getFrameModeFromString(const std::string &mode)
+{
+    if (mode == OPT_SENSOR_FRAMES_SECOND)
+    {
+        frameMode_ = FrameMode::SECOND_HALF;
+    }
+    else if (mode == OPT_SENSOR_FRAMES_BOTH)
+    {
+        frameMode_ = FrameMode::BOTH_HALVES;
+    }
+}
+
+ControllerSettings Config::defaultSettings(int index)
+{
+    ControllerSettings settings;
+
+    // the first controller moves the pointer, the second one makes gestures,
+    // the rest only have their buttons mapped
+    if (index == 0)
+    {
+        settings.role = ControllerRole::POINTER;
+    }
+    else if (index == 1)
+    {
+        settings.role = ControllerRole::GESTURE;
+    }
+    else
+    {
+        settings.role = ControllerRole::KEYS;
+    }
+    settings.coeffs = coeffs_;
+
+    return settings;
+}
+
+void Config::getRoleFromString(const std::string &role, ControllerSettings &settings)
+{
+    if (role == OPT_ROLE_POINTER)
+    {
+        settings.role = ControllerRole::POINTER;
+    }
+    else if (role == OPT_ROLE_GESTURE)
+    {
+        settings.role = ControllerRole::GESTURE;
+    }
+    else if (role == OPT_ROLE_KEYS)
+    {
+        settings.role = ControllerRole::KEYS;
+    }
+}
+
+void Config::getThreadModelFromString(const std::string &model)
+{
+    if (model == OPT_THREAD_MODEL_THREADS)
+    {
+        threadModel_ = ThreadModel::PER_CONTROLLER;
+    }
+    else if (model == OPT_THREAD_MODEL_REACTOR)
+    {
+        threadModel_ = ThreadModel::REACTOR;
+    }
+}
+
+void Config::getOutputModeFromString(const std::string &mode)
+{
+    if (mode == OPT_OUTPUT_MODE_DIRECT)
+    {
+        outputMode_ = OutputMode::DIRECT;
+    }
+    else if (mode == OPT_OUTPUT_MODE_PIPELINE)
+    {
+        outputMode_ = OutputMode::PIPELINE;
+    }
+}
+
+void Config::getOverflowPolicyFromString(const std::string &policy)
+{
+    if (policy == OPT_OUTPUT_OVERFLOW_DROP)
+    {
+        overflowPolicy_ = OverflowPolicy::DROP;
+    }
+    else if (policy == OPT_OUTPUT_OVERFLOW_BLOCK)
+    {
+        overflowPolicy_ = OverflowPolicy::BLOCK;
+    }
+}
+
+void Config::getSchedPolicyFromString(const std::string &policy)
+{
+    SchedPolicy value;
+
+    if (policy == OPT_SCHED_POLICY_OTHER)
+    {
+        value = SchedPolicy::OTHER;
+    }
+    else if (policy == OPT_SCHED_POLICY_FIFO)
+    {
+        value = SchedPolicy::FIFO;
+    }
+    else if (policy == OPT_SCHED_POLICY_RR)
+    {
+        value = SchedPolicy::RR;
+    }
+    else
+    {
+        return;
+    }
+
+    controllerSched_.policy = value;
+    outputSched_.policy = value;
+}
+
+std::vector<int> Config::getCpusFromString(const std::string &cpus)
+{
+    // comma separated list of CPUs and CPU ranges, e.g. "0,2-3";
+    // the whole list is ignored if any part of it is invalid
+    std::vector<int> result;
+    std::istringstream stream(cpus);
+    std::string item;
+
+    while (std::getline(stream, item, ','))
+    {
+        int first = -1;
+        int last = -1;
+        int length = 0;
+
+        if ((sscanf(item.c_str(), " %d - %d %n", &first, &last, &length) != 2) ||
+            (length != static_cast<int>(item.size())))
+        {
+            length = 0;
+            if ((sscanf(item.c_str(), " %d %n", &first, &length) != 1) ||
+                (length != static_cast<int>(item.size())))
+            {
+                return std::vector<int>();
+            }
+            last = first;
+        }
+
+        if ((first < 0) || (last < first) || (last >= CPU_SETSIZE))
+        {
+            return std::vector<int>();
+        }
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            result.push_back(cpu);
+        }
+    }
+
+    return result;
+}
+
+int Config::getTimeout(const char *name, int scale)
+{
+    // timeout of the config file option given in units of scale ms; zero or
+    // negative one would make the timer fire all the time or never
+    int timeout = conf_opts_[name].as<int>();
+
+    if ((timeout < MIN_TIMER_TIMEOUT) || (timeout > INT_MAX / scale))
+    {
+        throw std::invalid_argument(std::string(name) + " is out of range: " + std::to_string(timeout));
+    }
+
+    return timeout * scale;
+}
+
 std::string Config::expandTilde(const std::string &str)
 {
     if (str[0] == '~')
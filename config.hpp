@@ -45,10 +45,16 @@ public:
     const char *getConfigFileName() { return config_file_.c_str(); }
     // get location of the pid file
     const char *getPidFileName() { return pidfile_.c_str(); }
-    // get move coeffs
+    // get move coeffs set for all controllers
     MoveCoeffs getMoveCoeffs() { return coeffs_; }
-    // get keymap
+    // get number of controllers in the pool
+    int getControllerCount() { return controllerCount_; }
+    // get settings of all controllers in the pool
+    controller_settings getControllerSettings() { return controllers_; }
+    // get settings of single controller
     key_map getKeyMap(ControllerId controller);
+    ControllerRole getRole(ControllerId controller);
+    MoveCoeffs getMoveCoeffs(ControllerId controller);
     // get log level
     LogLevel getLogLevel() { return loglevel_; }
     // get location of the log file
@@ -67,6 +73,28 @@ public:
     int getMoveThreshold() { return moveThreshold_; }
     // get gesture threshold
     int getGestureThreshold() { return gestureThreshold_; }
+    // get controller read mode
+    ReadMode getReadMode() { return readMode_; }
+    // get sensor frame mode
+    FrameMode getFrameMode() { return frameMode_; }
+    // get output pipeline settings
+    ThreadModel getThreadModel() { return threadModel_; }
+    OutputMode getOutputMode() { return outputMode_; }
+    int getOutputQueueSize() { return outputQueueSize_; }
+    OverflowPolicy getOverflowPolicy() { return overflowPolicy_; }
+    // get scheduling settings of controller threads (and of the reactor),
+    // of the output thread and of the log writer thread
+    SchedParams getControllerSched() { return controllerSched_; }
+    SchedParams getOutputSched() { return outputSched_; }
+    SchedParams getLogSched() { return logSched_; }
+    // lock process memory or not
+    bool getLockMemory() { return lockMemory_; }
+    // get location of the file to record samples to, empty if not recording
+    const char *getRecordFileName() { return recordFile_.c_str(); }
+    // get location of the recording to replay, empty if not replaying
+    const char *getReplayFileName() { return replayFile_.c_str(); }
+    // replay as fast as possible or not
+    bool getReplayFast() { return replayFast_; }
 
     // parsing status
     bool isOK() { return ok_; }
@@ -95,7 +123,8 @@ protected:
     MoveCoeffs coeffs_;
     std::string config_file_;
     bool config_file_set_;
-    key_map keymaps_[MAX_CONTROLLERS];
+    int controllerCount_;
+    controller_settings controllers_;
     KeyMapParser keymap_parser_;
     OpMode opmode_;
     bool opmode_set_;
@@ -107,12 +136,35 @@ protected:
     int moveThreshold_;
     int gestureThreshold_;
     int gestureTimeout_;
+    ReadMode readMode_;
+    FrameMode frameMode_;
+    ThreadModel threadModel_;
+    OutputMode outputMode_;
+    int outputQueueSize_;
+    OverflowPolicy overflowPolicy_;
+    SchedParams controllerSched_;
+    SchedParams outputSched_;
+    SchedParams logSched_;
+    bool lockMemory_;
+    std::string recordFile_;
+    std::string replayFile_;
+    bool replayFast_;
     
     void handleCmdLine();
     void getLogFromChar(char l);
     void parseConfig();
     bool configFileOK();
     void getModeFromString(const std::string &mode);
+    void getReadModeFromString(const std::string &mode);
+    void getFrameModeFromString(const std::string &mode);
+    void getThreadModelFromString(const std::string &model);
+    void getOutputModeFromString(const std::string &mode);
+    void getOverflowPolicyFromString(const std::string &policy);
+    void getSchedPolicyFromString(const std::string &policy);
+    std::vector<int> getCpusFromString(const std::string &cpus);
+    int getTimeout(const char *name, int scale);
+    ControllerSettings defaultSettings(int index);
+    void getRoleFromString(const std::string &role, ControllerSettings &settings);
     std::string expandTilde(const std::string &str);
 };
 
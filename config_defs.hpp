@@ -53,51 +53,106 @@ namespace psmoveinput
 #define OPT_FOREGROUND "foreground,f"
 #define OPT_FOREGROUND_DESC "run in foreground, do not fork"
 #define OPT_FOREGROUND_ONLYLONG "foreground"
+#define OPT_RECORD "record"
+#define OPT_RECORD_DESC "record controller samples to given file"
+#define OPT_RECORD_ONLYLONG "record"
+#define OPT_REPLAY "replay"
+#define OPT_REPLAY_DESC "replay recorded samples from given file instead of connecting controllers"
+#define OPT_REPLAY_ONLYLONG "replay"
+#define OPT_REPLAY_FAST "replay-fast"
+#define OPT_REPLAY_FAST_DESC "replay as fast as possible rather than in real time"
+#define OPT_REPLAY_FAST_ONLYLONG "replay-fast"
 // config file options
 #define OPT_CONF_PID "PID_FILE"
 #define OPT_CONF_LOG "LOG_LEVEL"
 #define OPT_CONF_LOG_FILE "LOG_FILE"
 #define OPT_MOVEC_X "MOVE_COEFF_X"
 #define OPT_MOVEC_Y "MOVE_COEFF_Y"
-#define OPT_PSBTN_L2 "PSBTN_L2"
-#define OPT_PSBTN_R2 "PSBTN_R2"
-#define OPT_PSBTN_L1 "PSBTN_L1"
-#define OPT_PSBTN_R1 "PSBTN_R1"
-#define OPT_PSBTN_TRIANGLE "PSBTN_TRIANGLE"
-#define OPT_PSBTN_CIRCLE "PSBTN_CIRCLE"
-#define OPT_PSBTN_CROSS "PSBTN_CROSS"
-#define OPT_PSBTN_SQUARE "PSBTN_SQUARE"
-#define OPT_PSBTN_SELECT "PSBTN_SELECT"
-#define OPT_PSBTN_START "PSBTN_START"
-#define OPT_PSBTN_PS "PSBTN_PS"
-#define OPT_PSBTN_MOVE "PSBTN_MOVE"
-#define OPT_PSBTN_T "PSBTN_T"
-#define OPT_PSBTN_1_TRIANGLE "PSBTN_1_TRIANGLE"
-#define OPT_PSBTN_1_CIRCLE "PSBTN_1_CIRCLE"
-#define OPT_PSBTN_1_CROSS "PSBTN_1_CROSS"
-#define OPT_PSBTN_1_SQUARE "PSBTN_1_SQUARE"
-#define OPT_PSBTN_1_SELECT "PSBTN_1_SELECT"
-#define OPT_PSBTN_1_START "PSBTN_1_START"
-#define OPT_PSBTN_1_PS "PSBTN_1_PS"
-#define OPT_PSBTN_1_MOVE "PSBTN_1_MOVE"
-#define OPT_PSBTN_1_T "PSBTN_1_T"
+#define OPT_CONF_CONTROLLERS "CONTROLLERS"
+// per-controller options; the first controller uses plain option name,
+// e.g. PSBTN_CROSS, the others have their index inserted, e.g. PSBTN_2_CROSS
+#define OPT_PSBTN_PREFIX "PSBTN"
+#define OPT_MOVEC_PREFIX "MOVE_COEFF"
+#define OPT_CONF_ROLE "ROLE"
+// gesture options always carry controller index, e.g. GESTURE_3_UP,
+// GESTURE_UP is the same as GESTURE_1_UP
+#define OPT_GESTURE_PREFIX "GESTURE"
+#define OPT_GESTURE_DEF_CONTROLLER 1
+// button names
+#define OPT_BTN_TRIANGLE "TRIANGLE"
+#define OPT_BTN_CIRCLE "CIRCLE"
+#define OPT_BTN_CROSS "CROSS"
+#define OPT_BTN_SQUARE "SQUARE"
+#define OPT_BTN_SELECT "SELECT"
+#define OPT_BTN_START "START"
+#define OPT_BTN_PS "PS"
+#define OPT_BTN_MOVE "MOVE"
+#define OPT_BTN_T "T"
+// gesture names
+#define OPT_GESTURE_UP "UP"
+#define OPT_GESTURE_DOWN "DOWN"
+#define OPT_GESTURE_LEFT "LEFT"
+#define OPT_GESTURE_RIGHT "RIGHT"
 #define OPT_CONF_MODE "MODE"
 #define OPT_CONF_POLL_TIMEOUT "POLL_TIMEOUT"
 #define OPT_CONF_CONN_TIMEOUT "CONN_TIMEOUT"
 #define OPT_CONF_DISCONNECT_TIMEOUT "DISCONNECT_TIMEOUT"
+#define OPT_CONF_DISCONNECT_TIMEOUT_MS "DISCONNECT_TIMEOUT_MS"
 #define OPT_CONF_LED_UPDATE_TIMEOUT "LED_UPDATE_TIMEOUT"
 #define OPT_CONF_MOVE_THRESHOLD "MOVE_THRESHOLD"
-#define OPT_GESTURE_UP "GESTURE_UP"
-#define OPT_GESTURE_DOWN "GESTURE_DOWN"
-#define OPT_GESTURE_LEFT "GESTURE_LEFT"
-#define OPT_GESTURE_RIGHT "GESTURE_RIGHT"
 #define OPT_CONF_GESTURE_THRESHOLD "GESTURE_THRESHOLD"
 #define OPT_CONF_GESTURE_TIMEOUT "GESTURE_TIMEOUT"
+#define OPT_CONF_READ_MODE "READ_MODE"
+#define OPT_CONF_THREAD_MODEL "THREAD_MODEL"
+#define OPT_CONF_SENSOR_FRAMES "SENSOR_FRAMES"
+#define OPT_CONF_OUTPUT_MODE "OUTPUT_MODE"
+#define OPT_CONF_OUTPUT_QUEUE_SIZE "OUTPUT_QUEUE_SIZE"
+#define OPT_CONF_OUTPUT_OVERFLOW "OUTPUT_OVERFLOW"
+#define OPT_CONF_SCHED_POLICY "SCHED_POLICY"
+#define OPT_CONF_SCHED_PRIORITY "SCHED_PRIORITY"
+#define OPT_CONF_CONTROLLER_CPUS "CONTROLLER_CPUS"
+#define OPT_CONF_OUTPUT_CPUS "OUTPUT_CPUS"
+#define OPT_CONF_LOG_CPUS "LOG_CPUS"
+#define OPT_CONF_MLOCKALL "MLOCKALL"
 
 // operation modes
 #define OPT_MODE_STANDALONE "standalone"
 #define OPT_MODE_CLIENT     "client"
 
+// controller read modes
+#define OPT_READ_MODE_EVENT "event"
+#define OPT_READ_MODE_POLL  "poll"
+
+// thread models
+#define OPT_THREAD_MODEL_THREADS "threads"
+#define OPT_THREAD_MODEL_REACTOR "reactor"
+
+// sensor frame modes
+#define OPT_SENSOR_FRAMES_SECOND "second"
+#define OPT_SENSOR_FRAMES_BOTH   "both"
+
+// controller roles
+#define OPT_ROLE_POINTER "pointer"
+#define OPT_ROLE_GESTURE "gesture"
+#define OPT_ROLE_KEYS    "keys"
+
+// output modes
+#define OPT_OUTPUT_MODE_DIRECT   "direct"
+#define OPT_OUTPUT_MODE_PIPELINE "pipeline"
+
+// output queue overflow policies
+#define OPT_OUTPUT_OVERFLOW_DROP  "drop"
+#define OPT_OUTPUT_OVERFLOW_BLOCK "block"
+
+// scheduling policies
+#define OPT_SCHED_POLICY_OTHER "other"
+#define OPT_SCHED_POLICY_FIFO  "fifo"
+#define OPT_SCHED_POLICY_RR    "rr"
+
+// boolean option values
+#define OPT_YES "yes"
+#define OPT_NO  "no"
+
 // special keys handled by psmoveinput itself
 #define KEY_PSMOVE_DISCONNECT           KEY_MAX + 1
 #define KEY_PSMOVE_MOVE_TRIGGER         KEY_MAX + 2
@@ -123,11 +178,22 @@ namespace psmoveinput
 #define DEF_MODE    OPT_MODE_STANDALONE
 #define DEF_POLL_TIMEOUT 20 // ms
 #define DEF_CONN_TIMEOUT 3000 // ms
-#define DEF_DISCONNECT_TIMEOUT 7 // s
+#define DEF_DISCONNECT_TIMEOUT 7000 // ms
 #define DEF_LED_UPDATE_TIMEOUT 4000 // ms
 #define DEF_MOVE_THRESHOLD 0 // pixels
 #define DEF_GESTURE_THRESHOLD 100 // pixels
 #define DEF_GESTURE_TIMEOUT 600 // ms
+// poll, connect and disconnect timeouts drive timers, which cannot be shorter
+#define MIN_TIMER_TIMEOUT 1 // ms
+#define DEF_READ_MODE ReadMode::EVENT
+#define DEF_THREAD_MODEL ThreadModel::PER_CONTROLLER
+#define DEF_SENSOR_FRAMES FrameMode::SECOND_HALF
+#define DEF_OUTPUT_MODE OutputMode::DIRECT
+#define DEF_OUTPUT_QUEUE_SIZE 256 // samples per controller
+#define DEF_OUTPUT_OVERFLOW OverflowPolicy::DROP
+#define DEF_SCHED_POLICY SchedPolicy::OTHER
+#define DEF_SCHED_PRIORITY 20
+#define DEF_MLOCKALL false
 
 } // namespace psmoveinput
 
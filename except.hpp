@@ -34,7 +34,8 @@ enum class ex_type
     ALREADY_RUNNING,
     FORK_FAILED,
     PARENT_QUIT,
-    PIDFILE_CREAT_FAILED
+    PIDFILE_CREAT_FAILED,
+    REPLAY_FAILED
 };
 
 class Exception
@@ -21,18 +21,39 @@
 
 
 #include "file_log.hpp"
-#include <sys/time.h>
-#include <boost/format.hpp>
+#include "sched.hpp"
+#include <cstring>
 
 namespace psmoveinput
 {
 
-FileLog::FileLog()
+FileLog::FileLog(size_t queueSize) :
+    queue_(queueSize),
+    dropped_(0),
+    totalDropped_(0),
+    writer_(nullptr),
+    stop_(false),
+    flushRequests_(0),
+    flushesDone_(0)
 {
+    writerSched_.policy = SchedPolicy::OTHER;
+    writerSched_.priority = 0;
 }
 
 FileLog::~FileLog()
 {
+    if (writer_ != nullptr)
+    {
+        // writer thread writes out everything still queued before exiting
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        writer_->join();
+        delete writer_;
+    }
+
     if (file_.is_open())
     {
         file_.close();
@@ -43,32 +64,126 @@ void FileLog::init(const LogParams &params)
 {
     filename_ = params.logfile;
     file_.open(filename_.c_str(), std::ios_base::out | std::ios_base::ate);
+    if (file_.good())
+    {
+        writer_ = new boost::thread(&FileLog::writerThread, this);
+    }
 }
 
-void FileLog::write(const char *msg)
+void FileLog::write(const char *msg, LogLevel lvl)
 {
-    if (!file_.good())
+    // file stream is owned by writer thread, so writer thread
+    // presence is the only thing we can check here
+    if (writer_ == nullptr)
     {
         return;
     }
 
-    std::string message = getTimestamp();
-    message += msg;
-    file_ << message.c_str() << "\n";
-    file_.flush();
+    Record record;
+    gettimeofday(&record.tv, nullptr);
+    size_t len = strnlen(msg, LOG_RECORD_SIZE - 1);
+    std::memcpy(record.msg, msg, len);
+    record.msg[len] = 0;
+
+    while (queue_.push(record) == false)
+    {
+        if (lvl != LogLevel::FATAL)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            totalDropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // fatal message is likely to be the last one, so it waits
+        // for the writer to empty the queue instead of being dropped
+        flush();
+    }
+
+    if (queue_.size() > (queue_.capacity() / 2))
+    {
+        // don't wait for the writer to wake up by itself
+        cond_.notify_all();
+    }
+}
+
+void FileLog::flush()
+{
+    if (writer_ == nullptr)
+    {
+        return;
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    unsigned long request = ++flushRequests_;
+    cond_.notify_all();
+    while (flushesDone_ < request)
+    {
+        cond_.wait(lock);
+    }
+}
+
+void FileLog::writerThread()
+{
+    std::string error;
+    if (applySchedParams(writerSched_, error) == false)
+    {
+        write(("FileLog: failed to set up scheduling of writer thread (" + error + "), using defaults").c_str(),
+              LogLevel::ERROR);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    while (true)
+    {
+        bool stop = stop_;
+        unsigned long requests = flushRequests_;
+
+        lock.unlock();
+        writeRecords();
+        lock.lock();
+
+        if (requests > flushesDone_)
+        {
+            flushesDone_ = requests;
+            cond_.notify_all();
+        }
+
+        if (stop == true)
+        {
+            break;
+        }
+
+        if ((stop_ == false) && (flushRequests_ == flushesDone_))
+        {
+            cond_.timed_wait(lock, boost::posix_time::millisec(LOG_WRITER_INTERVAL));
+        }
+    }
 }
 
-std::string FileLog::getTimestamp()
+void FileLog::writeRecords()
 {
-    timeval tv;
-    std::string ret;
+    Record record;
+    bool written = false;
 
-    if (gettimeofday(&tv, nullptr) == 0)
+    while (queue_.pop(record) == true)
     {
-        ret = boost::str(boost::format("%1%.%2%: ") % tv.tv_sec % tv.tv_usec);
+        file_ << record.tv.tv_sec << "." << record.tv.tv_usec << ": " << record.msg << "\n";
+        written = true;
     }
 
-    return ret;
+    unsigned long dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+    {
+        timeval tv;
+        gettimeofday(&tv, nullptr);
+        file_ << tv.tv_sec << "." << tv.tv_usec << ": " << dropped << " log messages dropped\n";
+        written = true;
+    }
+
+    // single flush per batch instead of one per message
+    if (written == true)
+    {
+        file_.flush();
+    }
 }
 
 } // namespace psmoveinput
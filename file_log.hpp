@@ -1,4 +1,4 @@
-/* 
+/*
  * Copyright (C) 2012, 2013, 2014 Mikhail Sapozhnikov
  *
  * This file is part of psmoveinput.
@@ -24,26 +24,64 @@
 #define PSMOVEINPUT_FILE_LOG_HPP
 
 #include "log.hpp"
+#include "bounded_queue.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <atomic>
 #include <fstream>
+#include <sys/time.h>
 
 namespace psmoveinput
 {
 
+#define LOG_RECORD_SIZE 256         // longer messages are truncated
+#define DEF_LOG_QUEUE_SIZE 1024     // records
+#define LOG_WRITER_INTERVAL 100     // ms
+
 // log backend, which outputs data to a file
+// write() only copies the message into a lock-free queue, the file itself is
+// written by a background thread in batches; when the queue is full,
+// messages are dropped and the number of dropped messages is logged later;
+// fatal messages are never dropped, they wait for the writer to make room
 class FileLog : public LogBackend
 {
 public:
-    FileLog();
+    FileLog(size_t queueSize = DEF_LOG_QUEUE_SIZE);
     virtual ~FileLog();
 
+    // scheduling settings of the writer thread, have to be set before init()
+    void setWriterSched(const SchedParams &params) { writerSched_ = params; }
     virtual void init(const LogParams &params);
-    virtual void write(const char *msg);
+    virtual void write(const char *msg, LogLevel lvl);
+    // block until all queued messages are written to the file
+    virtual void flush();
+
+    // total number of messages dropped because of full queue
+    unsigned long getDropped() { return totalDropped_.load(std::memory_order_relaxed); }
 
 protected:
+    struct Record
+    {
+        timeval tv;
+        char msg[LOG_RECORD_SIZE];
+    };
+
     std::string filename_;
     std::ofstream file_;
+    BoundedQueue<Record> queue_;
+    std::atomic<unsigned long> dropped_;
+    std::atomic<unsigned long> totalDropped_;
+    boost::thread *writer_;
+    SchedParams writerSched_;
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    bool stop_;
+    unsigned long flushRequests_;
+    unsigned long flushesDone_;
 
-    std::string getTimestamp();
+    void writerThread();
+    void writeRecords();
 };
 
 } // namespace psmoveinput
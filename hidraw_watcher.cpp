@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "hidraw_watcher.hpp"
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace psmoveinput
+{
+
+#define HIDRAW_SYSFS_DIR "/sys/class/hidraw"
+#define HIDRAW_UNIQ_KEY "HID_UNIQ="
+#define HIDRAW_REPORT_SIZE 64
+
+static std::string toLower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return str;
+}
+
+HidrawWatcher::HidrawWatcher() :
+    fd_(-1)
+{
+}
+
+HidrawWatcher::~HidrawWatcher()
+{
+    close();
+}
+
+bool HidrawWatcher::open(const std::string &btaddr)
+{
+    close();
+
+    std::string device = findDevice(btaddr);
+    if (device.empty())
+    {
+        return false;
+    }
+
+    fd_ = ::open(device.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    device_ = device;
+    return true;
+}
+
+void HidrawWatcher::close()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    device_.clear();
+}
+
+bool HidrawWatcher::wait(int timeout)
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int ret = poll(&pfd, 1, timeout);
+    if ((ret <= 0) || ((pfd.revents & POLLIN) == 0))
+    {
+        // timeout, signal interruption or the device is gone;
+        // in the latter case disconnect timeout takes care of the controller
+        return false;
+    }
+
+    drain();
+    return true;
+}
+
+void HidrawWatcher::drain()
+{
+    unsigned char report[HIDRAW_REPORT_SIZE];
+
+    while (read(fd_, report, sizeof (report)) > 0)
+    {
+    }
+}
+
+std::string HidrawWatcher::findDevice(const std::string &btaddr)
+{
+    std::string uniq = toLower(btaddr);
+    std::string device;
+
+    if (uniq.empty())
+    {
+        return device;
+    }
+
+    DIR *dir = opendir(HIDRAW_SYSFS_DIR);
+    if (dir == nullptr)
+    {
+        return device;
+    }
+
+    // Bluetooth HID devices report remote device address as their unique id
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, 6, "hidraw") != 0)
+        {
+            continue;
+        }
+
+        std::ifstream uevent(std::string(HIDRAW_SYSFS_DIR) + "/" + name + "/device/uevent");
+        std::string line;
+        while (std::getline(uevent, line))
+        {
+            if ((line.compare(0, sizeof (HIDRAW_UNIQ_KEY) - 1, HIDRAW_UNIQ_KEY) == 0) &&
+                (toLower(line.substr(sizeof (HIDRAW_UNIQ_KEY) - 1)) == uniq))
+            {
+                device = "/dev/" + name;
+                break;
+            }
+        }
+
+        if (device.empty() == false)
+        {
+            break;
+        }
+    }
+
+    closedir(dir);
+    return device;
+}
+
+} // namespace psmoveinput
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_HIDRAW_WATCHER_HPP
+#define PSMOVEINPUT_HIDRAW_WATCHER_HPP
+
+#include <string>
+
+namespace psmoveinput
+{
+
+// HidrawWatcher opens its own read-only descriptor on the hidraw node of
+// a controller and lets controller thread sleep until the next input report
+// arrives. The kernel delivers every report to each open hidraw descriptor,
+// so reading from our copy does not steal any data from psmoveapi.
+class HidrawWatcher
+{
+public:
+    HidrawWatcher();
+    virtual ~HidrawWatcher();
+
+    // find hidraw node of the controller with given Bluetooth address and open it
+    bool open(const std::string &btaddr);
+    void close();
+    bool isOpen() { return (fd_ >= 0); }
+    int getFd() { return fd_; }
+    const std::string &getDevice() { return device_; }
+
+    // block until a report arrives or timeout (ms) expires;
+    // returns true if there is new data to be fetched with psmove_poll()
+    bool wait(int timeout);
+    // discard pending reports from our copy of the report queue
+    void drain();
+
+    HidrawWatcher(const HidrawWatcher &) = delete;
+    HidrawWatcher &operator = (const HidrawWatcher &) = delete;
+
+protected:
+    int fd_;
+    std::string device_;
+
+    std::string findDevice(const std::string &btaddr);
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_HIDRAW_WATCHER_HPP
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "hotplug_monitor.hpp"
+#include "common.hpp"
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/input.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+
+namespace psmoveinput
+{
+
+#define UEVENT_BUFFER_SIZE      8192
+#define UEVENT_KERNEL_GROUP     1
+#define UEVENT_UDEV_GROUP       2
+#define UDEV_CONTROL            "/run/udev/control"
+#define UDEV_PREFIX             "libudev"
+#define UDEV_MAGIC              0xfeedcafe
+#define HID_ID_KEY              "HID_ID="
+#define HID_UNIQ_KEY            "HID_UNIQ="
+
+// header of messages sent by udev, followed by the properties
+struct UdevHeader
+{
+    char prefix[8];
+    unsigned int magic;
+    unsigned int headerSize;
+    unsigned int propertiesOff;
+    unsigned int propertiesLen;
+    unsigned int filterSubsystemHash;
+    unsigned int filterDevtypeHash;
+    unsigned int filterTagBloomHi;
+    unsigned int filterTagBloomLo;
+};
+
+static std::string toLower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return str;
+}
+
+HotplugMonitor::HotplugMonitor(const std::string &sysfsRoot) :
+    fd_(-1),
+    udev_(false),
+    sysfsRoot_(sysfsRoot)
+{
+}
+
+HotplugMonitor::~HotplugMonitor()
+{
+    close();
+}
+
+bool HotplugMonitor::open()
+{
+    close();
+
+    fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    // kernel events may come before udev has created the device node
+    // and set its permissions, so prefer udev ones if it is running
+    udev_ = (access(UDEV_CONTROL, F_OK) == 0);
+
+    sockaddr_nl addr;
+    memset(&addr, 0, sizeof (addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = udev_ ? UEVENT_UDEV_GROUP : UEVENT_KERNEL_GROUP;
+
+    int on = 1;
+    if ((bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof (addr)) != 0) ||
+        (setsockopt(fd_, SOL_SOCKET, SO_PASSCRED, &on, sizeof (on)) != 0))
+    {
+        close();
+        return false;
+    }
+
+    scan();
+    return true;
+}
+
+void HotplugMonitor::close()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    devices_.clear();
+}
+
+bool HotplugMonitor::read(Event &event)
+{
+    char buf[UEVENT_BUFFER_SIZE];
+    char control[CMSG_SPACE(sizeof (ucred))];
+    sockaddr_nl addr;
+    iovec iov;
+    msghdr msg;
+
+    event.action = Action::NONE;
+
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    iov.iov_base = buf;
+    iov.iov_len = sizeof (buf);
+    memset(&msg, 0, sizeof (msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof (addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+
+    ssize_t len = recvmsg(fd_, &msg, 0);
+    if (len <= 0)
+    {
+        return false;
+    }
+
+    // only trust messages coming from the kernel or from root's udev
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if ((cmsg == nullptr) || (cmsg->cmsg_type != SCM_CREDENTIALS))
+    {
+        return true;
+    }
+    ucred cred;
+    memcpy(&cred, CMSG_DATA(cmsg), sizeof (cred));
+    if ((cred.uid != 0) || ((udev_ == false) && (addr.nl_pid != 0)))
+    {
+        return true;
+    }
+
+    parse(buf, len, event);
+    return true;
+}
+
+bool HotplugMonitor::parse(const char *buf, size_t len, Event &event)
+{
+    const char *props = buf;
+    const char *end = buf + len;
+
+    event.action = Action::NONE;
+    event.device.clear();
+    event.uniq.clear();
+    event.bluetooth = false;
+
+    if ((len >= sizeof (UdevHeader)) && (memcmp(buf, UDEV_PREFIX, sizeof (UDEV_PREFIX)) == 0))
+    {
+        UdevHeader header;
+        memcpy(&header, buf, sizeof (header));
+        if ((ntohl(header.magic) != UDEV_MAGIC) ||
+            (header.propertiesOff + header.propertiesLen > len))
+        {
+            return false;
+        }
+        props = buf + header.propertiesOff;
+        end = props + header.propertiesLen;
+    }
+    else
+    {
+        // kernel messages start with action@devpath
+        const char *header = static_cast<const char*>(memchr(buf, '\0', len));
+        if ((header == nullptr) || (strchr(buf, '@') == nullptr))
+        {
+            return false;
+        }
+        props = header + 1;
+    }
+
+    std::string action;
+    std::string devpath;
+    std::string subsystem;
+    std::string devname;
+
+    while (props < end)
+    {
+        size_t propLen = strnlen(props, end - props);
+        std::string prop(props, propLen);
+        props += propLen + 1;
+
+        size_t sep = prop.find('=');
+        if (sep == std::string::npos)
+        {
+            continue;
+        }
+        std::string key = prop.substr(0, sep);
+        if (key == "ACTION")
+        {
+            action = prop.substr(sep + 1);
+        }
+        else if (key == "DEVPATH")
+        {
+            devpath = prop.substr(sep + 1);
+        }
+        else if (key == "SUBSYSTEM")
+        {
+            subsystem = prop.substr(sep + 1);
+        }
+        else if (key == "DEVNAME")
+        {
+            devname = prop.substr(sep + 1);
+        }
+    }
+
+    if ((subsystem != "hidraw") || devpath.empty())
+    {
+        return true;
+    }
+
+    // kernel gives node name relative to /dev, udev gives full path
+    if (devname.empty())
+    {
+        devname = devpath.substr(devpath.rfind('/') + 1);
+    }
+    if (devname[0] != '/')
+    {
+        devname = "/dev/" + devname;
+    }
+
+    if (action == "add")
+    {
+        Device device;
+        if (readDevice(devpath, device) == true)
+        {
+            devices_[devpath] = device;
+            event.action = Action::ADD;
+            event.device = devname;
+            event.uniq = device.uniq;
+            event.bluetooth = device.bluetooth;
+        }
+    }
+    else if (action == "remove")
+    {
+        // sysfs entry is already gone, so we can only recognize devices seen before
+        auto it = devices_.find(devpath);
+        if (it != devices_.end())
+        {
+            event.action = Action::REMOVE;
+            event.device = devname;
+            event.uniq = it->second.uniq;
+            event.bluetooth = it->second.bluetooth;
+            devices_.erase(it);
+        }
+    }
+
+    return true;
+}
+
+bool HotplugMonitor::readDevice(const std::string &devpath, Device &device)
+{
+    std::ifstream uevent(sysfsRoot_ + devpath + "/device/uevent");
+    std::string line;
+    unsigned int bus = 0;
+    unsigned int vendor = 0;
+    unsigned int product = 0;
+    bool found = false;
+
+    device.uniq.clear();
+    device.bluetooth = false;
+
+    while (std::getline(uevent, line))
+    {
+        if (line.compare(0, sizeof (HID_ID_KEY) - 1, HID_ID_KEY) == 0)
+        {
+            found = (sscanf(line.c_str() + sizeof (HID_ID_KEY) - 1, "%x:%x:%x", &bus, &vendor, &product) == 3);
+        }
+        else if (line.compare(0, sizeof (HID_UNIQ_KEY) - 1, HID_UNIQ_KEY) == 0)
+        {
+            device.uniq = toLower(line.substr(sizeof (HID_UNIQ_KEY) - 1));
+        }
+    }
+
+    if ((found == false) || (vendor != PSMOVE_VENDOR_ID) || (product != PSMOVE_PRODUCT_ID))
+    {
+        return false;
+    }
+
+    device.bluetooth = (bus == BUS_BLUETOOTH);
+    return true;
+}
+
+void HotplugMonitor::scan()
+{
+    char root[PATH_MAX];
+    char path[PATH_MAX];
+    std::string classDir = sysfsRoot_ + "/class/hidraw";
+
+    if (realpath(sysfsRoot_.c_str(), root) == nullptr)
+    {
+        return;
+    }
+
+    DIR *dir = opendir(classDir.c_str());
+    if (dir == nullptr)
+    {
+        return;
+    }
+
+    // entries of the class directory are links to the devices
+    dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, 6, "hidraw") != 0)
+        {
+            continue;
+        }
+
+        if (realpath((classDir + "/" + name).c_str(), path) == nullptr)
+        {
+            continue;
+        }
+        std::string devpath = path;
+        if (devpath.compare(0, strlen(root), root) != 0)
+        {
+            continue;
+        }
+        devpath = devpath.substr(strlen(root));
+
+        Device device;
+        if (readDevice(devpath, device) == true)
+        {
+            devices_[devpath] = device;
+        }
+    }
+
+    closedir(dir);
+}
+
+} // namespace psmoveinput
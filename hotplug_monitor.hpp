@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_HOTPLUG_MONITOR_HPP
+#define PSMOVEINPUT_HOTPLUG_MONITOR_HPP
+
+#include <map>
+#include <string>
+#include <cstddef>
+
+namespace psmoveinput
+{
+
+// HotplugMonitor listens to netlink uevents and reports hidraw nodes of
+// PSMove controllers being added and removed. When udev is running, events
+// are taken from udev after it has processed them, so that the device node
+// is ready to be opened by psmoveapi; otherwise they come straight from the kernel.
+class HotplugMonitor
+{
+public:
+    enum class Action : unsigned char
+    {
+        NONE = 0,   // event does not concern PSMove controllers
+        ADD,
+        REMOVE
+    };
+
+    struct Event
+    {
+        Action action;
+        std::string device;     // hidraw node, e.g. /dev/hidraw3
+        std::string uniq;       // Bluetooth address of the controller in lower case
+        bool bluetooth;         // connected via Bluetooth rather than USB
+    };
+
+    HotplugMonitor(const std::string &sysfsRoot = "/sys");
+    virtual ~HotplugMonitor();
+
+    // start listening; controllers already present are remembered,
+    // so that their removal gets reported
+    bool open();
+    void close();
+    bool isOpen() { return (fd_ >= 0); }
+    int getFd() { return fd_; }
+
+    // fetch one pending uevent without blocking;
+    // returns false if there are no more pending events
+    bool read(Event &event);
+    // parse a single uevent message as received from netlink socket
+    bool parse(const char *buf, size_t len, Event &event);
+
+    HotplugMonitor(const HotplugMonitor &) = delete;
+    HotplugMonitor &operator = (const HotplugMonitor &) = delete;
+
+protected:
+    struct Device
+    {
+        std::string uniq;
+        bool bluetooth;
+    };
+
+    int fd_;
+    bool udev_;
+    std::string sysfsRoot_;
+    // known controllers by sysfs device path
+    std::map<std::string, Device> devices_;
+
+    bool readDevice(const std::string &devpath, Device &device);
+    void scan();
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_HOTPLUG_MONITOR_HPP
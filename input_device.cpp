@@ -22,21 +22,26 @@
 
 #include "input_device.hpp"
 #include <fcntl.h>
+#include <cerrno>
 #include <cstring>
 #include <cstdio>
 #include <stdexcept>
+#include <time.h>
 #include <boost/format.hpp>
 
 namespace psmoveinput
 {
 
 #define UINPUT_FILE_NAME "/dev/uinput"
-#define PSMOVE_VENDOR_ID 0x054C
-#define PSMOVE_PRODUCT_ID 0x03D5
+// failed writes are logged at most once per that many ns
+#define WRITE_ERROR_LOG_INTERVAL    1000000000LL
 
 InputDevice::InputDevice(const char *devname, key_array &keys, Log &log) :
+    uinput_(true),
     devname_(devname),
-    log_(log)
+    log_(log),
+    droppedFrames_(0),
+    lastErrorNs_(-WRITE_ERROR_LOG_INTERVAL)
 {
     fd_ = open(UINPUT_FILE_NAME, O_WRONLY | O_NONBLOCK);
     if (fd_ < 0)
@@ -67,89 +72,224 @@ InputDevice::InputDevice(const char *devname, key_array &keys, Log &log) :
     ioctl(fd_, UI_DEV_CREATE);
 }
 
+InputDevice::InputDevice(const char *devname, int fd, Log &log) :
+    fd_(fd),
+    uinput_(false),
+    devname_(devname),
+    log_(log),
+    droppedFrames_(0),
+    lastErrorNs_(-WRITE_ERROR_LOG_INTERVAL)
+{
+}
+
 InputDevice::~InputDevice()
 {
-    ioctl(fd_, UI_DEV_DESTROY);
+    if (uinput_ == true)
+    {
+        ioctl(fd_, UI_DEV_DESTROY);
+    }
     close(fd_);
 }
 
-void InputDevice::reportMove(int dx, int dy)
+// frame currently being collected by the calling thread
+struct OpenFrame
 {
-    input_event event[2];
+    InputDevice *device;    // nullptr if there is no open frame
+    InputFrame frame;
+};
+
+static thread_local OpenFrame openFrame = {};
 
-    std::memset(event, 0, sizeof (event));
+static void clearFrame(InputFrame *frame)
+{
+    frame->count = 0;
+    frame->rel[0] = frame->rel[1] = frame->rel[2] = -1;
+}
+
+static int relIndex(int code)
+{
+    return (code == REL_X) ? 0 : ((code == REL_Y) ? 1 : 2);
+}
+
+void InputDevice::reportMove(int dx, int dy)
+{
+    InputFrame single;
+    InputFrame *frame = getFrame(single);
 
     if (dx != 0)
     {
-        event[0].type = EV_REL;
-        event[0].code = REL_X;
-        event[0].value = dx;
+        addRel(frame, REL_X, dx);
     }
     if (dy != 0)
     {
-        event[1].type = EV_REL;
-        event[1].code = REL_Y;
-        event[1].value = dy;
+        addRel(frame, REL_Y, dy);
     }
 
-    if (dx != 0)
+    if (frame == &single)
     {
-        write(fd_, &event[0], sizeof (input_event));
+        reportFrame(frame);
     }
-    if (dy != 0)
+
+    LOG_TRACE(log_, boost::str(boost::format("InputDevice::reportMove(%1%, %2%)") % dx % dy).c_str());
+}
+
+void InputDevice::reportKey(int code, bool pressed)
+{
+    InputFrame single;
+    InputFrame *frame = getFrame(single);
+
+    addKey(frame, code, pressed == true ? 1 : 0);
+
+    if (frame == &single)
     {
-        write(fd_, &event[1], sizeof (input_event));
+        reportFrame(frame);
     }
 
-    reportSyn();
+    LOG_TRACE(log_, boost::str(boost::format("InputDevice::reportKey(%1%, %2%)") % code % pressed).c_str());
+}
+
+void InputDevice::reportMWheel(int value)
+{
+    InputFrame single;
+    InputFrame *frame = getFrame(single);
+
+    addRel(frame, REL_WHEEL, value);
+
+    if (frame == &single)
+    {
+        reportFrame(frame);
+    }
 
-    log_.write(boost::str(boost::format("InputDevice::reportMove(%1%, %2%)") % dx % dy).c_str());
+    LOG_TRACE(log_, boost::str(boost::format("InputDevice::reportMWheel(%1%)") % value).c_str());
 }
 
-void InputDevice::reportKey(int code, bool pressed)
+void InputDevice::beginFrame()
 {
-    input_event event;
+    if ((openFrame.device != nullptr) && (openFrame.device != this))
+    {
+        // the thread forgot to close a frame of another device
+        openFrame.device->reportFrame(&openFrame.frame);
+    }
 
-    std::memset(&event, 0, sizeof (event));
+    if (openFrame.device != this)
+    {
+        openFrame.device = this;
+        clearFrame(&openFrame.frame);
+    }
+}
 
-    event.type = EV_KEY;
-    event.code = code;
-    event.value = pressed == true ? 1 : 0;
+void InputDevice::endFrame()
+{
+    if (openFrame.device == this)
+    {
+        openFrame.device = nullptr;
+        reportFrame(&openFrame.frame);
+    }
+}
 
-    write(fd_, &event, sizeof (event));
+void InputDevice::logStats()
+{
+    log_.write(boost::str(boost::format("InputDevice: %1% frames dropped") % droppedFrames_.load()).c_str());
+}
 
-    reportSyn();
+InputFrame *InputDevice::getFrame(InputFrame &single)
+{
+    if (openFrame.device == this)
+    {
+        return &openFrame.frame;
+    }
 
-    log_.write(boost::str(boost::format("InputDevice::reportKey(%1%, %2%)") % code % pressed).c_str());
+    // no open frame, the event is sent on its own
+    clearFrame(&single);
+    return &single;
 }
 
-void InputDevice::reportMWheel(int value)
+void InputDevice::addRel(InputFrame *frame, int code, int value)
 {
-    input_event event;
+    int index = relIndex(code);
 
-    std::memset(&event, 0, sizeof (event));
+    if (frame->rel[index] >= 0)
+    {
+        // accumulate motion instead of sending several events for the same axis
+        frame->events[frame->rel[index]].value += value;
+        return;
+    }
 
+    if (frame->count == INPUT_FRAME_SIZE)
+    {
+        reportFrame(frame);
+    }
+
+    input_event &event = frame->events[frame->count];
+    std::memset(&event, 0, sizeof (event));
     event.type = EV_REL;
-    event.code = REL_WHEEL;
+    event.code = code;
     event.value = value;
+    frame->rel[index] = frame->count;
+    frame->count++;
+}
 
-    write(fd_, &event, sizeof (event));
+void InputDevice::addKey(InputFrame *frame, int code, int value)
+{
+    // the same key changing its state twice within one frame would be lost
+    // by the clients, so such frame is split in two
+    for (int i = 0; i < frame->count; i++)
+    {
+        if ((frame->events[i].type == EV_KEY) && (frame->events[i].code == code))
+        {
+            reportFrame(frame);
+            break;
+        }
+    }
 
-    reportSyn();
+    if (frame->count == INPUT_FRAME_SIZE)
+    {
+        reportFrame(frame);
+    }
 
-    log_.write(boost::str(boost::format("InputDevice::reportMWheel(%1%)") % value).c_str());
+    input_event &event = frame->events[frame->count];
+    std::memset(&event, 0, sizeof (event));
+    event.type = EV_KEY;
+    event.code = code;
+    event.value = value;
+    frame->count++;
 }
 
-void InputDevice::reportSyn()
+void InputDevice::reportFrame(InputFrame *frame)
 {
-    input_event event;
-
-    std::memset(&event, 0, sizeof (event));
+    // empty frame is not worth a syscall
+    if (frame->count > 0)
+    {
+        input_event &syn = frame->events[frame->count];
+        std::memset(&syn, 0, sizeof (syn));
+        syn.type = EV_SYN;
+        syn.code = SYN_REPORT;
+        syn.value = 0;
+
+        // uinput handles the whole buffer under a single lock, so the frame
+        // cannot be interleaved with events written by another thread
+        if (write(fd_, frame->events, sizeof (input_event) * (frame->count + 1)) < 0)
+        {
+            int error = errno;
+            unsigned long dropped = ++droppedFrames_;
+
+            // a full device fails every frame for a while, so only
+            // the first failure of every second makes it to the log
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+            long long nowNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+            long long last = lastErrorNs_.load();
+            if ((nowNs - last >= WRITE_ERROR_LOG_INTERVAL) &&
+                (lastErrorNs_.compare_exchange_strong(last, nowNs) == true))
+            {
+                log_.write(boost::str(boost::format("InputDevice: failed to write input frame (%1%), %2% frames dropped so far")
+                                      % strerror(error) % dropped).c_str(),
+                           LogLevel::ERROR);
+            }
+        }
+    }
 
-    event.type = EV_SYN;
-    event.code = SYN_REPORT;
-    event.value = 0;
-    write(fd_, &event, sizeof (event));
+    clearFrame(frame);
 }
 
 } // namespace psmoveinput
@@ -24,6 +24,7 @@
 #define PSMOVEINPUT_INPUT_DEVICE_HPP
 
 #include "log.hpp"
+#include <atomic>
 #include <linux/uinput.h>
 #include <vector>
 #include <string>
@@ -33,10 +34,24 @@ namespace psmoveinput
 
 typedef std::vector<int> key_array;
 
+#define INPUT_FRAME_SIZE 32     // events, not including SYN_REPORT
+
+// events collected for a single controller sample
+struct InputFrame
+{
+    input_event events[INPUT_FRAME_SIZE + 1];   // + SYN_REPORT
+    int count;
+    // positions of REL_X, REL_Y and REL_WHEEL events in the frame, or -1
+    int rel[3];
+};
+
 class InputDevice
 {
 public:
     InputDevice(const char *devname, key_array &keys, Log &log);
+    // frames are written to fd, which is not a uinput device, e.g. an in-memory
+    // file of a benchmark; the device takes the descriptor over
+    InputDevice(const char *devname, int fd, Log &log);
     virtual ~InputDevice();
 
     const char *getDeviceName() { return devname_.c_str(); }
@@ -44,12 +59,32 @@ public:
     void reportKey(int code, bool pressed);
     void reportMWheel(int value);
 
+    // Events reported between beginFrame() and endFrame() by the same thread
+    // are collected and written to the device with a single write() and
+    // a single SYN_REPORT, so that the compositor sees them as one atomic
+    // update. Relative motion within a frame is summed up. Outside of
+    // a frame every report*() call is sent as a frame of its own.
+    void beginFrame();
+    void endFrame();
+
+    // frames the device failed to take, e.g. when its buffer is full
+    unsigned long getDroppedFrames() { return droppedFrames_.load(); }
+    void logStats();
+
 protected:
     int fd_;
+    // fd_ is a uinput device created by us
+    bool uinput_;
     std::string devname_;
     Log &log_;
+    std::atomic<unsigned long> droppedFrames_;
+    // when a failed write was logged last time, CLOCK_MONOTONIC_RAW
+    std::atomic<long long> lastErrorNs_;
 
-    void reportSyn();
+    InputFrame *getFrame(InputFrame &single);
+    void addRel(InputFrame *frame, int code, int value);
+    void addKey(InputFrame *frame, int code, int value);
+    void reportFrame(InputFrame *frame);
 };
         
 } // namespace psmoveinput
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_LATENCY_HISTOGRAM_HPP
+#define PSMOVEINPUT_LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cmath>
+
+namespace psmoveinput
+{
+
+// each power of two range is split into 2^LATENCY_SUB_BITS buckets,
+// which keeps relative error of reported values within 1 / 2^LATENCY_SUB_BITS
+#define LATENCY_SUB_BITS    5
+#define LATENCY_SUB_COUNT   (1 << LATENCY_SUB_BITS)
+// values up to 2^(LATENCY_MAX_SHIFT + LATENCY_SUB_BITS + 1) ns (about 18 minutes),
+// larger ones are counted in the last bucket
+#define LATENCY_MAX_SHIFT   35
+#define LATENCY_BUCKETS     ((LATENCY_MAX_SHIFT + 2) * LATENCY_SUB_COUNT)
+
+// HDR style histogram of latencies in nanoseconds. Memory is allocated once
+// and record() is just a couple of relaxed atomic increments, so it may be
+// called on the hot path by any number of threads, while another thread
+// reads the percentiles.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    void record(long long ns)
+    {
+        unsigned long long value = (ns > 0) ? static_cast<unsigned long long>(ns) : 0;
+
+        counts_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+
+        unsigned long long max = max_.load(std::memory_order_relaxed);
+        while ((value > max) && (max_.compare_exchange_weak(max, value, std::memory_order_relaxed) == false))
+        {
+        }
+    }
+
+    unsigned long long getCount() const { return count_.load(std::memory_order_relaxed); }
+    unsigned long long getMax() const { return max_.load(std::memory_order_relaxed); }
+
+    // the smallest value, which is not exceeded by given fraction of
+    // recorded values (e.g. 0.99), rounded up to the bucket boundary
+    unsigned long long getPercentile(double fraction) const
+    {
+        unsigned long long count = getCount();
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        unsigned long long target = static_cast<unsigned long long>(std::ceil(fraction * count));
+        if (target == 0)
+        {
+            target = 1;
+        }
+
+        unsigned long long total = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            total += counts_[i].load(std::memory_order_relaxed);
+            if (total >= target)
+            {
+                unsigned long long upper = bucketUpper(i);
+                unsigned long long max = getMax();
+                return (upper < max) ? upper : max;
+            }
+        }
+
+        // the counters have been updated while we were reading them
+        return getMax();
+    }
+
+    // not to be called while values are being recorded
+    void reset()
+    {
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            counts_[i].store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator = (const LatencyHistogram &) = delete;
+
+protected:
+    static int bucketIndex(unsigned long long value)
+    {
+        int shift = 0;
+
+        if (value >= 2 * LATENCY_SUB_COUNT)
+        {
+            // position of the highest bit set minus the sub-bucket bits
+            shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BITS;
+        }
+        if (shift > LATENCY_MAX_SHIFT)
+        {
+            return LATENCY_BUCKETS - 1;
+        }
+
+        return shift * LATENCY_SUB_COUNT + static_cast<int>(value >> shift);
+    }
+
+    // the largest value counted in given bucket
+    static unsigned long long bucketUpper(int index)
+    {
+        if (index < 2 * LATENCY_SUB_COUNT)
+        {
+            return index;
+        }
+
+        int shift = index / LATENCY_SUB_COUNT - 1;
+        unsigned long long top = index - shift * LATENCY_SUB_COUNT;
+        return ((top + 1) << shift) - 1;
+    }
+
+    std::atomic<unsigned long long> counts_[LATENCY_BUCKETS];
+    std::atomic<unsigned long long> count_;
+    std::atomic<unsigned long long> max_;
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_LATENCY_HISTOGRAM_HPP
@@ -101,7 +101,13 @@ void Log::write(const char *msg, LogLevel lvl)
         {
             if (backend != nullptr)
             {
-                backend->write(msg);
+                backend->write(msg, lvl);
+                // fatal message is likely to be the last one,
+                // so don't let it get lost in a buffer
+                if (lvl == LogLevel::FATAL)
+                {
+                    backend->flush();
+                }
             }
         }
     }
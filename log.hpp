@@ -45,8 +45,11 @@ struct LogParams
 class LogBackend
 {
 public:
+    virtual ~LogBackend() {}
     virtual void init(const LogParams &params) = 0;
-    virtual void write(const char *msg) = 0;
+    virtual void write(const char *msg, LogLevel lvl) = 0;
+    // make sure everything written so far has reached its destination
+    virtual void flush() {}
 };
 
 class Log
@@ -60,6 +63,9 @@ public:
     // memory occupied by backend object
 
     void write(const char *msg, LogLevel lvl = LogLevel::INFO);
+    // check if messages of given level get written anywhere;
+    // use it to avoid building messages, which would be filtered out anyway
+    bool enabled(LogLevel lvl) const { return ((lvl <= params_.loglevel) && (backends_.empty() == false)); }
 
     Log(const Log &) = delete;
     Log &operator = (const Log &) = delete;
@@ -68,6 +74,20 @@ protected:
     LogParams params_;
 };
 
+// write a message only if its level is enabled; the message expression
+// is not evaluated at all otherwise
+#define LOG_WRITE(log, lvl, msg) \
+    do { if ((log).enabled(lvl)) { (log).write((msg), (lvl)); } } while (0)
+
+// tracing of every controller sample and every input event,
+// compiled out completely in release builds; the arguments are only
+// used in sizeof, so variables kept for tracing don't trigger warnings
+#ifdef PSMOVEINPUT_NO_TRACE
+#define LOG_TRACE(log, msg) do { (void)sizeof(log); (void)sizeof(msg); } while (0)
+#else
+#define LOG_TRACE(log, msg) LOG_WRITE(log, LogLevel::INFO, msg)
+#endif
+
 } // namespace psmoveinput
 
 #endif // PSMOVEINPUT_LOG_HPP
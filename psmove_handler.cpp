@@ -27,126 +27,225 @@
 namespace psmoveinput
 {
 
-PSMoveHandler::PSMoveHandler(const key_map &keymap1,
-                             const key_map &keymap2,
-                             const MoveCoeffs &coeffs,
-                             int moveThreshold,
-                             int gestureThreshold,
-                             Log &log) :
+static controller_settings pairSettings(const key_map &keymap1,
+                                        const key_map &keymap2,
+                                        const MoveCoeffs &coeffs)
+{
+    controller_settings controllers(2);
+
+    controllers[0].role = ControllerRole::POINTER;
+    controllers[0].keymap = keymap1;
+    controllers[0].coeffs = coeffs;
+    controllers[1].role = ControllerRole::GESTURE;
+    controllers[1].keymap = keymap2;
+    controllers[1].coeffs = coeffs;
+
+    return controllers;
+}
+
+template <typename Clock>
+PSMoveHandlerT<Clock>::PSMoveHandlerT(const controller_settings &controllers,
+                                      int moveThreshold,
+                                      int gestureThreshold,
+                                      Log &log) :
     log_(log),
     moveThreshold_(moveThreshold),
-    gestureThreshold_(gestureThreshold),
-    useMoveTrigger_(false),
-    moveTrigger_(false),
-    useGestureTrigger_(false),
-    gestureTrigger_(false),
-    releaseGestureKeys_(false)
+    gestureThreshold_(gestureThreshold)
 {
-    coeffs_.cx = coeffs.cx;
-    coeffs_.cy = coeffs.cy;
-
-    lastGyroTp_.tv_sec = 0;
-    lastGyroTp_.tv_nsec = 0;
+    init(controllers);
+}
 
-    lastGestureTp_.tv_sec = 0;
-    lastGestureTp_.tv_nsec = 0;
-    
-    keymaps_[0] = keymap1;
-    keymaps_[1] = keymap2;
+template <typename Clock>
+PSMoveHandlerT<Clock>::PSMoveHandlerT(const key_map &keymap1,
+                                      const key_map &keymap2,
+                                      const MoveCoeffs &coeffs,
+                                      int moveThreshold,
+                                      int gestureThreshold,
+                                      Log &log) :
+    log_(log),
+    moveThreshold_(moveThreshold),
+    gestureThreshold_(gestureThreshold)
+{
+    init(pairSettings(keymap1, keymap2, coeffs));
+}
 
-    // check for triggers after key maps are initialized
-    checkTriggers();
+template <typename Clock>
+PSMoveHandlerT<Clock>::~PSMoveHandlerT()
+{
+    disconnect_signal_.disconnect_all_slots();
 
-    buttons_[0] = 0;
-    buttons_[1] = 0;
+    for (ControllerState *state : controllers_)
+    {
+        delete state;
+    }
 }
 
-PSMoveHandler::~PSMoveHandler()
+template <typename Clock>
+void PSMoveHandlerT<Clock>::init(const controller_settings &controllers)
 {
-    move_signal_.disconnect_all_slots();
-    key_signal_.disconnect_all_slots();
+    for (const ControllerSettings &settings : controllers)
+    {
+        ControllerState *state = new ControllerState;
+
+        state->coeffs = settings.coeffs;
+        state->useMoveTrigger = false;
+        state->useGestureTrigger = false;
+        compileKeymap(state, settings.keymap);
+        resetState(state);
+
+        controllers_.push_back(state);
+    }
 }
 
-void PSMoveHandler::onGyroscope(int gx, int gy)
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onGyroscope(int gx, int gy)
 {
-    log_.write(boost::str(boost::format("PSMoveHandler::onGyroscope(%1%, %2%)") % gx %gy).c_str());
-    
-    // get current time
     timespec gyroTp;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &gyroTp);
+    clock_.now(gyroTp);
+    onGyroscope(ControllerId::FIRST, gx, gy, gyroTp);
+}
+
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onGyroscope(int gx, int gy, const timespec &gyroTp)
+{
+    onGyroscope(ControllerId::FIRST, gx, gy, gyroTp);
+}
+
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onGyroscope(ControllerId controller, int gx, int gy, const timespec &gyroTp)
+{
+    ControllerState *state = getState(controller);
+    if (state == nullptr)
+    {
+        return;
+    }
+
+    LOG_TRACE(log_, boost::str(boost::format("PSMoveHandler::onGyroscope(%1%, %2%, %3%)") % controllerIndex(controller) % gx % gy).c_str());
+
+    // reset() may be called from another thread, when the controller goes away
+    boost::lock_guard<boost::mutex> lock(state->mutex);
 
     // report pointer movement only if this is not the first measurement, and we have
     // previous measurement's timestamp to calculate time delta
-    if ((lastGyroTp_.tv_sec != 0) && (lastGyroTp_.tv_nsec != 0))
+    if ((state->lastGyroTp.tv_sec != 0) || (state->lastGyroTp.tv_nsec != 0))
     {
         // if move trigger is used, then report move only while
         // move trigger button is pressed
-        if (((useMoveTrigger_ == true) && (moveTrigger_ == true)) ||
-             (useMoveTrigger_ == false))
+        if (((state->useMoveTrigger == true) && (state->moveTrigger == true)) ||
+             (state->useMoveTrigger == false))
         {
             // pointer movement for each axis is calculated by multiplying gyroscope values
             // we receive from psmove by time delta between current and previous measurements
             // in milliseconds and then multiplying the result by the coefficient
-            long timeDelta = static_cast<long>((gyroTp.tv_nsec - lastGyroTp_.tv_nsec) / 1000000);
-            if (timeDelta < 0)
-            {
-                timeDelta += 1000;
-            }
+            double timeDelta = timeDeltaMs(gyroTp, state->lastGyroTp);
+
+            LOG_TRACE(log_, boost::str(boost::format("timeDelta=%1%") % timeDelta).c_str());
 
-            log_.write(boost::str(boost::format("timeDelta=%1%") % timeDelta).c_str());
+            // only whole pixels can be reported, the fractional part of the movement
+            // is carried over to the next measurement, so that slow movements
+            // and short time deltas still add up to pointer motion
+            double fx = gx * timeDelta * state->coeffs.cx + state->residualX;
+            double fy = gy * timeDelta * state->coeffs.cy + state->residualY;
+            int dx = static_cast<int>(fx);
+            int dy = static_cast<int>(fy);
+            state->residualX = fx - dx;
+            state->residualY = fy - dy;
 
-            int dx = static_cast<int>(gx * timeDelta * coeffs_.cx);
-            int dy = static_cast<int>(gy * timeDelta * coeffs_.cy);
+            // movements below the threshold are dropped along with their residuals
             if (((dx > 0) && (dx < moveThreshold_)) ||
                 ((dx < 0) && (dx > -moveThreshold_)))
             {
                 dx = 0;
+                state->residualX = 0.0;
             }
             if (((dy > 0) && (dy < moveThreshold_)) ||
                 ((dy < 0) && (dy > -moveThreshold_)))
             {
                 dy = 0;
+                state->residualY = 0.0;
             }
 
             if ((dx != 0) || (dy != 0))
             {
-                move_signal_(dx, dy);
+                move_slot_(dx, dy);
             }
         }
+        else
+        {
+            state->residualX = 0.0;
+            state->residualY = 0.0;
+        }
     }
-    
-    lastGyroTp_.tv_sec = gyroTp.tv_sec;
-    lastGyroTp_.tv_nsec = gyroTp.tv_nsec;
+
+    state->lastGyroTp.tv_sec = gyroTp.tv_sec;
+    state->lastGyroTp.tv_nsec = gyroTp.tv_nsec;
 }
 
-void PSMoveHandler::onGesture(int gx, int gy)
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onGesture(int gx, int gy)
 {
-    log_.write(boost::str(boost::format("PSMoveHandler::onGesture(%1%, %2%)") % gx %gy).c_str());
-
-    // get current time
     timespec gestureTp;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &gestureTp);
+    clock_.now(gestureTp);
+    onGesture(ControllerId::SECOND, gx, gy, gestureTp);
+}
+
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onGesture(int gx, int gy, const timespec &gestureTp)
+{
+    onGesture(ControllerId::SECOND, gx, gy, gestureTp);
+}
+
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onGesture(ControllerId controller, int gx, int gy, const timespec &gestureTp)
+{
+    ControllerState *state = getState(controller);
+    if (state == nullptr)
+    {
+        return;
+    }
+
+    LOG_TRACE(log_, boost::str(boost::format("PSMoveHandler::onGesture(%1%, %2%, %3%)") % controllerIndex(controller) % gx % gy).c_str());
 
+    // the state is locked against reset(), but not while onButtons() runs,
+    // since it takes the lock itself
+    int buttons = 0;
+    bool report = false;
+    {
+        boost::lock_guard<boost::mutex> lock(state->mutex);
+        report = detectGesture(state, gx, gy, gestureTp, buttons);
+    }
+
+    // report gesture buttons
+    if (report == true)
+    {
+        onButtons(buttons, controller);
+    }
+
+    boost::lock_guard<boost::mutex> lock(state->mutex);
+    state->lastGestureTp.tv_sec = gestureTp.tv_sec;
+    state->lastGestureTp.tv_nsec = gestureTp.tv_nsec;
+}
+
+template <typename Clock>
+bool PSMoveHandlerT<Clock>::detectGesture(ControllerState *state, int gx, int gy, const timespec &gestureTp, int &buttons)
+{
     // handle gestures only if this is not the first measurement, and we have
     // previous measurement's timestamp to calculate time delta
-    if ((lastGestureTp_.tv_sec != 0) && (lastGestureTp_.tv_nsec != 0))
+    if ((state->lastGestureTp.tv_sec != 0) || (state->lastGestureTp.tv_nsec != 0))
     {
         // if gesture trigger is used, then handle gestures only while
         // gesture trigger button is pressed
-        if (((useGestureTrigger_ == true) && (gestureTrigger_ == true)) ||
-             (useGestureTrigger_ == false))
+        if (((state->useGestureTrigger == true) && (state->gestureTrigger == true)) ||
+             (state->useGestureTrigger == false))
         {
-            // calculations are made in the same way as in onGyroscope() function
-            long timeDelta = static_cast<long>((gestureTp.tv_nsec - lastGestureTp_.tv_nsec) / 1000000);
-            if (timeDelta < 0)
-            {
-                timeDelta += 1000;
-            }
+            // calculations are made in the same way as in onGyroscope() function,
+            // but gestures are not accumulated, so there are no residuals to carry
+            double timeDelta = timeDeltaMs(gestureTp, state->lastGestureTp);
 
-            log_.write(boost::str(boost::format("timeDelta=%1%") % timeDelta).c_str());
+            LOG_TRACE(log_, boost::str(boost::format("timeDelta=%1%") % timeDelta).c_str());
 
-            int dx = static_cast<int>(gx * timeDelta * coeffs_.cx);
-            int dy = static_cast<int>(gy * timeDelta * coeffs_.cy);
+            int dx = static_cast<int>(gx * timeDelta * state->coeffs.cx);
+            int dy = static_cast<int>(gy * timeDelta * state->coeffs.cy);
             if (((dx > 0) && (dx < gestureThreshold_)) ||
                 ((dx < 0) && (dx > -gestureThreshold_)))
             {
@@ -162,110 +261,203 @@ void PSMoveHandler::onGesture(int gx, int gy)
             if (dx > 0)
             {
                 gestureButtons |= BTN_GESTURE_RIGHT;
-                log_.write("Gesture RIGHT");
+                LOG_TRACE(log_, "Gesture RIGHT");
             }
             else if (dx < 0)
             {
                 gestureButtons |= BTN_GESTURE_LEFT;
-                log_.write("Gesture LEFT");
+                LOG_TRACE(log_, "Gesture LEFT");
             }
 
             if (dy > 0)
             {
                 gestureButtons |= BTN_GESTURE_UP;
-                log_.write("Gesture UP");
+                LOG_TRACE(log_, "Gesture UP");
             }
             else if (dy < 0)
             {
                 gestureButtons |= BTN_GESTURE_DOWN;
-                log_.write("Gesture DOWN");
+                LOG_TRACE(log_, "Gesture DOWN");
             }
-            // report gesture buttons
-            onButtons(gestureButtons | (buttons_[1] & BTN_GESTURE_MASK), ControllerId::SECOND);
+            buttons = gestureButtons | (state->buttons & BTN_GESTURE_MASK);
+            return true;
         }
     }
-    
-    lastGestureTp_.tv_sec = gestureTp.tv_sec;
-    lastGestureTp_.tv_nsec = gestureTp.tv_nsec;
+
+    return false;
 }
 
-void PSMoveHandler::onButtons(int buttons, ControllerId controller)
+template <typename Clock>
+void PSMoveHandlerT<Clock>::onButtons(int buttons, ControllerId controller)
 {
-    log_.write(boost::str(boost::format("PSMoveHandler::onButtons(%1%)") % buttons).c_str());
-    log_.write(boost::str(boost::format("PSMoveHandler::buttons_ = %1%") % buttons_).c_str());
+    ControllerState *state = getState(controller);
+    if (state == nullptr)
+    {
+        return;
+    }
 
-    int buttonIndex = (controller == ControllerId::FIRST) ? 0 : 1;
+    LOG_TRACE(log_, boost::str(boost::format("PSMoveHandler::onButtons(%1%)") % buttons).c_str());
 
-    if (buttons_[buttonIndex] != buttons)
+    bool releaseGestureKeys = false;
     {
-        int pressed = (buttons & ~buttons_[buttonIndex]);
-        int released = (buttons_[buttonIndex] & ~buttons);
+        boost::lock_guard<boost::mutex> lock(state->mutex);
 
-        for (int i = 1; i <= BTN_GESTURE_RIGHT; i <<= 1)
+        LOG_TRACE(log_, boost::str(boost::format("PSMoveHandler::buttons_ = %1%") % state->buttons).c_str());
+
+        if (state->buttons != buttons)
         {
-            boost::lock_guard<boost::mutex> lock(mutex_);
-            if (pressed & i)
-            {
-                reportKey(i, true, controller);
-            }
-            else if (released & i)
+            unsigned int pressed = (buttons & ~state->buttons);
+            unsigned int released = (state->buttons & ~buttons);
+            // only visit buttons, which have changed and have something mapped to them
+            unsigned int changed = (pressed | released) & state->mappedButtons;
+
+            while (changed != 0)
             {
-                reportKey(i, false, controller);
+                int bit = __builtin_ctz(changed);
+                changed &= (changed - 1);
+                reportKey(state, bit, ((pressed >> bit) & 1) != 0, controller);
             }
+
+            state->buttons = buttons;
         }
 
-        buttons_[buttonIndex] = buttons;
+        releaseGestureKeys = state->releaseGestureKeys;
+        state->releaseGestureKeys = false;
     }
 
-    if (releaseGestureKeys_ == true)
+    if (releaseGestureKeys == true)
     {
-        releaseGestureKeys_ = false;
-        onGesture(0, 0);
+        timespec gestureTp;
+        clock_.now(gestureTp);
+        onGesture(controller, 0, 0, gestureTp);
     }
 }
 
-void PSMoveHandler::reset()
+template <typename Clock>
+void PSMoveHandlerT<Clock>::reset()
 {
-    buttons_[0] = 0;
-    buttons_[1] = 0;
-    lastGyroTp_.tv_sec = 0;
-    lastGyroTp_.tv_nsec = 0;
-    lastGestureTp_.tv_sec = 0;
-    lastGestureTp_.tv_nsec = 0;
-    moveTrigger_ = false;
-    gestureTrigger_ = false;
+    for (unsigned int i = 0; i < controllers_.size(); i++)
+    {
+        reset(controllerId(i));
+    }
 }
 
-void PSMoveHandler::reportKey(int button, bool pressed, ControllerId controller)
+template <typename Clock>
+void PSMoveHandlerT<Clock>::reset(ControllerId controller)
 {
-    key_map *keymap = nullptr;
+    ControllerState *state = getState(controller);
+    if (state == nullptr)
+    {
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> lock(state->mutex);
 
-    if (controller == ControllerId::FIRST)
+    // a controller leaving with a button pressed must not leave a stuck key
+    // behind; special keys are not reported, so there is nothing to release
+    unsigned int held = state->buttons & state->mappedButtons;
+    while (held != 0)
     {
-        keymap = &keymaps_[0];
+        int bit = __builtin_ctz(held);
+        held &= (held - 1);
+        for (int lincode : state->buttonTable[bit])
+        {
+            if (lincode <= KEY_MAX)
+            {
+                key_slot_(lincode, false);
+            }
+        }
     }
-    else
+
+    resetState(state);
+}
+
+template <typename Clock>
+typename PSMoveHandlerT<Clock>::ControllerState *PSMoveHandlerT<Clock>::getState(ControllerId controller)
+{
+    unsigned int index = static_cast<unsigned int>(controllerIndex(controller));
+    return (index < controllers_.size()) ? controllers_[index] : nullptr;
+}
+
+template <typename Clock>
+void PSMoveHandlerT<Clock>::resetState(ControllerState *state)
+{
+    state->buttons = 0;
+    state->lastGyroTp.tv_sec = 0;
+    state->lastGyroTp.tv_nsec = 0;
+    state->lastGestureTp.tv_sec = 0;
+    state->lastGestureTp.tv_nsec = 0;
+    state->moveTrigger = false;
+    state->gestureTrigger = false;
+    state->releaseGestureKeys = false;
+    state->residualX = 0.0;
+    state->residualY = 0.0;
+}
+
+template <typename Clock>
+double PSMoveHandlerT<Clock>::timeDeltaMs(const timespec &to, const timespec &from)
+{
+    long long delta = timespecDiffNs(to, from);
+
+    // samples delivered out of order do not move the pointer backwards
+    if (delta < 0)
+    {
+        delta = 0;
+    }
+
+    return delta / 1000000.0;
+}
+
+template <typename Clock>
+void PSMoveHandlerT<Clock>::compileKeymap(ControllerState *state, const key_map &keymap)
+{
+    state->mappedButtons = 0;
+
+    for (KeyMapEntry entry : keymap)
     {
-        keymap = &keymaps_[1];
+        unsigned int pscode = static_cast<unsigned int>(entry.pscode);
+
+        // each psmoveapi button and gesture occupies a single bit
+        if ((pscode == 0) || ((pscode & (pscode - 1)) != 0))
+        {
+            continue;
+        }
+
+        int bit = __builtin_ctz(pscode);
+        state->buttonTable[bit].push_back(entry.lincode);
+        state->mappedButtons |= pscode;
+
+        // triggers make the controller move the pointer or make gestures
+        // only while the trigger button is pressed
+        if (entry.lincode == KEY_PSMOVE_MOVE_TRIGGER)
+        {
+            state->useMoveTrigger = true;
+        }
+        else if (entry.lincode == KEY_PSMOVE_GESTURE_TRIGGER)
+        {
+            state->useGestureTrigger = true;
+        }
     }
+}
 
-    log_.write(boost::str(boost::format("PSMoveHandler::reportKey(%1%, %2%)") % button % pressed).c_str());
+template <typename Clock>
+void PSMoveHandlerT<Clock>::reportKey(ControllerState *state, int bit, bool pressed, ControllerId controller)
+{
+    LOG_TRACE(log_, boost::str(boost::format("PSMoveHandler::reportKey(%1%, %2%)") % (1 << bit) % pressed).c_str());
 
-    for (KeyMapEntry entry : *keymap)
+    for (int lincode : state->buttonTable[bit])
     {
-        if (entry.pscode == button)
+        if (handleSpecialKeys(state, lincode, controller, pressed) == false)
         {
-            if (handleSpecialKeys(entry.lincode, controller, pressed) == false)
-            {
-                // this is not a special key handled internally, so
-                // pass it further
-                key_signal_(entry.lincode, pressed);
-            }
+            // this is not a special key handled internally, so
+            // pass it further
+            key_slot_(lincode, pressed);
         }
     }
 }
 
-bool PSMoveHandler::handleSpecialKeys(int lincode, ControllerId controller, bool pressed)
+template <typename Clock>
+bool PSMoveHandlerT<Clock>::handleSpecialKeys(ControllerState *state, int lincode, ControllerId controller, bool pressed)
 {
     bool ret = false;
 
@@ -274,59 +466,40 @@ bool PSMoveHandler::handleSpecialKeys(int lincode, ControllerId controller, bool
         disconnect_signal_(controller);
         ret = true;
     }
-    else if((controller == ControllerId::FIRST) && (lincode == KEY_PSMOVE_MOVE_TRIGGER))
+    else if (lincode == KEY_PSMOVE_MOVE_TRIGGER)
     {
-        moveTrigger_ = pressed;
+        state->moveTrigger = pressed;
         ret = true;
     }
-    else if((controller == ControllerId::SECOND) && (lincode == KEY_PSMOVE_GESTURE_TRIGGER))
+    else if (lincode == KEY_PSMOVE_GESTURE_TRIGGER)
     {
-        if ((gestureTrigger_ == true) && (pressed == false))
+        if ((state->gestureTrigger == true) && (pressed == false))
         {
             /* When gesture trigger is released, we need to release all gesture keys,
                but not in this section of code because it is protected with mutex,
                and calling onGesture() from here would lead to dead lock. */
-            releaseGestureKeys_ = true;
+            state->releaseGestureKeys = true;
         }
 
-        gestureTrigger_ = pressed;
+        state->gestureTrigger = pressed;
         ret = true;
     }
     else if((lincode == KEY_PSMOVE_MWHEEL_UP) && (pressed == true))
     {
-        mwheel_signal_(1);
+        mwheel_slot_(1);
         ret = true;
     }
     else if((lincode == KEY_PSMOVE_MWHEEL_DOWN) && (pressed == true))
     {
-        mwheel_signal_(-1);
+        mwheel_slot_(-1);
         ret = true;
     }
 
     return ret;
 }
 
-void PSMoveHandler::checkTriggers()
-{
-    // check the first key map for move trigger
-    for (KeyMapEntry entry : keymaps_[0])
-    {
-        if (entry.lincode == KEY_PSMOVE_MOVE_TRIGGER)
-        {
-            useMoveTrigger_ = true;
-            break;
-        }
-    }
-
-    // check the second key map for gesture trigger
-    for (KeyMapEntry entry : keymaps_[1])
-    {
-        if (entry.lincode == KEY_PSMOVE_GESTURE_TRIGGER)
-        {
-            useGestureTrigger_ = true;
-            break;
-        }
-    }
-}
+// the handler used by psmoveinput and the one driven by virtual time
+template class PSMoveHandlerT<MonotonicClock>;
+template class PSMoveHandlerT<ManualClock>;
 
 } // namespace psmoveinput
@@ -24,68 +24,128 @@
 #define PSMOVEINPUT_PSMOVE_HANDLER_HPP
 
 #include "common.hpp"
+#include "clock.hpp"
 #include "log.hpp"
 #include "config_defs.hpp"
+#include "static_slot.hpp"
 #include <psmoveapi/psmove.h>
 #include <boost/signals2.hpp>
 #include <boost/thread/mutex.hpp>
 #include <time.h>
 #include <map>
+#include <vector>
 
 namespace psmoveinput
 {
 
-typedef boost::signals2::signal<void (int, int)> move_signal;
-typedef boost::signals2::signal<void (int, bool)> key_signal;
+// number of bits in button state reported by the listener
+#define BUTTON_BITS 32
+
+// per-sample outputs are statically bound, see static_slot.hpp
+typedef StaticSlot<void (int, int)> move_slot;
+typedef StaticSlot<void (int, bool)> key_slot;
+typedef StaticSlot<void (int)> mwheel_slot;
 typedef boost::signals2::signal<void (ControllerId)> disconnect_signal;
-typedef boost::signals2::signal<void (int)> mwheel_signal;
+// Linux key codes mapped to a single button
+typedef std::vector<int> button_actions;
 
-class PSMoveHandler
+// Clock tells the time to calls, which do not carry a timestamp of their own;
+// see clock.hpp. Instantiated for MonotonicClock and ManualClock only.
+template <typename Clock>
+class PSMoveHandlerT
 {
 public:
-    PSMoveHandler(const key_map &keymap1,
-                  const key_map &keymap2,
-                  const MoveCoeffs &coeffs,
-                  int moveThreshold,
-                  int gestureThreshold,
-                  Log &log);
-    virtual ~PSMoveHandler();
+    // pool of controllers
+    PSMoveHandlerT(const controller_settings &controllers,
+                   int moveThreshold,
+                   int gestureThreshold,
+                   Log &log);
+    // pointer controller with keymap1 and gesture controller with keymap2
+    PSMoveHandlerT(const key_map &keymap1,
+                   const key_map &keymap2,
+                   const MoveCoeffs &coeffs,
+                   int moveThreshold,
+                   int gestureThreshold,
+                   Log &log);
+    virtual ~PSMoveHandlerT();
 
+    // sensor data of the first (gyroscope) or the second (gesture) controller
+    // taken at the moment of the call, as told by the clock
     void onGyroscope(int gx, int gy);
     void onGesture(int gx, int gy);
+    // sensor data of the first (gyroscope) or the second (gesture) controller
+    // sampled at given time point (CLOCK_MONOTONIC_RAW)
+    void onGyroscope(int gx, int gy, const timespec &tp);
+    void onGesture(int gx, int gy, const timespec &tp);
+    // sensor data of given controller sampled at given time point
+    void onGyroscope(ControllerId controller, int gx, int gy, const timespec &tp);
+    void onGesture(ControllerId controller, int gx, int gy, const timespec &tp);
     void onButtons(int buttons, ControllerId controller);
+    // forget state of all controllers or of a single one,
+    // keys still held by the controller are released
     void reset();
+    void reset(ControllerId controller);
+
+    int getControllerCount() { return static_cast<int>(controllers_.size()); }
 
-    move_signal &getMoveSignal() { return move_signal_; }
-    key_signal &getKeySignal() { return key_signal_; }
+    void setMoveSlot(const move_slot &slot) { move_slot_ = slot; }
+    void setKeySlot(const key_slot &slot) { key_slot_ = slot; }
+    void setMWheelSlot(const mwheel_slot &slot) { mwheel_slot_ = slot; }
     disconnect_signal &getDisconnectSignal() { return disconnect_signal_; }
-    mwheel_signal &getMWheelSignal() { return mwheel_signal_; }
+    Clock &getClock() { return clock_; }
+
+    PSMoveHandlerT(const PSMoveHandlerT &) = delete;
+    PSMoveHandlerT &operator = (const PSMoveHandlerT &) = delete;
 
 protected:
-    move_signal move_signal_;
-    key_signal key_signal_;
+    // State of a single controller. Each controller is normally driven by its
+    // own thread, so there is no lock shared by all controllers; the mutex only
+    // serializes concurrent calls for the same controller, e.g. reset() made by
+    // the listener thread while the output thread is handing a sample over.
+    struct ControllerState
+    {
+        MoveCoeffs coeffs;
+        // key map compiled into a table indexed by button bit position
+        button_actions buttonTable[BUTTON_BITS];
+        // buttons having at least one action
+        unsigned int mappedButtons;
+        int buttons;
+        timespec lastGyroTp;
+        timespec lastGestureTp;
+        bool useMoveTrigger;
+        bool moveTrigger;
+        bool useGestureTrigger;
+        bool gestureTrigger;
+        bool releaseGestureKeys;
+        // sub-pixel pointer movement not reported yet
+        double residualX;
+        double residualY;
+        boost::mutex mutex;
+    };
+
+    move_slot move_slot_;
+    key_slot key_slot_;
+    mwheel_slot mwheel_slot_;
     disconnect_signal disconnect_signal_;
-    mwheel_signal mwheel_signal_;
-    key_map keymaps_[MAX_CONTROLLERS];
-    MoveCoeffs coeffs_;
-    int buttons_[MAX_CONTROLLERS];
+    Clock clock_;
+    std::vector<ControllerState*> controllers_;
     Log &log_;
     int moveThreshold_;
     int gestureThreshold_;
-    timespec lastGyroTp_;
-    timespec lastGestureTp_;
-    boost::mutex mutex_;
-    bool useMoveTrigger_;
-    bool moveTrigger_;
-    bool useGestureTrigger_;
-    bool gestureTrigger_;
-    bool releaseGestureKeys_;
-
-    void reportKey(int button, bool pressed, ControllerId controller);
-    bool handleSpecialKeys(int lincode, ControllerId controller, bool pressed);
-    void checkTriggers();
+
+    void init(const controller_settings &controllers);
+    ControllerState *getState(ControllerId controller);
+    void resetState(ControllerState *state);
+    void compileKeymap(ControllerState *state, const key_map &keymap);
+    // called with the state locked; true if gesture buttons are to be reported
+    bool detectGesture(ControllerState *state, int gx, int gy, const timespec &tp, int &buttons);
+    void reportKey(ControllerState *state, int bit, bool pressed, ControllerId controller);
+    bool handleSpecialKeys(ControllerState *state, int lincode, ControllerId controller, bool pressed);
+    double timeDeltaMs(const timespec &to, const timespec &from);
 };
 
+typedef PSMoveHandlerT<MonotonicClock> PSMoveHandler;
+
 } // namespace psmoveinput
 
 #endif // PSMOVEINPUT_PSMOVE_HANDLER_HPP
@@ -21,109 +21,755 @@
 
 
 #include "psmove_listener.hpp"
+#include "sched.hpp"
 #include <boost/format.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 namespace psmoveinput
 {
 
 #define CALIBRATED_GYRO_COEFF   10
+#define MAX_REPORT_BATCH        16
+// samples taken from one controller's queue before moving on to the next one
+#define OUTPUT_BATCH            16
 
-PSMoveListener::PSMoveListener(Log &log,
-                               OpMode mode,
-                               int pollTimeout,
-                               int connectTimeout,
-                               int disconnectTimeout,
-                               int ledTimeout,
-                               int gestureTimeout) :
+// reactor event sources other than controllers, which are identified by their index
+#define REACTOR_TICK            0xFFFFFFFF
+#define REACTOR_CONNECT         0xFFFFFFFE
+#define REACTOR_CONTROL         0xFFFFFFFD
+#define REACTOR_HOTPLUG         0xFFFFFFFC
+#define REACTOR_SIGNAL          0xFFFFFFFB
+// set in the source of controller's watchdog timer along with controller index
+#define REACTOR_WATCHDOG        0x40000000
+#define REACTOR_MAX_EVENTS      (2 * MAX_CONTROLLERS + 5)
+
+// connection attempts after a controller has appeared, in case psmoveapi
+// does not see it right away
+#define HOTPLUG_CONNECT_RETRIES 3
+#define HOTPLUG_RETRY_INTERVAL  500 // ms
+// without hot-plug events ineligible controllers are checked anew that often
+#define INELIGIBLE_RECHECK_INTERVAL 60000 // ms
+
+// LED colors of the controllers, repeated if there are more controllers
+#define LED_COLORS 8
+static const unsigned char ledColors[LED_COLORS][3] = {
+    {33, 119, 47},
+    {123, 59, 160},
+    {200, 120, 0},
+    {0, 90, 200},
+    {180, 30, 30},
+    {0, 160, 160},
+    {160, 160, 0},
+    {140, 140, 140}
+};
+
+// Sample flags
+#define SAMPLE_MOTION_FIRST     0x01    // movement from the first half-frame
+#define SAMPLE_MOTION_SECOND    0x02    // movement from the second half-frame
+#define SAMPLE_GESTURE          0x04
+#define SAMPLE_BUTTONS          0x08    // buttons state has changed
+
+PSMoveListener::PSMoveListener(Log &log, const ListenerParams &params) :
     log_(log),
     stop_(false),
-    mode_(mode),
-    threadStop_(false),
-    pollTimeout_(pollTimeout),
-    connectTimeout_(connectTimeout),
-    disconnectTimeout_(disconnectTimeout),
-    ledTimeout_(ledTimeout),
-    gestureTimeout_(gestureTimeout)
+    mode_(params.mode),
+    roles_(params.roles),
+    slotSerials_(params.roles.size()),
+    pollTimeout_(params.pollTimeout),
+    connectTimeout_(params.connectTimeout),
+    disconnectTimeout_(params.disconnectTimeout),
+    ledTimeout_(params.ledTimeout),
+    gestureTimeout_(params.gestureTimeout),
+    readMode_(params.readMode),
+    frameMode_(params.frameMode),
+    threadModel_(params.threadModel),
+    outputMode_(params.outputMode),
+    controllerSched_(params.controllerSched),
+    outputSched_(params.outputSched),
+    lockMemory_(params.lockMemory),
+    outputThread_(nullptr),
+    outputStop_(false),
+    outputWaiting_(false),
+    wakeFd_(-1),
+    controlFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    signalFd_(-1),
+    tickOverruns_(0),
+    connectRetries_(0),
+    lastCount_(-1),
+    idsValid_(true)
 {
-    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ineligibleTp_);
+
+    // controllers BlueZ fails to disconnect are left to the script
+    bluez_.setFallback([this](const std::string &btaddr) { runDisconnectScript(btaddr); });
+
+    // one thread per controller of the pool
+    for (unsigned int i = 0; i < roles_.size(); i++)
     {
-        controllerThreads_[i] = new ControllerThread(log_);
+        controllerThreads_.push_back(new ControllerThread(log_,
+                                                          params.outputMode,
+                                                          params.outputQueueSize,
+                                                          params.overflowPolicy));
     }
 }
 
 PSMoveListener::~PSMoveListener()
 {
-    gyroSignal_.disconnect_all_slots();
-    buttonSignal_.disconnect_all_slots();
+    // the worker of the client must not call the fallback any more
+    bluez_.close();
+    stopOutput();
+
+    disconnectCompleteSignal_.disconnect_all_slots();
+    unixSignalSignal_.disconnect_all_slots();
 
-    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    for (ControllerThread *thread : controllerThreads_)
     {
-        if (controllerThreads_[i] != nullptr)
-        {
-            delete controllerThreads_[i];
-        }
+        delete thread;
+    }
+
+    if (controlFd_ >= 0)
+    {
+        close(controlFd_);
     }
 }
 
-void PSMoveListener::run()
+// serial number of the controller, which is its Bluetooth address
+static std::string getSerial(PSMove *move)
 {
-    PSMove *move = nullptr;
-    int psmoveId = 0;
+    std::string result;
+    char *serial = psmove_get_serial(move);
+
+    if (serial != nullptr)
+    {
+        result = serial;
+        free(serial);
+    }
+
+    return result;
+}
+
+// arm timer to expire after delay ms (right away if 0) and then every interval ms (only once if 0)
+static void armTimer(int fd, int delay, int interval)
+{
+    itimerspec its;
+    its.it_interval.tv_sec = interval / 1000;
+    its.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+    its.it_value.tv_sec = delay / 1000;
+    its.it_value.tv_nsec = (delay % 1000) * 1000000L;
+    // zero value would disarm the timer
+    if ((its.it_value.tv_sec == 0) && (its.it_value.tv_nsec == 0))
+    {
+        its.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+// arm timer to expire once after delay ns
+static void armTimerNs(int fd, long long delay)
+{
+    itimerspec its;
+    memset(&its, 0, sizeof (its));
+    if (delay <= 0)
+    {
+        delay = 1;
+    }
+    its.it_value.tv_sec = delay / 1000000000LL;
+    its.it_value.tv_nsec = delay % 1000000000LL;
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+static void disarmTimer(int fd)
+{
+    itimerspec its;
+    memset(&its, 0, sizeof (its));
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+// arm timer to expire every interval ms, counting from the current time point
+// rather than from the time it takes to get here, so that the period never drifts
+static void armTimerAbs(int fd, int interval)
+{
+    itimerspec its;
+    timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    its.it_interval.tv_sec = interval / 1000;
+    its.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+    its.it_value = timespecAddNs(now, interval * 1000000LL);
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+// returns the number of times the timer has expired since the last read
+static uint64_t readTimer(int fd)
+{
+    uint64_t expirations = 0;
+    if (read(fd, &expirations, sizeof (expirations)) != sizeof (expirations))
+    {
+        expirations = 0;
+    }
+    return expirations;
+}
 
+static bool epollAdd(int epfd, int fd, uint32_t source)
+{
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+    event.data.u32 = source;
+    return (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) == 0);
+}
+
+static void epollDel(int epfd, int fd)
+{
+    if (fd >= 0)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+void PSMoveListener::run()
+{
     init();
+    startOutput();
+
+    if (threadModel_ == ThreadModel::REACTOR)
+    {
+        runReactor();
+    }
+    else
+    {
+        runThreads();
+    }
+}
+
+void PSMoveListener::runThreads()
+{
+    // connect to controllers present at startup
+    bool connectNeeded = true;
 
     log_.write("PSMoveListener: starting main loop");
 
     // main listener loop : establish and handle controller connections
     while (true)
     {
-        if (stop_ || threadStop_)
+        if (stop_)
         {
             // wait until all controller threads complete execution
-            for (int i = 0; i < MAX_CONTROLLERS; i++)
+            for (ControllerThread *thread : controllerThreads_)
             {
-                controllerThreads_[i]->join();
+                thread->join();
             }
+            // let the handler see everything the controllers have sent
+            waitOutputDrained();
+
+            log_.write("Stopping PSMoveListener");
+            stopOutput();
+            break;
+        }
+
+        // free the slots of controllers, which have gone, and look for new ones
+        if (reapControllers() == true)
+        {
+            connectNeeded = true;
+        }
+
+        if (connectNeeded == true)
+        {
+            connectControllers();
+        }
 
-            if (stop_)
+        connectNeeded = waitEvents();
+    }
+}
+
+void PSMoveListener::runReactor()
+{
+    epoll_event events[REACTOR_MAX_EVENTS];
+    // wait descriptors of controllers registered with epoll, -1 for none
+    std::vector<int> watched(controllerThreads_.size(), -1);
+    bool ticking = false;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int tickFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int connectFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if ((epfd < 0) || (tickFd < 0) || (connectFd < 0) || (controlFd_ < 0) ||
+        (epollAdd(epfd, tickFd, REACTOR_TICK) == false) ||
+        (epollAdd(epfd, connectFd, REACTOR_CONNECT) == false) ||
+        (epollAdd(epfd, controlFd_, REACTOR_CONTROL) == false) ||
+        (hotplug_.isOpen() && (epollAdd(epfd, hotplug_.getFd(), REACTOR_HOTPLUG) == false)) ||
+        ((signalFd_ >= 0) && (epollAdd(epfd, signalFd_, REACTOR_SIGNAL) == false)) ||
+        (addWatchdogs(epfd) == false))
+    {
+        log_.write("PSMoveListener: failed to set up reactor, falling back to thread per controller",
+                   LogLevel::ERROR);
+        for (int fd : {epfd, tickFd, connectFd})
+        {
+            if (fd >= 0)
             {
-                // we're not just stopping controller threads,
-                // the listener itself has to stop working
-                log_.write("Stopping PSMoveListener");
-                break;
+                close(fd);
             }
-            else
+        }
+        threadModel_ = ThreadModel::PER_CONTROLLER;
+        runThreads();
+        return;
+    }
+
+    log_.write("PSMoveListener: starting reactor loop");
+
+    // listener thread services the controllers now
+    applySched(controllerSched_, "reactor");
+
+    /* Every controller in event mode is serviced as soon as its hidraw node
+       becomes readable. The tick timer fires every poll timeout while there
+       are controllers connected and services all of them, which reads the ones
+       in poll mode and takes care of LED refreshes of the silent ones. Each
+       controller's watchdog timer fires when its disconnect timeout may have
+       expired. Connection attempts are made on the connect timer, which
+       is armed by hot-plug events, or fires every connect timeout if there are
+       no hot-plug events to rely on. Nothing wakes the loop up while there are
+       neither controllers nor hot-plug events. */
+    armTimer(connectFd, 0, hotplug_.isOpen() ? 0 : connectTimeout_);
+
+    while (true)
+    {
+        int count = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, -1);
+
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t source = events[i].data.u32;
+
+            if (source == REACTOR_TICK)
             {
-                // no need to use mutex here because at this poing there's only one
-                // main thread remaining
-                threadStop_ = false;
-                // notify that all controllers have been disconnected
-                disconnectCompleteSignal_();
+                uint64_t expirations = readTimer(tickFd);
+                if (expirations > 1)
+                {
+                    tickOverruns_ += expirations - 1;
+                }
+                for (ControllerThread *thread : controllerThreads_)
+                {
+                    if (thread->running() == true)
+                    {
+                        thread->service();
+                    }
+                }
+            }
+            else if (source == REACTOR_CONNECT)
+            {
+                readTimer(connectFd);
+                connectControllers();
+                if (hotplug_.isOpen() && (connectRetries_ > 0))
+                {
+                    connectRetries_--;
+                    armTimer(connectFd, HOTPLUG_RETRY_INTERVAL, 0);
+                }
+            }
+            else if (source == REACTOR_CONTROL)
+            {
+                uint64_t value;
+                read(controlFd_, &value, sizeof (value));
+            }
+            else if (source == REACTOR_SIGNAL)
+            {
+                handleSignals();
+            }
+            else if (source == REACTOR_HOTPLUG)
+            {
+                if (handleHotplug() == true)
+                {
+                    armTimer(connectFd, 0, 0);
+                }
+            }
+            else if ((source & REACTOR_WATCHDOG) != 0)
+            {
+                ControllerThread *thread = controllerThreads_[source & ~REACTOR_WATCHDOG];
+                if (thread->watchdog() == false)
+                {
+                    thread->requestStop();
+                }
+            }
+            else if ((source < controllerThreads_.size()) && (controllerThreads_[source]->running() == true))
+            {
+                ControllerThread *thread = controllerThreads_[source];
+
+                if ((events[i].events & (EPOLLERR | EPOLLHUP)) != 0)
+                {
+                    // the node is gone; leave the controller to the tick,
+                    // disconnect timeout will take care of it
+                    epollDel(epfd, watched[source]);
+                    continue;
+                }
+
+                thread->drainWaitFd();
+                thread->service();
             }
         }
 
-        // try to connect to new controller if there is less than
-        // maximum number of controllers already connected
-        if (isFullCapacity() == false)
+        if (stop_)
         {
-            move = connect(psmoveId);
-            if (move != nullptr)
+            for (unsigned int n = 0; n < controllerThreads_.size(); n++)
             {
-                log_.write(boost::str(boost::format("Connected to PSMove, psmoveapi id = %1%") % psmoveId).c_str());
-                handleNewDevice(psmoveId, move);
-                move = nullptr;
+                if (controllerThreads_[n]->running() == true)
+                {
+                    epollDel(epfd, watched[n]);
+                    watched[n] = -1;
+                    controllerThreads_[n]->release();
+                }
+            }
+            // let the handler see everything the controllers have sent
+            waitOutputDrained();
+
+            log_.write(boost::str(boost::format("PSMoveListener: reactor tick missed %1% deadlines") % tickOverruns_).c_str());
+            log_.write("Stopping PSMoveListener");
+            stopOutput();
+            break;
+        }
+
+        // disconnect controllers, which have gone silent or have been asked to leave
+        bool disconnected = false;
+        for (unsigned int n = 0; n < controllerThreads_.size(); n++)
+        {
+            ControllerThread *thread = controllerThreads_[n];
+            if ((thread->running() == true) && (thread->stopRequested() == true))
+            {
+                epollDel(epfd, watched[n]);
+                watched[n] = -1;
+                thread->release();
+                controllerGone(thread);
+                disconnected = true;
             }
         }
+        if (disconnected == true)
+        {
+            // look for the controllers, which are still there
+            armTimer(connectFd, 0, hotplug_.isOpen() ? 0 : connectTimeout_);
+        }
 
-        boost::this_thread::sleep(boost::posix_time::millisec(connectTimeout_));
+        // watch newly connected controllers, tick only while there are any
+        bool connected = false;
+        for (unsigned int n = 0; n < controllerThreads_.size(); n++)
+        {
+            ControllerThread *thread = controllerThreads_[n];
+            if (thread->running() == true)
+            {
+                connected = true;
+                if ((watched[n] == -1) && (thread->getWaitFd() >= 0) &&
+                    (epollAdd(epfd, thread->getWaitFd(), n) == true))
+                {
+                    watched[n] = thread->getWaitFd();
+                }
+            }
+        }
+        if (connected != ticking)
+        {
+            if (connected == true)
+            {
+                armTimerAbs(tickFd, pollTimeout_);
+            }
+            else
+            {
+                disarmTimer(tickFd);
+            }
+            ticking = connected;
+        }
+    }
+
+    close(connectFd);
+    close(tickFd);
+    close(epfd);
+}
+
+void PSMoveListener::applySched(const SchedParams &params, const char *name)
+{
+    std::string error;
+
+    // the thread keeps running with whatever could not be applied left as it is
+    if (applySchedParams(params, error) == false)
+    {
+        log_.write(boost::str(boost::format("PSMoveListener: failed to set up scheduling of %1% thread (%2%), using defaults")
+                              % name % error).c_str(), LogLevel::ERROR);
     }
 }
 
+bool PSMoveListener::addWatchdogs(int epfd)
+{
+    // watchdog timers live as long as the controller threads,
+    // they are disarmed while there is no controller connected
+    for (unsigned int n = 0; n < controllerThreads_.size(); n++)
+    {
+        int fd = controllerThreads_[n]->getWatchdogFd();
+        if ((fd < 0) || (epollAdd(epfd, fd, n | REACTOR_WATCHDOG) == false))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void PSMoveListener::stop()
 {
     stop_ = true;
+
+    // nobody has to wait for a timeout to notice
+    for (ControllerThread *thread : controllerThreads_)
+    {
+        thread->wake();
+    }
+    wakeListener();
+}
+
+void PSMoveListener::wakeListener()
+{
+    if (controlFd_ >= 0)
+    {
+        uint64_t value = 1;
+        write(controlFd_, &value, sizeof (value));
+    }
+}
+
+bool PSMoveListener::waitEvents()
+{
+    pollfd pfds[3];
+    int timeout = connectTimeout_;
+
+    pfds[0].fd = controlFd_;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    pfds[1].fd = hotplug_.getFd();
+    pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
+    pfds[2].fd = signalFd_;
+    pfds[2].events = POLLIN;
+    pfds[2].revents = 0;
+
+    // with hot-plug events there is nothing to do until something happens,
+    // unless there are connection attempts to retry
+    if (hotplug_.isOpen() == true)
+    {
+        timeout = (connectRetries_ > 0) ? HOTPLUG_RETRY_INTERVAL : -1;
+    }
+
+    int ret = poll(pfds, 3, timeout);
+    if (ret == 0)
+    {
+        if (connectRetries_ > 0)
+        {
+            connectRetries_--;
+        }
+        return true;
+    }
+
+    bool connectNeeded = false;
+    if (ret > 0)
+    {
+        if ((pfds[0].revents & POLLIN) != 0)
+        {
+            uint64_t value;
+            read(controlFd_, &value, sizeof (value));
+        }
+        if ((pfds[1].revents & POLLIN) != 0)
+        {
+            connectNeeded = handleHotplug();
+        }
+        if ((pfds[2].revents & POLLIN) != 0)
+        {
+            handleSignals();
+        }
+    }
+
+    return connectNeeded;
+}
+
+void PSMoveListener::handleSignals()
+{
+    signalfd_siginfo info;
+
+    // signals are handled here, in the listener thread, rather than in signal
+    // context, so the slots may do whatever they want, including stop()
+    while (read(signalFd_, &info, sizeof (info)) == sizeof (info))
+    {
+        unixSignalSignal_(static_cast<int>(info.ssi_signo));
+    }
+}
+
+void PSMoveListener::dumpStats()
+{
+    log_.write("PSMoveListener: statistics");
+    for (ControllerThread *thread : controllerThreads_)
+    {
+        if (thread->running() == true)
+        {
+            thread->logStats();
+        }
+    }
+    if (threadModel_ == ThreadModel::REACTOR)
+    {
+        log_.write(boost::str(boost::format("PSMoveListener: reactor tick missed %1% deadlines") % tickOverruns_).c_str());
+    }
+    logLatency("poll to handler", queueLatency_);
+    logLatency("handler to input device", outputLatency_);
+    logLatency("poll to input device", totalLatency_);
+}
+
+void PSMoveListener::logLatency(const char *stage, const LatencyHistogram &histogram)
+{
+    // microseconds are precise enough for the log
+    log_.write(boost::str(boost::format("PSMoveListener: %1% latency over %2% samples, us: p50 %3%, p99 %4%, p99.9 %5%, max %6%")
+                          % stage % histogram.getCount()
+                          % (histogram.getPercentile(0.5) / 1000.0)
+                          % (histogram.getPercentile(0.99) / 1000.0)
+                          % (histogram.getPercentile(0.999) / 1000.0)
+                          % (histogram.getMax() / 1000.0)).c_str());
+}
+
+bool PSMoveListener::handleHotplug()
+{
+    HotplugMonitor::Event event;
+    bool added = false;
+
+    while (hotplug_.read(event) == true)
+    {
+        if (event.action == HotplugMonitor::Action::NONE)
+        {
+            continue;
+        }
+
+        // psmoveapi ids may now refer to different controllers
+        invalidateIds();
+
+        // controllers plugged in via USB are never connected; the one,
+        // which has gone, is forgotten, or all of them, if it is not known
+        if (event.bluetooth == false)
+        {
+            if (event.action == HotplugMonitor::Action::REMOVE)
+            {
+                std::map<std::string, int>::iterator it = ineligible_.end();
+                for (it = ineligible_.begin(); it != ineligible_.end(); ++it)
+                {
+                    if ((event.uniq.empty() == false) &&
+                        (boost::algorithm::iequals(it->first, event.uniq) == true))
+                    {
+                        break;
+                    }
+                }
+                if (it != ineligible_.end())
+                {
+                    ineligible_.erase(it);
+                }
+                else
+                {
+                    forgetIneligible();
+                }
+            }
+            continue;
+        }
+
+        if (event.action == HotplugMonitor::Action::ADD)
+        {
+            log_.write(boost::str(boost::format("PSMoveListener: controller %1% appeared at %2%") % event.uniq % event.device).c_str());
+            pendingDevices_.insert(event.uniq);
+            connectRetries_ = HOTPLUG_CONNECT_RETRIES;
+            added = true;
+        }
+        else
+        {
+            log_.write(boost::str(boost::format("PSMoveListener: controller %1% removed from %2%") % event.uniq % event.device).c_str());
+            pendingDevices_.erase(event.uniq);
+            // no need to wait for disconnect timeout of the controller
+            for (ControllerThread *thread : controllerThreads_)
+            {
+                if ((thread->running() == true) &&
+                    (boost::algorithm::iequals(thread->getBtaddr(), event.uniq) == true))
+                {
+                    disconnect(thread->getId());
+                    break;
+                }
+            }
+        }
+    }
+
+    return added;
+}
+
+void PSMoveListener::connectControllers()
+{
+    PSMove *move = nullptr;
+    int psmoveId = 0;
+
+    // try to connect to new controllers as long as there is less than
+    // maximum number of controllers already connected
+    while ((isFullCapacity() == false) && (needToStop() == false))
+    {
+        move = connect(psmoveId);
+        if (move == nullptr)
+        {
+            break;
+        }
+        log_.write(boost::str(boost::format("Connected to PSMove, psmoveapi id = %1%") % psmoveId).c_str());
+        handleNewDevice(psmoveId, move);
+    }
+
+    // no more retries for controllers, which are connected now
+    for (ControllerThread *thread : controllerThreads_)
+    {
+        if (thread->running() == true)
+        {
+            pendingDevices_.erase(boost::algorithm::to_lower_copy(thread->getBtaddr()));
+        }
+    }
+    if (pendingDevices_.empty() == true)
+    {
+        connectRetries_ = 0;
+    }
+}
+
+bool PSMoveListener::reapControllers()
+{
+    bool reaped = false;
+
+    for (ControllerThread *thread : controllerThreads_)
+    {
+        if (thread->finished() == true)
+        {
+            thread->reap();
+            controllerGone(thread);
+            reaped = true;
+        }
+    }
+
+    return reaped;
+}
+
+void PSMoveListener::controllerGone(ControllerThread *thread)
+{
+    // let the handler see everything the controller has sent before it forgets the controller
+    waitOutputDrained(thread);
+    disconnectCompleteSignal_(thread->getId());
+
+    // psmoveapi enumerates remaining controllers anew
+    invalidateIds();
+}
+
+void PSMoveListener::invalidateIds()
+{
+    idsValid_ = false;
+}
+
+void PSMoveListener::forgetIneligible()
+{
+    ineligible_.clear();
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ineligibleTp_);
 }
 
 void PSMoveListener::init()
@@ -149,102 +795,496 @@ void PSMoveListener::init()
     {
         psmove_set_remote_config(PSMove_OnlyLocal);
     }
+
+    if (lockMemory_ == true)
+    {
+        std::string error;
+        if (lockMemory(error) == true)
+        {
+            log_.write("PSMoveListener: process memory locked");
+        }
+        else
+        {
+            log_.write(boost::str(boost::format("PSMoveListener: failed to lock process memory (%1%)") % error).c_str(),
+                       LogLevel::ERROR);
+        }
+    }
+
+    // local controllers are connected as soon as their hidraw nodes appear;
+    // remote ones give no hot-plug events, so we keep trying to connect
+    // every connect timeout in client mode
+    if ((mode_ == OpMode::STANDALONE) && (controlFd_ >= 0))
+    {
+        if (hotplug_.open() == true)
+        {
+            log_.write("PSMoveListener: waiting for hot-plug events");
+        }
+        else
+        {
+            log_.write("PSMoveListener: hot-plug events are not available, falling back to periodic connection attempts",
+                       LogLevel::ERROR);
+        }
+    }
+
+    // controllers are disconnected through BlueZ, the disconnect script is
+    // only used when BlueZ fails to do it or the system bus is not available
+    if (bluez_.open() == true)
+    {
+        log_.write("PSMoveListener: connected to the system bus");
+    }
+    else
+    {
+        log_.write("PSMoveListener: system bus is not available, falling back to the disconnect script",
+                   LogLevel::ERROR);
+    }
 }
 
 void PSMoveListener::handleNewDevice(int psmoveId, PSMove *move)
 {
-    if (controllerThreads_[0]->running() == false)
+    std::string serial = getSerial(move);
+    int slot = -1;
+    int freeSlot = -1;
+
+    /* A controller coming back takes the slot it had before, so that its
+       role, key map and coefficients stay the same. A new controller takes
+       the first free slot not remembered for another controller, or just
+       the first free slot if all of them are. */
+    for (unsigned int i = 0; i < controllerThreads_.size(); i++)
     {
-        controllerThreads_[0]->start(ControllerId::FIRST, psmoveId, move, this,
-                                     pollTimeout_, disconnectTimeout_, ledTimeout_, gestureTimeout_);
+        if (controllerThreads_[i]->running() == true)
+        {
+            continue;
+        }
+        if ((serial.empty() == false) && (slotSerials_[i] == serial))
+        {
+            slot = i;
+            break;
+        }
+        if (freeSlot < 0)
+        {
+            freeSlot = i;
+        }
+        if ((slot < 0) && slotSerials_[i].empty())
+        {
+            slot = i;
+        }
     }
-    else if (controllerThreads_[1]->running() == false)
+    if (slot < 0)
     {
-        controllerThreads_[1]->start(ControllerId::SECOND, psmoveId, move, this,
-                                     pollTimeout_, disconnectTimeout_, ledTimeout_, gestureTimeout_);
+        slot = freeSlot;
+    }
+
+    if (slot < 0)
+    {
+        psmove_disconnect(move);
+        return;
+    }
+
+    log_.write(boost::str(boost::format("PSMove %1% takes slot #%2%") % serial % slot).c_str());
+    if (serial.empty() == false)
+    {
+        slotSerials_[slot] = serial;
+    }
+
+    ControllerThread *thread = controllerThreads_[slot];
+    if (threadModel_ == ThreadModel::REACTOR)
+    {
+        thread->attach(controllerId(slot), roles_[slot], psmoveId, move, this,
+                       pollTimeout_, disconnectTimeout_, ledTimeout_, gestureTimeout_,
+                       readMode_, frameMode_);
+    }
+    else
+    {
+        thread->start(controllerId(slot), roles_[slot], psmoveId, move, this,
+                      pollTimeout_, disconnectTimeout_, ledTimeout_, gestureTimeout_,
+                      readMode_, frameMode_);
     }
 }
 
-void PSMoveListener::onDisconnect()
+void PSMoveListener::disconnect(ControllerId id)
 {
-    // to avoid messing up controller ids on single controller disconnect
-    // we kill all controller threads
-    boost::lock_guard<boost::mutex> lock(mutex_);
-    threadStop_ = true;
+    unsigned int index = static_cast<unsigned int>(controllerIndex(id));
 
-    // controller threads for still connected controllers will be
-    // re-created on next main listener loop iteration
+    if (index < controllerThreads_.size())
+    {
+        // the controller is disconnected by the thread servicing it,
+        // the listener thread reaps it afterwards
+        controllerThreads_[index]->requestStop();
+        wakeListener();
+    }
 }
 
 void PSMoveListener::onDisconnectKey(ControllerId id)
 {
     std::string btaddr;
+    unsigned int index = static_cast<unsigned int>(controllerIndex(id));
 
-    if (id == ControllerId::FIRST)
+    if (index >= controllerThreads_.size())
     {
-        btaddr = controllerThreads_[0]->getBtaddr();
+        return;
     }
-    else
+    btaddr = controllerThreads_[index]->getBtaddr();
+
+    disconnect(id);
+
+    log_.write(boost::str(boost::format("PSMoveListener: disconnecting controller btaddr=%1%") % btaddr.c_str()).c_str());
+    // BlueZ is asked by the worker of the client, which runs the script itself if BlueZ fails
+    if (bluez_.disconnect(btaddr) == false)
+    {
+        runDisconnectScript(btaddr);
+    }
+}
+
+void PSMoveListener::runDisconnectScript(const std::string &btaddr)
+{
+    log_.write(boost::str(boost::format("PSMoveListener: running the disconnect script for btaddr=%1%") % btaddr).c_str());
+
+    // call psmoveinput_disconnect giving it controller's Bluetooth address
+    std::string cmd = "psmoveinput_disconnect.py ";
+    cmd += btaddr;
+    system(cmd.c_str());
+}
+
+PSMove *PSMoveListener::connect(int &psmoveId)
+{
+    timespec now;
+    int count = psmove_count_connected();
+    int running = 0;
+
+    for (ControllerThread *thread : controllerThreads_)
+    {
+        if (thread->running() == true)
+        {
+            running++;
+        }
+    }
+
+    if (count != lastCount_)
+    {
+        invalidateIds();
+        lastCount_ = count;
+    }
+
+    /* Controllers found ineligible are not opened again, since opening and
+       closing them over and over disturbs the Bluetooth ones. The cache
+       is only dropped if there are fewer controllers than cached ones, i.e.
+       some of them must have gone, and, without hot-plug events telling
+       which controllers go away, once in a while. */
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    if ((count < static_cast<int>(ineligible_.size())) ||
+        ((hotplug_.isOpen() == false) && (timespecDiffMs(now, ineligibleTp_) > INELIGIBLE_RECHECK_INTERVAL)))
+    {
+        forgetIneligible();
+    }
+
+    // every controller present is either running or ineligible
+    if (count <= running + static_cast<int>(ineligible_.size()))
+    {
+        return nullptr;
+    }
+
+    PSMove *move = scanIds(count, psmoveId, true);
+    if ((move == nullptr) && (ineligible_.empty() == false))
+    {
+        // there is a controller nobody knows about, but it has not been found,
+        // so it hides behind an id remembered for an ineligible one
+        for (std::map<std::string, int>::value_type &entry : ineligible_)
+        {
+            entry.second = -1;
+        }
+        move = scanIds(count, psmoveId, false);
+    }
+
+    return move;
+}
+
+PSMove *PSMoveListener::scanIds(int count, int &psmoveId, bool useHints)
+{
+    PSMove *move = nullptr;
+
+    // find correct psmoveapi id of controller to connect
+    for (psmoveId = 0; psmoveId < count; psmoveId++)
+    {
+        bool skip = false;
+
+        if (useHints == true)
+        {
+            for (const std::map<std::string, int>::value_type &entry : ineligible_)
+            {
+                if (entry.second == psmoveId)
+                {
+                    skip = true;
+                    break;
+                }
+            }
+        }
+
+        // check if there is a running controller thread with this id
+        if (idsValid_ == true)
+        {
+            for (ControllerThread *thread : controllerThreads_)
+            {
+                if ((thread->running() == true) &&
+                    (thread->getPSMoveId() == psmoveId))
+                {
+                    skip = true;
+                    break;
+                }
+            }
+        }
+
+        if (skip == false)
+        {
+            // no thread handles controller with this id, so try to connect to it
+            move = psmove_connect_by_id(psmoveId);
+            if (move == nullptr)
+            {
+                continue;
+            }
+            std::string serial = getSerial(move);
+            if ((ineligible_.count(serial) != 0) || (psmove_connection_type(move) != Conn_Bluetooth))
+            {
+                // ignore controllers connected via USB, and remember where they are now
+                if (ineligible_.count(serial) == 0)
+                {
+                    log_.write(boost::str(boost::format("Ignoring PSMove %1% connected via USB, psmoveapi id = %2%")
+                                          % serial % psmoveId).c_str());
+                }
+                for (std::map<std::string, int>::value_type &entry : ineligible_)
+                {
+                    if (entry.second == psmoveId)
+                    {
+                        entry.second = -1;
+                    }
+                }
+                ineligible_[serial] = psmoveId;
+                psmove_disconnect(move);
+                move = nullptr;
+                continue;
+            }
+            if (idsValid_ == false)
+            {
+                // ids have been reassigned since running controllers were connected,
+                // so they are recognized by their serial numbers
+                bool running = false;
+                for (ControllerThread *thread : controllerThreads_)
+                {
+                    if ((thread->running() == true) && (thread->getBtaddr() == serial))
+                    {
+                        thread->setPSMoveId(psmoveId);
+                        running = true;
+                        break;
+                    }
+                }
+                if (running == true)
+                {
+                    psmove_disconnect(move);
+                    move = nullptr;
+                    continue;
+                }
+            }
+            break;
+        }
+    }
+
+    // every id has been looked at, so ids of running controllers are up to date
+    if (move == nullptr)
+    {
+        idsValid_ = true;
+    }
+
+    return move;
+}
+
+void PSMoveListener::emitSample(const Sample &sample)
+{
+    timespec entered;
+    timespec written;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &entered);
+
+    // everything produced by one report goes to the input device as one frame
+    frameBeginSlot_();
+
+    if ((sample.flags & SAMPLE_MOTION_FIRST) != 0)
+    {
+        gyroSlot_(sample.id, sample.x[0], sample.y[0], sample.tp[0]);
+    }
+    if ((sample.flags & SAMPLE_MOTION_SECOND) != 0)
+    {
+        gyroSlot_(sample.id, sample.x[1], sample.y[1], sample.tp[1]);
+    }
+    if ((sample.flags & SAMPLE_GESTURE) != 0)
+    {
+        gestureSlot_(sample.id, sample.x[1], sample.y[1], sample.tp[1]);
+    }
+    if ((sample.flags & SAMPLE_BUTTONS) != 0)
+    {
+        buttonSlot_(sample.buttons, sample.id);
+    }
+
+    // the frame is written to the input device before the slot returns
+    frameEndSlot_();
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &written);
+    queueLatency_.record(timespecDiffNs(entered, sample.polled));
+    outputLatency_.record(timespecDiffNs(written, entered));
+    totalLatency_.record(timespecDiffNs(written, sample.polled));
+}
+
+void PSMoveListener::startOutput()
+{
+    if ((outputMode_ != OutputMode::PIPELINE) || (outputThread_ != nullptr))
+    {
+        return;
+    }
+
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd_ < 0)
+    {
+        log_.write("PSMoveListener: failed to create output thread wake up event, falling back to direct output",
+                   LogLevel::ERROR);
+        outputMode_ = OutputMode::DIRECT;
+        return;
+    }
+
+    log_.write("PSMoveListener: starting output thread");
+    outputStop_ = false;
+    outputThread_ = new boost::thread(&PSMoveListener::outputThread, this);
+}
+
+void PSMoveListener::stopOutput()
+{
+    if (outputThread_ == nullptr)
     {
-        btaddr = controllerThreads_[1]->getBtaddr();
+        return;
     }
 
-    // stop controller threads
-    onDisconnect();
+    outputStop_ = true;
+    uint64_t value = 1;
+    write(wakeFd_, &value, sizeof (value));
+    outputThread_->join();
+    delete outputThread_;
+    outputThread_ = nullptr;
 
-    log_.write(boost::str(boost::format("PSMoveListener: disconnecting controller btaddr=%1%") % btaddr.c_str()).c_str());
-    // call psmoveinput_disconnect giving it controller's Bluetooth address
-    std::string cmd = "psmoveinput_disconnect.py ";
-    cmd += btaddr;
-    system(cmd.c_str());
+    close(wakeFd_);
+    wakeFd_ = -1;
 }
 
-PSMove *PSMoveListener::connect(int &psmoveId)
+void PSMoveListener::outputThread()
 {
-    PSMove *move = nullptr;
+    Sample sample;
 
-    // find correct psmoveapi id of controller to connect
-    for (psmoveId = 0; psmoveId < MAX_CONTROLLERS; psmoveId++)
+    applySched(outputSched_, "output");
+
+    while (outputStop_.load() == false)
     {
-        bool exists = false;
+        bool idle = true;
 
-        // check if there is a running controller thread with this id
-        for (int i = 0; i < MAX_CONTROLLERS; i++)
+        // serve controllers in turns, so that a busy one cannot starve the other
+        for (ControllerThread *thread : controllerThreads_)
         {
-            if ((controllerThreads_[i]->running() == true) &&
-                (controllerThreads_[i]->getPSMoveId() == psmoveId))
+            SpscQueue<Sample> *queue = thread->getQueue();
+            if (queue->empty() == true)
+            {
+                continue;
+            }
+            // raised before the first sample leaves the queue and lowered after
+            // the last one has been emitted, see waitOutputDrained()
+            thread->getEmitting().store(true);
+            for (int n = 0; (n < OUTPUT_BATCH) && queue->pop(sample); n++)
             {
-                exists = true;
-                break;
+                emitSample(sample);
+                idle = false;
             }
+            thread->getEmitting().store(false);
         }
 
-        if (exists == false)
+        if (idle == true)
         {
-            // no thread handles controller with this id, so try to connect to it
-            move = psmove_connect_by_id(psmoveId);
-            if (psmove_connection_type(move) != Conn_Bluetooth)
+            /* Announce that we are going to sleep before checking the queues for
+               the last time. A controller thread pushing a sample after that check
+               is guaranteed to see the flag and wake us up, while as long as we
+               are busy, producers do not have to make any syscalls. */
+            outputWaiting_.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool empty = true;
+            for (ControllerThread *thread : controllerThreads_)
             {
-                // ignore controllers connected via USB
-                psmove_disconnect(move);
-                move = nullptr;
-                continue;
+                if (thread->getQueue()->empty() == false)
+                {
+                    empty = false;
+                    break;
+                }
             }
-            break;
+
+            if ((empty == true) && (outputStop_.load() == false))
+            {
+                pollfd pfd;
+                pfd.fd = wakeFd_;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, pollTimeout_) > 0)
+                {
+                    uint64_t value;
+                    read(wakeFd_, &value, sizeof (value));
+                }
+            }
+
+            outputWaiting_.store(false);
         }
     }
+}
+
+void PSMoveListener::wakeOutput()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (outputWaiting_.exchange(false) == true)
+    {
+        uint64_t value = 1;
+        write(wakeFd_, &value, sizeof (value));
+    }
+}
 
+void PSMoveListener::waitOutputDrained()
+{
+    for (ControllerThread *thread : controllerThreads_)
+    {
+        waitOutputDrained(thread);
+    }
+}
 
-    return move;
+void PSMoveListener::waitOutputDrained(ControllerThread *thread)
+{
+    if (outputThread_ == nullptr)
+    {
+        return;
+    }
+
+    /* The queue is checked first: once it is seen empty, the flag raised
+       before the last pop is visible as well, and it stays up until
+       the sample popped has been emitted. */
+    while (true)
+    {
+        bool empty = thread->getQueue()->empty();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ((empty == true) && (thread->getEmitting().load() == false))
+        {
+            break;
+        }
+        wakeOutput();
+        boost::this_thread::sleep(boost::posix_time::millisec(1));
+    }
 }
 
 bool PSMoveListener::isFullCapacity()
 {
     bool isFull = true;
 
-    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    for (ControllerThread *thread : controllerThreads_)
     {
-        if (controllerThreads_[i]->running() == false)
+        if (thread->running() == false)
         {
             isFull = false;
             break;
@@ -258,22 +1298,47 @@ bool PSMoveListener::isFullCapacity()
 
 
 
-PSMoveListener::ControllerThread::ControllerThread(Log &log) :
+PSMoveListener::ControllerThread::ControllerThread(Log &log,
+                                                   OutputMode outputMode,
+                                                   int queueSize,
+                                                   OverflowPolicy overflowPolicy) :
     id_(ControllerId::FIRST),
+    role_(ControllerRole::KEYS),
     move_(nullptr),
     listener_(nullptr),
     thread_(nullptr),
+    attached_(false),
+    stopRequested_(false),
+    finished_(false),
     log_(log),
     pollTimeout_(0),
     disconnectTimeout_(0),
     ledTimeout_(0),
     buttons_(0),
-    pollCount_(0),
     psmoveId_(0),
-    calibrated_(false)
+    calibrated_(false),
+    gestureTimeout_(0),
+    readMode_(ReadMode::POLL),
+    frameMode_(FrameMode::SECOND_HALF),
+    watchdogFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    stopFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    tickFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    cycles_(0),
+    overruns_(0),
+    overflowPolicy_(overflowPolicy),
+    queue_(new SpscQueue<Sample>((outputMode == OutputMode::PIPELINE) ? queueSize : 0)),
+    emitting_(false),
+    dropped_(0),
+    waited_(0)
 {
     lastTp_.tv_sec = 0;
     lastTp_.tv_nsec = 0;
+    lastDataTp_.tv_sec = 0;
+    lastDataTp_.tv_nsec = 0;
+    lastLedTp_.tv_sec = 0;
+    lastLedTp_.tv_nsec = 0;
+    lastGestureTp_.tv_sec = 0;
+    lastGestureTp_.tv_nsec = 0;
 }
 
 PSMoveListener::ControllerThread::~ControllerThread()
@@ -282,183 +1347,549 @@ PSMoveListener::ControllerThread::~ControllerThread()
     {
         delete thread_;
     }
+    if (watchdogFd_ >= 0)
+    {
+        close(watchdogFd_);
+    }
+    if (tickFd_ >= 0)
+    {
+        close(tickFd_);
+    }
+    if (stopFd_ >= 0)
+    {
+        close(stopFd_);
+    }
+    delete queue_;
 }
 
 void PSMoveListener::ControllerThread::start(ControllerId id,
+                                             ControllerRole role,
                                              int psmoveId,
                                              PSMove *move,
                                              PSMoveListener *listener,
                                              int pollTimeout,
                                              int disconnectTimeout,
                                              int ledTimeout,
-                                             int gestureTimeout)
+                                             int gestureTimeout,
+                                             ReadMode readMode,
+                                             FrameMode frameMode)
 {
     // only start new thread if there isn't one already running
-    if (thread_ == nullptr)
-    {
-        int num = (id == ControllerId::FIRST) ? 0 : 1;
-        log_.write(boost::str(boost::format("Starting controller thread for controller #%1%") %num).c_str());
-        id_ = id;
-        psmoveId_ = psmoveId;
-        move_ = move;
-        listener_ = listener;
-        pollTimeout_ = pollTimeout;
-        disconnectTimeout_ = disconnectTimeout;
-        ledTimeout_ = ledTimeout;
-        gestureTimeout_ = gestureTimeout;
-        btaddr_ = psmove_get_serial(move_);
-        if (psmove_has_calibration(move_) == true)
-        {
-            calibrated_ = true;
+    if ((thread_ == nullptr) && (attached_ == false))
+    {
+        setup(id, role, psmoveId, move, listener, pollTimeout, disconnectTimeout, ledTimeout,
+              gestureTimeout, readMode, frameMode);
+        thread_ = new boost::thread(boost::ref(*this));
+    }
+}
+
+void PSMoveListener::ControllerThread::attach(ControllerId id,
+                                              ControllerRole role,
+                                              int psmoveId,
+                                              PSMove *move,
+                                              PSMoveListener *listener,
+                                              int pollTimeout,
+                                              int disconnectTimeout,
+                                              int ledTimeout,
+                                              int gestureTimeout,
+                                              ReadMode readMode,
+                                              FrameMode frameMode)
+{
+    if ((thread_ == nullptr) && (attached_ == false))
+    {
+        setup(id, role, psmoveId, move, listener, pollTimeout, disconnectTimeout, ledTimeout,
+              gestureTimeout, readMode, frameMode);
+        if ((move_ == nullptr) || (listener_ == nullptr))
+        {
+            return;
+        }
+        begin();
+        attached_ = true;
+    }
+}
+
+void PSMoveListener::ControllerThread::release()
+{
+    if (attached_ == true)
+    {
+        attached_ = false;
+        stopRequested_ = false;
+        end();
+    }
+}
+
+void PSMoveListener::ControllerThread::requestStop()
+{
+    stopRequested_ = true;
+    wake();
+}
+
+void PSMoveListener::ControllerThread::wake()
+{
+    if (stopFd_ >= 0)
+    {
+        uint64_t value = 1;
+        write(stopFd_, &value, sizeof (value));
+    }
+}
+
+void PSMoveListener::ControllerThread::reap()
+{
+    if (thread_ != nullptr)
+    {
+        thread_->join();
+        delete thread_;
+        thread_ = nullptr;
+    }
+    stopRequested_ = false;
+    finished_ = false;
+}
+
+void PSMoveListener::ControllerThread::setup(ControllerId id,
+                                             ControllerRole role,
+                                             int psmoveId,
+                                             PSMove *move,
+                                             PSMoveListener *listener,
+                                             int pollTimeout,
+                                             int disconnectTimeout,
+                                             int ledTimeout,
+                                             int gestureTimeout,
+                                             ReadMode readMode,
+                                             FrameMode frameMode)
+{
+    int num = controllerIndex(id);
+    log_.write(boost::str(boost::format("Setting up controller #%1%") %num).c_str());
+    id_ = id;
+    role_ = role;
+    psmoveId_ = psmoveId;
+    move_ = move;
+    listener_ = listener;
+    pollTimeout_ = pollTimeout;
+    disconnectTimeout_ = disconnectTimeout;
+    ledTimeout_ = ledTimeout;
+    gestureTimeout_ = gestureTimeout;
+    frameMode_ = frameMode;
+    btaddr_ = getSerial(move_);
+    if (psmove_has_calibration(move_) == true)
+    {
+        calibrated_ = true;
+    }
+    else
+    {
+        calibrated_ = false;
+    }
+
+    // in event mode the thread sleeps on controller's hidraw node;
+    // if the node cannot be found (e.g. remote controllers in client mode),
+    // fall back to polling the controller every pollTimeout ms
+    readMode_ = ReadMode::POLL;
+    if (readMode == ReadMode::EVENT)
+    {
+        if (watcher_.open(btaddr_) == true)
+        {
+            readMode_ = ReadMode::EVENT;
+            log_.write(boost::str(boost::format("Controller #%1% reports are read from %2%") % num % watcher_.getDevice()).c_str());
         }
         else
         {
-            calibrated_ = false;
+            log_.write(boost::str(boost::format("Could not open hidraw node of controller #%1%, falling back to poll mode") % num).c_str(),
+                       LogLevel::ERROR);
         }
-
-        thread_ = new boost::thread(boost::ref(*this));
     }
 }
 
 bool PSMoveListener::ControllerThread::running()
 {
-    return ((thread_ == nullptr) ? false : true);
+    return ((thread_ != nullptr) || (attached_ == true));
 }
 
 void PSMoveListener::ControllerThread::operator ()()
 {
-    timespec tp;
-    int gestureCount = 0;
-
-    tp.tv_sec = 0;
-    tp.tv_nsec = 0;
-
     if ((move_ == nullptr) || (listener_ == nullptr))
     {
         return;
     }
 
-    setLeds();
+    listener_->applySched(listener_->controllerSched_, "controller");
+    begin();
+
+    // the controller is serviced on a fixed cadence of absolute deadlines,
+    // however long servicing it takes, and in event mode on every report as well
+    cycles_ = 0;
+    overruns_ = 0;
+    armTimerAbs(tickFd_, pollTimeout_);
 
     // thread main loop
     while (true)
     {
-        int gx, gy, gz, buttons;
+        if ((listener_->needToStop() == true) || (stopRequested_ == true))
+        {
+            break;
+        }
 
-        if (listener_->needToStop() == true)
+        service();
+
+        if (wait() == false)
         {
             break;
         }
+    }
+
+    disarmTimer(tickFd_);
+    end();
+
+    // the listener thread joins us and frees the slot
+    finished_ = true;
+    listener_->wakeListener();
+}
 
-        // fetch data from PSMove as long as there is something to fetch
-        while (psmove_poll(move_))
+bool PSMoveListener::ControllerThread::wait()
+{
+    pollfd pfds[4];
+
+    // wake up as soon as the controller sends a report, its disconnect timeout
+    // expires or we are asked to stop; the tick lets us read the controller
+    // in poll mode and handle LED updates on a silent controller
+    pfds[0].fd = watchdogFd_;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    pfds[1].fd = getWaitFd();
+    pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
+    pfds[2].fd = tickFd_;
+    pfds[2].events = POLLIN;
+    pfds[2].revents = 0;
+    pfds[3].fd = stopFd_;
+    pfds[3].events = POLLIN;
+    pfds[3].revents = 0;
+
+    if (poll(pfds, 4, -1) > 0)
+    {
+        if ((pfds[3].revents & POLLIN) != 0)
         {
-            // only the first controller moves the mouse pointer
-            if (calibrated_ == true)
-            {
-                float fx, fy, fz;
-                psmove_get_gyroscope_frame(move_, Frame_SecondHalf, &fx, &fy, &fz);
-                /* since calibrated gyroscope values can be less than 1, e.g. something
-                   like 0.00354, we multiply them by special coefficient before converting
-                   them to integers in order not to miss small controller movements
-                   and prevent the mouse cursor from being twitchy */
-                gx = static_cast<int>(fx * CALIBRATED_GYRO_COEFF);
-                gz = static_cast<int>(fz * CALIBRATED_GYRO_COEFF);
-            }
-            else
+            // stop requests are checked by the caller
+            uint64_t value;
+            read(stopFd_, &value, sizeof (value));
+            return true;
+        }
+        if ((pfds[2].revents & POLLIN) != 0)
+        {
+            // more than one expiration means we have missed a deadline
+            uint64_t expirations = readTimer(tickFd_);
+            cycles_.fetch_add(expirations, std::memory_order_relaxed);
+            if (expirations > 1)
             {
-                psmove_get_gyroscope(move_, &gx, &gy, &gz);
+                overruns_.fetch_add(expirations - 1, std::memory_order_relaxed);
             }
+        }
+        if ((pfds[1].revents & POLLIN) != 0)
+        {
+            watcher_.drain();
+        }
+        if ((pfds[0].revents & POLLIN) != 0)
+        {
+            return watchdog();
+        }
+    }
 
-            if (id_ == ControllerId::FIRST)
-            {
-                // first controller moves the cursor
-                listener_->getGyroSignal()(-gz, -gx);
-            }
-            else
-            {
-                // second controller is used for gestures
-                gestureCount++;
-                if (gestureCount > (gestureTimeout_ / pollTimeout_))
-                {
-                    gestureCount = 0;
-                    listener_->getGestureSignal()(-gz, gx);
-                }
-            }
+    return true;
+}
 
-            buttons = psmove_get_buttons(move_);
-            if (buttons_ != buttons)
-            {
-                buttons_ = buttons;
-                listener_->getButtonSignal()(buttons, id_);
-            }
+bool PSMoveListener::ControllerThread::watchdog()
+{
+    timespec tp;
+
+    readTimer(watchdogFd_);
+    if (move_ == nullptr)
+    {
+        // stale expiration of a controller, which is gone already
+        return true;
+    }
 
-            // remember when we received last piece of data from PSMove
-            clock_gettime(CLOCK_MONOTONIC_RAW, &lastTp_);
+    /* The timer is armed for disconnect timeout after the last piece of data we
+       knew of at the time, so that getting reports costs nothing extra. Once it
+       expires, it is either the controller being gone or the timer being re-armed
+       for disconnect timeout after the data received since then. Controller,
+       which has not sent anything yet, is never considered disconnected. */
+    long long timeout = disconnectTimeout_ * 1000000LL;
+    long long elapsed = 0;
+    if (lastDataTp_.tv_sec != 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &tp);
+        elapsed = timespecDiffNs(tp, lastDataTp_);
+        if (elapsed >= timeout)
+        {
+            log_.write(boost::str(boost::format("Controller #%1% has sent nothing for %2% ms")
+                                  % controllerIndex(id_) % (elapsed / 1000000)).c_str());
+            return false;
         }
+    }
+    armTimerNs(watchdogFd_, timeout - elapsed);
+
+    return true;
+}
+
+void PSMoveListener::ControllerThread::begin()
+{
+    // forget wake ups meant for the previous controller
+    if (stopFd_ >= 0)
+    {
+        uint64_t value;
+        read(stopFd_, &value, sizeof (value));
+    }
 
-        updateLeds();
+    setLeds();
+    clock_gettime(CLOCK_MONOTONIC_RAW, &lastLedTp_);
+    lastGestureTp_ = lastLedTp_;
+    armTimerNs(watchdogFd_, disconnectTimeout_ * 1000000LL);
+}
+
+void PSMoveListener::ControllerThread::service()
+{
+    Report reports[MAX_REPORT_BATCH];
+    int count = 0;
 
-        // if controller does not give data updates for a specific period
-        // of time, consider it disconnected and stop the thread
-        clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
-        if (lastTp_.tv_sec != 0)
+    // fetch data from PSMove as long as there is something to fetch
+    while (psmove_poll(move_))
+    {
+        readReport(reports[count]);
+        count++;
+        if (count == MAX_REPORT_BATCH)
         {
-            if ((tp.tv_sec - lastTp_.tv_sec) > disconnectTimeout_)
-            {
-                break;
-            }
+            handleReports(reports, count);
+            count = 0;
         }
-        
-        boost::this_thread::sleep(boost::posix_time::millisec(pollTimeout_));
     }
+    if (count > 0)
+    {
+        handleReports(reports, count);
+    }
+
+    updateLeds();
+}
+
+void PSMoveListener::ControllerThread::end()
+{
+    log_.write(boost::str(boost::format("Stopping controller #%1%") % controllerIndex(id_)).c_str());
+    logStats();
 
-    int num = (id_ == ControllerId::FIRST) ? 0 : 1;
-    log_.write(boost::str(boost::format("Stopping controller thread for controller #%1%") %num).c_str());
-    
-    // the thread is about to stop, so we don't need thread object anymore
-    thread_->detach();
-    delete thread_;
-    thread_ = nullptr;
     lastTp_.tv_sec = 0;
     lastTp_.tv_nsec = 0;
-    
+    lastDataTp_.tv_sec = 0;
+    lastDataTp_.tv_nsec = 0;
+
     // clean up
+    disarmTimer(watchdogFd_);
+    watcher_.close();
     psmove_disconnect(move_);
     move_ = nullptr;
-    // notify the listener
-    listener_->onDisconnect();
 }
 
-void PSMoveListener::ControllerThread::setLeds()
+void PSMoveListener::ControllerThread::logStats()
 {
-    if (move_ == nullptr)
+    int num = controllerIndex(id_);
+
+    if (thread_ != nullptr)
     {
-        return;
+        log_.write(boost::str(boost::format("Controller #%1% loop: %2% cycles, %3% missed deadlines")
+                              % num % cycles_.load() % overruns_.load()).c_str());
+    }
+    if (listener_->outputMode_ == OutputMode::PIPELINE)
+    {
+        log_.write(boost::str(boost::format("Controller #%1% output queue: max depth %2% of %3%, %4% samples dropped, %5% waited for room")
+                              % num % queue_->getHighWater() % queue_->capacity() % dropped_.load() % waited_.load()).c_str());
     }
+}
 
-    // TODO: make colors configurable
+void PSMoveListener::ControllerThread::readReport(Report &report)
+{
+    int gx, gy, gz;
 
-    if (id_ == ControllerId::FIRST)
+    clock_gettime(CLOCK_MONOTONIC_RAW, &report.polled);
+
+    if (calibrated_ == true)
+    {
+        float fx, fy, fz;
+        /* since calibrated gyroscope values can be less than 1, e.g. something
+           like 0.00354, we multiply them by special coefficient before converting
+           them to integers in order not to miss small controller movements
+           and prevent the mouse cursor from being twitchy */
+        if (frameMode_ == FrameMode::BOTH_HALVES)
+        {
+            psmove_get_gyroscope_frame(move_, Frame_FirstHalf, &fx, &fy, &fz);
+            report.gx[0] = static_cast<int>(fx * CALIBRATED_GYRO_COEFF);
+            report.gz[0] = static_cast<int>(fz * CALIBRATED_GYRO_COEFF);
+        }
+        psmove_get_gyroscope_frame(move_, Frame_SecondHalf, &fx, &fy, &fz);
+        report.gx[1] = static_cast<int>(fx * CALIBRATED_GYRO_COEFF);
+        report.gz[1] = static_cast<int>(fz * CALIBRATED_GYRO_COEFF);
+    }
+    else if (frameMode_ == FrameMode::BOTH_HALVES)
     {
-        psmove_set_leds(move_, 33, 119, 47);
+        psmove_get_half_frame(move_, Sensor_Gyroscope, Frame_FirstHalf, &gx, &gy, &gz);
+        report.gx[0] = gx;
+        report.gz[0] = gz;
+        psmove_get_half_frame(move_, Sensor_Gyroscope, Frame_SecondHalf, &gx, &gy, &gz);
+        report.gx[1] = gx;
+        report.gz[1] = gz;
     }
     else
     {
-        psmove_set_leds(move_, 123, 59, 160);
+        psmove_get_gyroscope(move_, &gx, &gy, &gz);
+        report.gx[1] = gx;
+        report.gz[1] = gz;
+    }
+
+    report.buttons = psmove_get_buttons(move_);
+}
+
+void PSMoveListener::ControllerThread::handleReports(const Report *reports, int count)
+{
+    timespec now;
+    long long interval = 0;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+    /* All reports fetched in one go are considered to be evenly spread between
+       the previous batch and now, so that the handler integrates motion over the
+       real time it took the controller to send them, rather than over the time
+       it took us to read them. Each report carries two half-frames, the first
+       one being sampled half a report interval earlier than the second. */
+    if (lastTp_.tv_sec != 0)
+    {
+        interval = timespecDiffNs(now, lastTp_) / count;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        const Report &report = reports[i];
+        Sample sample;
+
+        sample.flags = 0;
+        sample.id = id_;
+        sample.polled = report.polled;
+        sample.tp[1] = timespecAddNs(now, -interval * (count - 1 - i));
+        sample.tp[0] = timespecAddNs(sample.tp[1], -interval / 2);
+
+        if (role_ == ControllerRole::POINTER)
+        {
+            // pointer controller moves the cursor
+            if (frameMode_ == FrameMode::BOTH_HALVES)
+            {
+                sample.flags |= SAMPLE_MOTION_FIRST;
+                sample.x[0] = -report.gz[0];
+                sample.y[0] = -report.gx[0];
+            }
+            sample.flags |= SAMPLE_MOTION_SECOND;
+            sample.x[1] = -report.gz[1];
+            sample.y[1] = -report.gx[1];
+        }
+        else if (role_ == ControllerRole::GESTURE)
+        {
+            // gesture controller's movements are
+            // reported once per gesture timeout
+            if (timespecDiffMs(sample.tp[1], lastGestureTp_) > gestureTimeout_)
+            {
+                lastGestureTp_ = sample.tp[1];
+                sample.flags |= SAMPLE_GESTURE;
+                if (frameMode_ == FrameMode::BOTH_HALVES)
+                {
+                    // gestures are sampled rather than integrated,
+                    // so both half-frames are averaged to reduce noise
+                    sample.x[1] = -(report.gz[0] + report.gz[1]) / 2;
+                    sample.y[1] = (report.gx[0] + report.gx[1]) / 2;
+                }
+                else
+                {
+                    sample.x[1] = -report.gz[1];
+                    sample.y[1] = report.gx[1];
+                }
+            }
+        }
+
+        if (buttons_ != report.buttons)
+        {
+            buttons_ = report.buttons;
+            sample.flags |= SAMPLE_BUTTONS;
+            sample.buttons = report.buttons;
+        }
+
+        if (sample.flags == 0)
+        {
+            continue;
+        }
+
+        if (listener_->outputMode_ == OutputMode::PIPELINE)
+        {
+            pushSample(sample);
+        }
+        else
+        {
+            listener_->emitSample(sample);
+        }
+    }
+
+    // remember when we received last piece of data from PSMove
+    lastTp_ = now;
+    clock_gettime(CLOCK_MONOTONIC, &lastDataTp_);
+}
+
+void PSMoveListener::ControllerThread::pushSample(const Sample &sample)
+{
+    bool waited = false;
+
+    while (queue_->push(sample) == false)
+    {
+        if ((overflowPolicy_ == OverflowPolicy::DROP) && ((sample.flags & SAMPLE_BUTTONS) == 0))
+        {
+            // losing a bit of pointer movement is better than falling behind,
+            // but button presses and releases must never get lost
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (listener_->needToStop() == true)
+        {
+            return;
+        }
+
+        if (waited == false)
+        {
+            waited = true;
+            waited_.fetch_add(1, std::memory_order_relaxed);
+        }
+        listener_->wakeOutput();
+        boost::this_thread::yield();
+    }
+
+    listener_->wakeOutput();
+}
+
+void PSMoveListener::ControllerThread::setLeds()
+{
+    if (move_ == nullptr)
+    {
+        return;
     }
+
+    // TODO: make colors configurable
+
+    const unsigned char *color = ledColors[controllerIndex(id_) % LED_COLORS];
+    psmove_set_leds(move_, color[0], color[1], color[2]);
     psmove_update_leds(move_);
 }
 
 void PSMoveListener::ControllerThread::updateLeds()
 {
-    log_.write(boost::str(boost::format("updateLeds(), pollCount_=%1%") %pollCount_).c_str());
-    pollCount_++;
-    if (pollCount_ > (ledTimeout_ / pollTimeout_))
+    timespec tp;
+
+    // controller turns LEDs off unless they are refreshed periodically
+    clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+    if (timespecDiffMs(tp, lastLedTp_) > ledTimeout_)
     {
-        pollCount_ = 0;
+        lastLedTp_ = tp;
         int update_result = psmove_update_leds(move_);
-        log_.write(boost::str(boost::format("psmove_update_leds() returned %1%") %update_result).c_str());
+        LOG_TRACE(log_, boost::str(boost::format("psmove_update_leds() returned %1%") %update_result).c_str());
     }
 }
 
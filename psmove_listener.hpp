@@ -24,104 +24,331 @@
 #define PSMOVEINPUT_PSMOVE_LISTENER_HPP
 
 #include "log.hpp"
+#include "bluez_client.hpp"
+#include "hidraw_watcher.hpp"
+#include "hotplug_monitor.hpp"
+#include "latency_histogram.hpp"
+#include "spsc_queue.hpp"
+#include "static_slot.hpp"
 #include <boost/signals2.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <psmoveapi/psmove.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <vector>
 #include <time.h>
 
 namespace psmoveinput
 {
 
-typedef boost::signals2::signal<void (int, int)> gyro_signal;
-typedef boost::signals2::signal<void (int, ControllerId)> button_signal;
-typedef boost::signals2::signal<void ()> disconnect_complete_signal;
+// gyroscope values of a controller along with the time point they were sampled at
+typedef StaticSlot<void (ControllerId, int, int, const timespec &)> gyro_slot;
+typedef StaticSlot<void (int, ControllerId)> button_slot;
+// invoked before and after the slots fed by a single controller report
+typedef StaticSlot<void ()> frame_slot;
+// raised by the listener thread once a controller has been disconnected
+// and everything it has sent has been handed over
+typedef boost::signals2::signal<void (ControllerId)> disconnect_complete_signal;
+// raised by the listener thread for every Unix signal read from the signal descriptor
+typedef boost::signals2::signal<void (int)> unix_signal_signal;
+
+// listener settings
+struct ListenerParams
+{
+    OpMode mode;
+    int pollTimeout;
+    int connectTimeout;
+    int disconnectTimeout;
+    int ledTimeout;
+    int gestureTimeout;
+    ReadMode readMode;
+    FrameMode frameMode;
+    ThreadModel threadModel;
+    OutputMode outputMode;
+    int outputQueueSize;
+    OverflowPolicy overflowPolicy;
+    // scheduling of the threads servicing controllers and of the output thread
+    SchedParams controllerSched;
+    SchedParams outputSched;
+    bool lockMemory;
+    // one role per controller of the pool
+    std::vector<ControllerRole> roles;
+};
 
 class PSMoveListener
 {
 public:
-    PSMoveListener(Log &log,
-                   OpMode mode,
-                   int pollTimeout,
-                   int connectTimeout,
-                   int disconnectTimeout,
-                   int ledTimeout,
-                   int gestureTimeout);
+    PSMoveListener(Log &log, const ListenerParams &params);
     virtual ~PSMoveListener();
 
-    gyro_signal &getGyroSignal() { return gyroSignal_; }
-    gyro_signal &getGestureSignal() { return gestureSignal_; }
-    button_signal &getButtonSignal() { return buttonSignal_; }
+    // per-sample outputs, have to be set before run()
+    void setGyroSlot(const gyro_slot &slot) { gyroSlot_ = slot; }
+    void setGestureSlot(const gyro_slot &slot) { gestureSlot_ = slot; }
+    void setButtonSlot(const button_slot &slot) { buttonSlot_ = slot; }
+    void setFrameBeginSlot(const frame_slot &slot) { frameBeginSlot_ = slot; }
+    void setFrameEndSlot(const frame_slot &slot) { frameEndSlot_ = slot; }
     disconnect_complete_signal &getDisconnectCompleteSignal() { return disconnectCompleteSignal_; }
+    unix_signal_signal &getUnixSignalSignal() { return unixSignalSignal_; }
+    // signalfd descriptor watched by the listener loop, has to be set before run()
+    void setSignalFd(int fd) { signalFd_ = fd; }
     void run();
     void stop();
-    bool needToStop() { return (stop_ || threadStop_); }
-    void onDisconnect();
+    bool needToStop() { return stop_.load(); }
+    // disconnect a single controller, the others keep working
+    void disconnect(ControllerId id);
     void onDisconnectKey(ControllerId id);
+    // log statistics of connected controllers, has to be called from the listener thread
+    void dumpStats();
 
 protected:
 
+    // everything controller thread extracted from a single report,
+    // which has to be passed on to the handler
+    struct Sample
+    {
+        int flags;          // SAMPLE_* bits
+        ControllerId id;
+        int x[2];           // movement (first and second half-frames) or gesture (second)
+        int y[2];
+        timespec tp[2];
+        int buttons;
+        // when psmove_poll() returned the report
+        timespec polled;
+    };
+
     // controller thread manages connection to single PSMove controller
-    // and invokes listener's signals on getting input events
+    // and invokes listener's slots on getting input events;
+    // in reactor mode it has no thread of its own and is serviced by the listener thread
     class ControllerThread
     {
     public:
-        ControllerThread(Log &log);
+        ControllerThread(Log &log, OutputMode outputMode, int queueSize, OverflowPolicy overflowPolicy);
         virtual ~ControllerThread();
 
+        // start a thread servicing the controller
         void start(ControllerId id,
+                   ControllerRole role,
                    int psmoveId,
                    PSMove *move,
                    PSMoveListener *listener,
                    int pollTimeout,
                    int disconnectTimeout,
                    int ledTimeout,
-                   int gestureTimeout);
+                   int gestureTimeout,
+                   ReadMode readMode,
+                   FrameMode frameMode);
+        // take the controller over without starting a thread, service() has to be
+        // called whenever getWaitFd() becomes readable and at least every pollTimeout ms
+        void attach(ControllerId id,
+                    ControllerRole role,
+                    int psmoveId,
+                    PSMove *move,
+                    PSMoveListener *listener,
+                    int pollTimeout,
+                    int disconnectTimeout,
+                    int ledTimeout,
+                    int gestureTimeout,
+                    ReadMode readMode,
+                    FrameMode frameMode);
+        // disconnect the controller taken over with attach()
+        void release();
+        // ask the thread to disconnect the controller
+        void requestStop();
+        // make the thread check stop requests right away
+        void wake();
+        bool stopRequested() { return stopRequested_.load(); }
+        // the thread has disconnected the controller and has to be reaped
+        bool finished() { return finished_.load(); }
+        void reap();
+        // read and handle everything the controller has sent, refresh LEDs
+        void service();
+        // descriptor becoming readable when the controller sends a report, -1 in poll mode
+        int getWaitFd() { return (readMode_ == ReadMode::EVENT) ? watcher_.getFd() : -1; }
+        // has to be called before service() once getWaitFd() is readable
+        void drainWaitFd() { watcher_.drain(); }
+        // timer becoming readable when the disconnect timeout may have expired
+        int getWatchdogFd() { return watchdogFd_; }
+        // has to be called once getWatchdogFd() is readable;
+        // returns false if the controller is considered disconnected
+        bool watchdog();
         void join() { if (thread_ != nullptr) thread_->join(); }
         bool running();
         void operator ()();
+        void logStats();
         int getPSMoveId() { return psmoveId_; }
+        void setPSMoveId(int psmoveId) { psmoveId_ = psmoveId; }
+        ControllerId getId() { return id_; }
         std::string getBtaddr() { return btaddr_; }
+        // pipeline mode: samples waiting for the output thread
+        SpscQueue<Sample> *getQueue() { return queue_; }
+        // pipeline mode: set by the output thread while it hands samples of
+        // this controller over, so that emptying the queue is not mistaken
+        // for the last sample having reached the handler
+        std::atomic<bool> &getEmitting() { return emitting_; }
 
     protected:
+        // sensor data from a single controller report
+        struct Report
+        {
+            int gx[2];      // gyroscope x for the first and the second half-frames
+            int gz[2];      // gyroscope z for the first and the second half-frames
+            int buttons;
+            timespec polled;
+        };
+
         ControllerId id_;
+        ControllerRole role_;
         PSMove *move_;
         PSMoveListener* listener_;
         boost::thread *thread_;
+        bool attached_;
+        std::atomic<bool> stopRequested_;
+        std::atomic<bool> finished_;
         Log &log_;
         int pollTimeout_;
         int disconnectTimeout_;
         int ledTimeout_;
         int buttons_;
         timespec lastTp_;
-        int pollCount_;
+        // the same on the clock of watchdogFd_, since timerfd does not support
+        // CLOCK_MONOTONIC_RAW and the watchdog must not mix the two clocks
+        timespec lastDataTp_;
+        timespec lastLedTp_;
+        timespec lastGestureTp_;
         int psmoveId_;
         std::string btaddr_;
         bool calibrated_;
         int gestureTimeout_;
+        ReadMode readMode_;
+        FrameMode frameMode_;
+        HidrawWatcher watcher_;
+        // disconnect timeout timer, armed for the earliest time the controller
+        // may be considered disconnected and re-armed lazily when it fires
+        int watchdogFd_;
+        // thread mode: wakes the thread up on stop requests
+        int stopFd_;
+        // thread mode: fixed-rate loop timer and its statistics
+        int tickFd_;
+        std::atomic<unsigned long> cycles_;
+        std::atomic<unsigned long> overruns_;
+        OverflowPolicy overflowPolicy_;
+        SpscQueue<Sample> *queue_;
+        std::atomic<bool> emitting_;
+        // output queue statistics
+        std::atomic<unsigned long> dropped_;
+        std::atomic<unsigned long> waited_;
 
+        void setup(ControllerId id,
+                   ControllerRole role,
+                   int psmoveId,
+                   PSMove *move,
+                   PSMoveListener *listener,
+                   int pollTimeout,
+                   int disconnectTimeout,
+                   int ledTimeout,
+                   int gestureTimeout,
+                   ReadMode readMode,
+                   FrameMode frameMode);
+        void begin();
+        void end();
+        // sleep until there is something to do; returns false if the controller
+        // is considered disconnected
+        bool wait();
+        void readReport(Report &report);
+        void handleReports(const Report *reports, int count);
+        void pushSample(const Sample &sample);
         void setLeds();
         void updateLeds();
     };
 
-    gyro_signal gyroSignal_;
-    gyro_signal gestureSignal_;
-    button_signal buttonSignal_;
+    gyro_slot gyroSlot_;
+    gyro_slot gestureSlot_;
+    button_slot buttonSlot_;
+    frame_slot frameBeginSlot_;
+    frame_slot frameEndSlot_;
     disconnect_complete_signal disconnectCompleteSignal_;
+    unix_signal_signal unixSignalSignal_;
     Log &log_;
-    bool stop_;
+    std::atomic<bool> stop_;
     OpMode mode_;
-    ControllerThread *controllerThreads_[MAX_CONTROLLERS];
-    boost::mutex mutex_;
-    bool threadStop_;
+    std::vector<ControllerThread*> controllerThreads_;
+    std::vector<ControllerRole> roles_;
+    // serial number of the controller, which used each slot last,
+    // so that controllers keep their slots when they reconnect
+    std::vector<std::string> slotSerials_;
     int pollTimeout_;
     int connectTimeout_;
     int disconnectTimeout_;
     int ledTimeout_;
     int gestureTimeout_;
+    ReadMode readMode_;
+    FrameMode frameMode_;
+    ThreadModel threadModel_;
+    OutputMode outputMode_;
+    SchedParams controllerSched_;
+    SchedParams outputSched_;
+    bool lockMemory_;
+    boost::thread *outputThread_;
+    std::atomic<bool> outputStop_;
+    // set while the output thread is about to sleep on wakeFd_
+    std::atomic<bool> outputWaiting_;
+    int wakeFd_;
+    // wakes listener thread up on stop and disconnect requests
+    int controlFd_;
+    int signalFd_;
+    // reactor tick deadlines passed while the loop was busy with something else
+    unsigned long tickOverruns_;
+    // latencies of samples from psmove_poll() to handler entry, from handler
+    // entry to completion of the input device write and of the whole way
+    LatencyHistogram queueLatency_;
+    LatencyHistogram outputLatency_;
+    LatencyHistogram totalLatency_;
+    HotplugMonitor hotplug_;
+    BluezClient bluez_;
+    // Bluetooth addresses of controllers announced by hot-plug events,
+    // which have not been connected yet
+    std::set<std::string> pendingDevices_;
+    int connectRetries_;
+    // controllers, which cannot be connected (i.e. USB ones), by serial number, with
+    // psmoveapi ids they were last seen at; the ids are only hints, since psmoveapi
+    // renumbers controllers whenever one of them comes or goes
+    std::map<std::string, int> ineligible_;
+    // when the cache was last emptied; without hot-plug events nobody tells
+    // that an ineligible controller has gone, so the cache is rebuilt now and then
+    timespec ineligibleTp_;
+    // number of controllers reported by psmoveapi last time
+    int lastCount_;
+    // psmoveapi ids of running controllers may be out of date
+    // after controllers have come and gone
+    bool idsValid_;
 
     void init();
+    void runThreads();
+    void runReactor();
+    void wakeListener();
+    bool waitEvents();
+    void handleSignals();
+    void logLatency(const char *stage, const LatencyHistogram &histogram);
+    bool addWatchdogs(int epfd);
+    void applySched(const SchedParams &params, const char *name);
+    bool handleHotplug();
+    void connectControllers();
+    bool reapControllers();
+    void controllerGone(ControllerThread *thread);
+    void invalidateIds();
+    void forgetIneligible();
+    PSMove *scanIds(int count, int &psmoveId, bool useHints);
+    void emitSample(const Sample &sample);
+    void startOutput();
+    void stopOutput();
+    void outputThread();
+    void wakeOutput();
+    void waitOutputDrained();
+    void waitOutputDrained(ControllerThread *thread);
     void handleNewDevice(int psmoveId, PSMove *move);
+    void runDisconnectScript(const std::string &btaddr);
     PSMove *connect(int &psmoveId); 
     bool isFullCapacity();
 };
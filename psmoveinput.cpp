@@ -23,12 +23,14 @@
 #include "psmoveinput.hpp"
 #include "config.h"
 #include "file_log.hpp"
+#include "sample_replay.hpp"
 #include <iostream>
 #include <unistd.h>
 #include <boost/format.hpp>
 #include <boost/bind/placeholders.hpp>
 #include <signal.h>
 #include <fcntl.h>
+#include <sys/signalfd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <exception>
@@ -38,11 +40,6 @@ using namespace boost::placeholders;
 namespace psmoveinput
 {
 
-extern "C"
-{
-    static void signal_handler(int sig);
-}
-
 PSMoveInput *PSMoveInput::instance_ = nullptr;
 int PSMoveInput::refs_ = 0;
 
@@ -67,56 +64,85 @@ void PSMoveInput::releaseRef()
 }
 
 PSMoveInput::PSMoveInput() :
+    config_(new Config()),
     log_(nullptr),
     device_(nullptr),
     handler_(nullptr),
-    listener_(nullptr)
+    listener_(nullptr),
+    recorder_(nullptr),
+    argc_(0),
+    argv_(nullptr),
+    signalFd_(-1),
+    reload_(false)
 {
 }
 
 PSMoveInput::~PSMoveInput()
 {
+    stopComponents();
     if (log_ != nullptr)
     {
         delete log_;
     }
-    if (device_ != nullptr)
+    if (signalFd_ >= 0)
     {
-        delete device_;
-    }
-    if (handler_ != nullptr)
-    {
-        delete handler_;
-    }
-    if (listener_ != nullptr)
-    {
-        delete listener_;
+        close(signalFd_);
     }
+    delete config_;
 }
 
 int PSMoveInput::run(int argc, char **argv)
 {
     int retval = RETVAL_OK;
 
+    argc_ = argc;
+    argv_ = argv;
+
     try
     {
         processConfig(argc, argv);
 
+        // replay runs in foreground and may be used alongside a running instance
+        if (config_->getReplayFileName()[0] != '\0')
+        {
+            setupSignals();
+            setupLog();
+            replay();
+            return retval;
+        }
+
         std::cout << "Starting psmoveinput" << std::endl;
 
-        setupLog();
         checkPidFile();
 
+        // fork before starting any threads, they would not survive it
         daemonize();
 
+        // signals are blocked in every thread started from now on
         setupSignals();
 
-        initDevice();
-        initHandler();
+        setupLog();
+        writePidFile();
 
-        // launch psmove listener, it will automatically report events to the handler,
-        // and the handler will forward them to the input device
-        startListener();
+        while (true)
+        {
+            initDevice();
+            initHandler();
+
+            // launch psmove listener, it will automatically report events to the handler,
+            // and the handler will forward them to the input device
+            startListener();
+
+            if (reload_ == false)
+            {
+                break;
+            }
+
+            // start over with the new configuration, if it is fine
+            reload_ = false;
+            stopComponents();
+            reloadConfig();
+        }
 
         // time to quit
         removePidFile();
@@ -153,7 +179,7 @@ int PSMoveInput::handleException(Exception &e)
         case ex_type::ALREADY_RUNNING:
         {
             std::cout << "An instance of psmoveinput is already running. ";
-            std::cout << "Pidfile: " << config_.getPidFileName() << std::endl;
+            std::cout << "Pidfile: " << config_->getPidFileName() << std::endl;
             retval = RETVAL_ALREADY;
             break;
         }
@@ -180,6 +206,12 @@ int PSMoveInput::handleException(Exception &e)
             retval = RETVAL_OK;
             break;
         }
+        case ex_type::REPLAY_FAILED:
+        {
+            std::cout << "Failed to open recording " << config_->getReplayFileName() << std::endl;
+            retval = RETVAL_FAIL;
+            break;
+        }
         case ex_type::VERSION_RQ:
         {
             print_version();
@@ -195,18 +227,18 @@ int PSMoveInput::handleException(Exception &e)
 
 void PSMoveInput::processConfig(int argc, char **argv)
 {
-    config_.parse(argc, argv);
-    if (!config_.isOK())
+    config_->parse(argc, argv);
+    if (!config_->isOK())
     {
         throw Exception(ex_type::INVALID_CONFIG);
     }
 
-    if (config_.helpRequested())
+    if (config_->helpRequested())
     {
         throw Exception(ex_type::HELP_RQ);
     }
 
-    if (config_.versionRequested())
+    if (config_->versionRequested())
     {
         throw Exception(ex_type::VERSION_RQ);
     }
@@ -214,16 +246,17 @@ void PSMoveInput::processConfig(int argc, char **argv)
 
 void PSMoveInput::setupLog()
 {
-    LogLevel loglvl = config_.getLogLevel();
-    log_ = new Log(LogParams(config_.getLogFileName(), loglvl));
+    LogLevel loglvl = config_->getLogLevel();
+    log_ = new Log(LogParams(config_->getLogFileName(), loglvl));
     FileLog *logBackend = new FileLog();
+    logBackend->setWriterSched(config_->getLogSched());
     log_->addBackend(logBackend);
     log_->write("PSMoveInput logging started");
 }
 
 void PSMoveInput::checkPidFile()
 {
-    const char *pidfile = config_.getPidFileName();
+    const char *pidfile = config_->getPidFileName();
     int fd = open(pidfile, O_RDONLY);
     if (fd >= 0)
     {
@@ -237,7 +270,7 @@ void PSMoveInput::daemonize()
 {
     pid_t pid;
 
-    if (config_.getForeground() == false) // don't fork in foreground mode
+    if (config_->getForeground() == false) // don't fork in foreground mode
     {
         std::cout << "Forking to background..." << std::endl;
         pid = fork();
@@ -268,13 +301,11 @@ void PSMoveInput::daemonize()
         std::freopen("/dev/null", "w", stdout);
         std::freopen("/dev/null", "w", stderr);
     }
-
-    writePidFile();
 }
 
 void PSMoveInput::writePidFile()
 {
-    const char *pidfile = config_.getPidFileName();
+    const char *pidfile = config_->getPidFileName();
     // create file with 0644 permissions
     int fd = creat(pidfile, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
     if (fd == -1)
@@ -292,7 +323,7 @@ void PSMoveInput::writePidFile()
 
 void PSMoveInput::removePidFile()
 {
-    unlink(config_.getPidFileName());
+    unlink(config_->getPidFileName());
 }
 
 void PSMoveInput::initDevice()
@@ -302,15 +333,13 @@ void PSMoveInput::initDevice()
     log_->write("Initializing input device");
     log_->write("Reported keys:");
 
-    for (KeyMapEntry entry : config_.getKeyMap(ControllerId::FIRST))
+    for (const ControllerSettings &settings : config_->getControllerSettings())
     {
-        deviceKeys.push_back(entry.lincode);
-        log_->write(boost::str(boost::format("pscode=%1%, lincode=%2%") % entry.pscode % entry.lincode).c_str());
-    }
-    for (KeyMapEntry entry : config_.getKeyMap(ControllerId::SECOND))
-    {
-        deviceKeys.push_back(entry.lincode);
-        log_->write(boost::str(boost::format("pscode=%1%, lincode=%2%") % entry.pscode % entry.lincode).c_str());
+        for (KeyMapEntry entry : settings.keymap)
+        {
+            deviceKeys.push_back(entry.lincode);
+            log_->write(boost::str(boost::format("pscode=%1%, lincode=%2%") % entry.pscode % entry.lincode).c_str());
+        }
     }
 
     device_ = new InputDevice(INPUT_DEVICE_NAME, deviceKeys, *log_);
@@ -320,43 +349,86 @@ void PSMoveInput::initHandler()
 {
     log_->write("Initializing PSMoveHandler");
 
-    handler_ = new PSMoveHandler(config_.getKeyMap(ControllerId::FIRST),
-                                 config_.getKeyMap(ControllerId::SECOND),
-                                 config_.getMoveCoeffs(),
-                                 config_.getMoveThreshold(),
-                                 config_.getGestureThreshold(),
+    handler_ = new PSMoveHandler(config_->getControllerSettings(),
+                                 config_->getMoveThreshold(),
+                                 config_->getGestureThreshold(),
                                  *log_);
 
-    // connect handler signals to device slots
-    move_signal &moveSignal = handler_->getMoveSignal();
-    key_signal &keySignal = handler_->getKeySignal();
-    mwheel_signal &mwheelSignal = handler_->getMWheelSignal();
-
-    moveSignal.connect(boost::bind(&InputDevice::reportMove, device_, _1, _2));
-    keySignal.connect(boost::bind(&InputDevice::reportKey, device_, _1, _2));
-    mwheelSignal.connect(boost::bind(&InputDevice::reportMWheel, device_, _1));
+    // bind handler outputs to the device
+    handler_->setMoveSlot(move_slot::bind<InputDevice, &InputDevice::reportMove>(device_));
+    handler_->setKeySlot(key_slot::bind<InputDevice, &InputDevice::reportKey>(device_));
+    handler_->setMWheelSlot(mwheel_slot::bind<InputDevice, &InputDevice::reportMWheel>(device_));
 }
 
 void PSMoveInput::startListener()
 {
-    listener_ = new PSMoveListener(*log_,
-                                   config_.getOpMode(),
-                                   config_.getPollTimeout(),
-                                   config_.getConnTimeout(),
-                                   config_.getDisconnectTimeout(),
-                                   config_.getLedTimeout(),
-                                   config_.getGestureTimeout());
-
-    // connect listener signals to handler slots
-    gyro_signal &gyroSignal = listener_->getGyroSignal();
-    gyro_signal &gestureSignal = listener_->getGestureSignal();
-    button_signal &buttonSignal = listener_->getButtonSignal();
-    disconnect_complete_signal &disconnectCompleteSignal = listener_->getDisconnectCompleteSignal();
+    ListenerParams params;
+
+    params.mode = config_->getOpMode();
+    params.pollTimeout = config_->getPollTimeout();
+    params.connectTimeout = config_->getConnTimeout();
+    params.disconnectTimeout = config_->getDisconnectTimeout();
+    params.ledTimeout = config_->getLedTimeout();
+    params.gestureTimeout = config_->getGestureTimeout();
+    params.readMode = config_->getReadMode();
+    params.frameMode = config_->getFrameMode();
+    params.threadModel = config_->getThreadModel();
+    params.outputMode = config_->getOutputMode();
+    params.outputQueueSize = config_->getOutputQueueSize();
+    params.overflowPolicy = config_->getOverflowPolicy();
+    params.controllerSched = config_->getControllerSched();
+    params.outputSched = config_->getOutputSched();
+    params.lockMemory = config_->getLockMemory();
+    for (const ControllerSettings &settings : config_->getControllerSettings())
+    {
+        params.roles.push_back(settings.role);
+    }
+
+    listener_ = new PSMoveListener(*log_, params);
+
+    // bind listener outputs to the handler
+    listener_->setGyroSlot(gyro_slot::bind<PSMoveHandler, &PSMoveHandler::onGyroscope>(handler_));
+    listener_->setGestureSlot(gyro_slot::bind<PSMoveHandler, &PSMoveHandler::onGesture>(handler_));
+    listener_->setButtonSlot(button_slot::bind<PSMoveHandler, &PSMoveHandler::onButtons>(handler_));
 
-    gyroSignal.connect(boost::bind(&PSMoveHandler::onGyroscope, handler_, _1, _2));
-    gestureSignal.connect(boost::bind(&PSMoveHandler::onGesture, handler_, _1, _2));
-    buttonSignal.connect(boost::bind(&PSMoveHandler::onButtons, handler_, _1, _2));
-    disconnectCompleteSignal.connect(boost::bind(&PSMoveHandler::reset, handler_));
+    // events resulting from a single controller report are written to the device at once
+    listener_->setFrameBeginSlot(frame_slot::bind<InputDevice, &InputDevice::beginFrame>(device_));
+    listener_->setFrameEndSlot(frame_slot::bind<InputDevice, &InputDevice::endFrame>(device_));
+
+    // when recording, the recorder takes listener outputs and passes them on
+    if (config_->getRecordFileName()[0] != '\0')
+    {
+        recorder_ = new SampleRecorder(*log_);
+        if (recorder_->open(config_->getRecordFileName()) == true)
+        {
+            recorder_->setGyroSlot(gyro_slot::bind<PSMoveHandler, &PSMoveHandler::onGyroscope>(handler_));
+            recorder_->setGestureSlot(gyro_slot::bind<PSMoveHandler, &PSMoveHandler::onGesture>(handler_));
+            recorder_->setButtonSlot(button_slot::bind<PSMoveHandler, &PSMoveHandler::onButtons>(handler_));
+            recorder_->setFrameBeginSlot(frame_slot::bind<InputDevice, &InputDevice::beginFrame>(device_));
+            recorder_->setFrameEndSlot(frame_slot::bind<InputDevice, &InputDevice::endFrame>(device_));
+
+            listener_->setGyroSlot(gyro_slot::bind<SampleRecorder, &SampleRecorder::onGyroscope>(recorder_));
+            listener_->setGestureSlot(gyro_slot::bind<SampleRecorder, &SampleRecorder::onGesture>(recorder_));
+            listener_->setButtonSlot(button_slot::bind<SampleRecorder, &SampleRecorder::onButtons>(recorder_));
+            listener_->setFrameBeginSlot(frame_slot::bind<SampleRecorder, &SampleRecorder::onFrameBegin>(recorder_));
+            listener_->setFrameEndSlot(frame_slot::bind<SampleRecorder, &SampleRecorder::onFrameEnd>(recorder_));
+            listener_->getDisconnectCompleteSignal().connect(boost::bind(&SampleRecorder::onDisconnect, recorder_, _1));
+        }
+        else
+        {
+            delete recorder_;
+            recorder_ = nullptr;
+        }
+    }
+
+    // signals are handled by the listener thread
+    listener_->setSignalFd(signalFd_);
+    listener_->getUnixSignalSignal().connect(boost::bind(&PSMoveInput::onSignal, this, _1));
+
+    // connect control signals
+    disconnect_complete_signal &disconnectCompleteSignal = listener_->getDisconnectCompleteSignal();
+    void (PSMoveHandler::*resetController)(ControllerId) = &PSMoveHandler::reset;
+    disconnectCompleteSignal.connect(boost::bind(resetController, handler_, _1));
 
     // connect handler's disconnect signal to listener's slot
     disconnect_signal &disconnectSignal = handler_->getDisconnectSignal();
@@ -364,13 +436,53 @@ void PSMoveInput::startListener()
 
     /* NOTE: There are two disconnect signals. One belongs to PSMoveHandler and is used to
        notify PSMoveListener on disconnect button being pressed on one of the controllers.
-       Another is PSMoveListener's "disconnect complete" signal. It is raised when all
-       controller threads are disconnected (as a result of either disconnect key press or
-       expiring disconnect timeout), and PSMoveHandler has to reset its internal state. */
+       Another is PSMoveListener's "disconnect complete" signal. It is raised when a single
+       controller is disconnected (as a result of either disconnect key press or expiring
+       disconnect timeout), and PSMoveHandler has to reset the state of that controller
+       only, the other controllers keep working. */
 
     listener_->run();
 }
 
+void PSMoveInput::replay()
+{
+    // the handler tells the time by the recording rather than by the clock,
+    // so that replaying as fast as possible gives the same results
+    typedef PSMoveHandlerT<ManualClock> ReplayHandler;
+
+    initDevice();
+
+    log_->write("Initializing PSMoveHandler");
+    ReplayHandler handler(config_->getControllerSettings(),
+                          config_->getMoveThreshold(),
+                          config_->getGestureThreshold(),
+                          *log_);
+    handler.setMoveSlot(move_slot::bind<InputDevice, &InputDevice::reportMove>(device_));
+    handler.setKeySlot(key_slot::bind<InputDevice, &InputDevice::reportKey>(device_));
+    handler.setMWheelSlot(mwheel_slot::bind<InputDevice, &InputDevice::reportMWheel>(device_));
+
+    SampleReplay replay(*log_);
+    if (replay.open(config_->getReplayFileName()) == false)
+    {
+        throw Exception(ex_type::REPLAY_FAILED);
+    }
+
+    // the handler and the device are driven by the recording
+    // just the same way they are driven by the listener
+    replay.setGyroSlot(gyro_slot::bind<ReplayHandler, &ReplayHandler::onGyroscope>(&handler));
+    replay.setGestureSlot(gyro_slot::bind<ReplayHandler, &ReplayHandler::onGesture>(&handler));
+    replay.setButtonSlot(button_slot::bind<ReplayHandler, &ReplayHandler::onButtons>(&handler));
+    replay.setFrameBeginSlot(frame_slot::bind<InputDevice, &InputDevice::beginFrame>(device_));
+    replay.setFrameEndSlot(frame_slot::bind<InputDevice, &InputDevice::endFrame>(device_));
+    replay.setTimeSlot(time_slot::bind<ManualClock, &ManualClock::set>(&handler.getClock()));
+    void (ReplayHandler::*resetController)(ControllerId) = &ReplayHandler::reset;
+    replay.getDisconnectCompleteSignal().connect(boost::bind(resetController, &handler, _1));
+    replay.setSignalFd(signalFd_);
+
+    replay.run(config_->getReplayFast() == false);
+    stopComponents();
+}
+
 void PSMoveInput::stop()
 {
     if (listener_ != nullptr)
@@ -379,24 +491,103 @@ void PSMoveInput::stop()
     }
 }
 
+void PSMoveInput::stopComponents()
+{
+    if (listener_ != nullptr)
+    {
+        delete listener_;
+        listener_ = nullptr;
+    }
+    if (recorder_ != nullptr)
+    {
+        delete recorder_;
+        recorder_ = nullptr;
+    }
+    if (handler_ != nullptr)
+    {
+        delete handler_;
+        handler_ = nullptr;
+    }
+    if (device_ != nullptr)
+    {
+        delete device_;
+        device_ = nullptr;
+    }
+}
+
+bool PSMoveInput::reloadConfig()
+{
+    // options are only ever added to a parsed configuration, so parse it anew
+    Config *config = new Config();
+
+    config->parse(argc_, argv_);
+    if (config->isOK() == false)
+    {
+        log_->write("Invalid configuration, keeping the previous one", LogLevel::ERROR);
+        delete config;
+        return false;
+    }
+
+    log_->write("Configuration reloaded; log settings take effect after restart");
+    delete config_;
+    config_ = config;
+    return true;
+}
+
 void PSMoveInput::setupSignals()
 {
-    struct sigaction act;
     sigset_t sigset;
 
-    // set of signals to be blocked during signal handling
+    /* Signals are never delivered asynchronously. They are blocked in every
+       thread, which is why this has to be done before any threads are started,
+       and read from a signal descriptor by the listener thread instead. */
     sigemptyset(&sigset);
     sigaddset(&sigset, SIGINT);
     sigaddset(&sigset, SIGQUIT);
     sigaddset(&sigset, SIGTERM);
+    sigaddset(&sigset, SIGHUP);
+    sigaddset(&sigset, SIGUSR1);
 
-    act.sa_handler = signal_handler;
-    act.sa_mask = sigset;
-    act.sa_flags = 0;
+    if (pthread_sigmask(SIG_BLOCK, &sigset, nullptr) != 0)
+    {
+        return;
+    }
 
-    sigaction(SIGINT, &act, nullptr);
-    sigaction(SIGQUIT, &act, nullptr);
-    sigaction(SIGTERM, &act, nullptr);
+    signalFd_ = signalfd(-1, &sigset, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd_ < 0)
+    {
+        // nobody would ever see them, so let default actions take place
+        pthread_sigmask(SIG_UNBLOCK, &sigset, nullptr);
+    }
+}
+
+void PSMoveInput::onSignal(int sig)
+{
+    switch (sig)
+    {
+        case SIGHUP:
+        {
+            log_->write("SIGHUP received, reloading configuration");
+            reload_ = true;
+            listener_->stop();
+            break;
+        }
+        case SIGUSR1:
+        {
+            listener_->dumpStats();
+            if (device_ != nullptr)
+            {
+                device_->logStats();
+            }
+            break;
+        }
+        default:
+        {
+            log_->write(boost::str(boost::format("Signal %1% received, stopping") % sig).c_str());
+            listener_->stop();
+            break;
+        }
+    }
 }
 
 void PSMoveInput::print_version()
@@ -419,12 +610,4 @@ You should have received a copy of the GNU General Public License\n\
 along with this program.  If not, see <http://www.gnu.org/licenses/>." << std::endl;
 }
 
-// psmoveinput signal handler
-void signal_handler(int sig)
-{
-    PSMoveInput &input = PSMoveInput::getRef();
-    input.stop();
-    PSMoveInput::releaseRef();
-}
-
 } // namespace psmoveinput
@@ -28,6 +28,7 @@
 #include "input_device.hpp"
 #include "psmove_handler.hpp"
 #include "psmove_listener.hpp"
+#include "sample_recorder.hpp"
 #include "except.hpp"
 
 namespace psmoveinput
@@ -54,11 +55,19 @@ public:
     static void releaseRef();
 
 protected:
-    Config config_;
+    Config *config_;
     Log *log_;
     InputDevice *device_;
     PSMoveHandler *handler_;
     PSMoveListener *listener_;
+    // passes listener outputs on to the handler, recording them
+    SampleRecorder *recorder_;
+    // command line is parsed again on configuration reload
+    int argc_;
+    char **argv_;
+    // termination, reload and statistics signals are read from here by the listener
+    int signalFd_;
+    bool reload_;
 
     static PSMoveInput *instance_;
     static int refs_;
@@ -76,7 +85,11 @@ protected:
     void initDevice();
     void initHandler();
     void startListener();
+    void replay();
+    void stopComponents();
+    bool reloadConfig();
     void setupSignals();
+    void onSignal(int sig);
     void print_version();
 
     PSMoveInput(const PSMoveInput &) = delete;
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "sample_recorder.hpp"
+#include <boost/format.hpp>
+#include <boost/thread/locks.hpp>
+#include <cerrno>
+#include <cstring>
+
+namespace psmoveinput
+{
+
+// frame being collected by the current thread, FRAME record goes first
+struct PendingFrame
+{
+    Record records[RECORD_FRAME_SIZE + 1];
+    int count;
+    bool open;
+};
+
+static thread_local PendingFrame pending = {};
+
+static int64_t toNs(const timespec &tp)
+{
+    return tp.tv_sec * 1000000000LL + tp.tv_nsec;
+}
+
+static void startFrame()
+{
+    timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    memset(&pending.records[0], 0, sizeof (Record));
+    pending.records[0].type = static_cast<uint8_t>(RecordType::FRAME);
+    pending.records[0].ns = toNs(now);
+    pending.count = 1;
+    pending.open = true;
+}
+
+SampleRecorder::SampleRecorder(Log &log) :
+    log_(log),
+    file_(nullptr),
+    frames_(0)
+{
+}
+
+SampleRecorder::~SampleRecorder()
+{
+    close();
+}
+
+bool SampleRecorder::open(const std::string &path)
+{
+    close();
+
+    file_ = fopen(path.c_str(), "ab");
+    if (file_ == nullptr)
+    {
+        log_.write(boost::str(boost::format("SampleRecorder: failed to open %1% (%2%)") % path % strerror(errno)).c_str(),
+                   LogLevel::ERROR);
+        return false;
+    }
+
+    // magic only goes to the beginning of a new file
+    fseek(file_, 0, SEEK_END);
+    if ((ftell(file_) == 0) && (fwrite(RECORD_MAGIC, RECORD_MAGIC_SIZE, 1, file_) != 1))
+    {
+        log_.write(boost::str(boost::format("SampleRecorder: failed to write to %1%") % path).c_str(),
+                   LogLevel::ERROR);
+        close();
+        return false;
+    }
+
+    log_.write(boost::str(boost::format("SampleRecorder: recording to %1%") % path).c_str());
+    frames_ = 0;
+    return true;
+}
+
+void SampleRecorder::close()
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (file_ != nullptr)
+    {
+        fclose(file_);
+        file_ = nullptr;
+        log_.write(boost::str(boost::format("SampleRecorder: %1% frames recorded") % frames_).c_str());
+    }
+}
+
+void SampleRecorder::onGyroscope(ControllerId controller, int gx, int gy, const timespec &tp)
+{
+    add(RecordType::GYRO, controller, gx, gy, tp);
+    gyroSlot_(controller, gx, gy, tp);
+}
+
+void SampleRecorder::onGesture(ControllerId controller, int gx, int gy, const timespec &tp)
+{
+    add(RecordType::GESTURE, controller, gx, gy, tp);
+    gestureSlot_(controller, gx, gy, tp);
+}
+
+void SampleRecorder::onButtons(int buttons, ControllerId controller)
+{
+    timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    add(RecordType::BUTTONS, controller, buttons, 0, now);
+    buttonSlot_(buttons, controller);
+}
+
+void SampleRecorder::onFrameBegin()
+{
+    startFrame();
+    frameBeginSlot_();
+}
+
+void SampleRecorder::onFrameEnd()
+{
+    frameEndSlot_();
+
+    // frames with nothing in them are not worth recording
+    if (pending.count > 1)
+    {
+        pending.records[0].count = pending.count - 1;
+        write(pending.records, pending.count);
+    }
+    pending.open = false;
+}
+
+void SampleRecorder::onDisconnect(ControllerId controller)
+{
+    timespec now;
+    Record record;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    memset(&record, 0, sizeof (record));
+    record.type = static_cast<uint8_t>(RecordType::DISCONNECT);
+    record.controller = static_cast<uint8_t>(controllerIndex(controller));
+    record.ns = toNs(now);
+    write(&record, 1);
+}
+
+void SampleRecorder::add(RecordType type, ControllerId controller, int x, int y, const timespec &tp)
+{
+    if (pending.open == false)
+    {
+        // reported outside of a frame, make it a frame of its own
+        startFrame();
+        add(type, controller, x, y, tp);
+        pending.records[0].count = 1;
+        write(pending.records, pending.count);
+        pending.open = false;
+        return;
+    }
+
+    if (pending.count == RECORD_FRAME_SIZE + 1)
+    {
+        // should never happen, but the frame has to be written anyway
+        pending.records[0].count = RECORD_FRAME_SIZE;
+        write(pending.records, pending.count);
+        pending.count = 1;
+    }
+
+    Record &record = pending.records[pending.count++];
+    memset(&record, 0, sizeof (record));
+    record.type = static_cast<uint8_t>(type);
+    record.controller = static_cast<uint8_t>(controllerIndex(controller));
+    record.x = x;
+    record.y = y;
+    record.ns = toNs(tp);
+}
+
+void SampleRecorder::write(const Record *records, int count)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (file_ == nullptr)
+    {
+        return;
+    }
+
+    // stdio buffers the records, so most of the time this is just a copy
+    if (fwrite(records, sizeof (Record), count, file_) != static_cast<size_t>(count))
+    {
+        log_.write("SampleRecorder: failed to write, recording stopped", LogLevel::ERROR);
+        fclose(file_);
+        file_ = nullptr;
+        return;
+    }
+    if (records[0].type == static_cast<uint8_t>(RecordType::FRAME))
+    {
+        frames_++;
+    }
+}
+
+} // namespace psmoveinput
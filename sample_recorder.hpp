@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_SAMPLE_RECORDER_HPP
+#define PSMOVEINPUT_SAMPLE_RECORDER_HPP
+
+#include "log.hpp"
+#include "psmove_listener.hpp"
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace psmoveinput
+{
+
+/* Recording file starts with RECORD_MAGIC followed by a sequence of records.
+   A FRAME record is followed by as many records as its count says, which is
+   everything the listener has handed over for a single controller report.
+   DISCONNECT records stand on their own. Records are stored in host byte
+   order, recordings are not meant to be moved between architectures. */
+#define RECORD_MAGIC        "PSMVREC1"
+#define RECORD_MAGIC_SIZE   8
+// the largest number of records in a single frame
+#define RECORD_FRAME_SIZE   8
+
+enum class RecordType : uint8_t
+{
+    FRAME = 0,
+    GYRO,
+    GESTURE,
+    BUTTONS,
+    DISCONNECT
+};
+
+struct Record
+{
+    uint8_t type;       // RecordType
+    uint8_t controller; // controller index
+    uint16_t count;     // FRAME: number of records in the frame
+    int32_t x;          // GYRO, GESTURE: sensor values; BUTTONS: buttons state
+    int32_t y;
+    uint32_t reserved;
+    int64_t ns;         // CLOCK_MONOTONIC_RAW; sample time for GYRO and GESTURE
+};
+
+// SampleRecorder stands between the listener and the handler, passing
+// everything on unchanged and writing it to a file on the way. Each thread
+// collects its frame separately, so frames of different controllers never
+// get mixed up in the file.
+class SampleRecorder
+{
+public:
+    SampleRecorder(Log &log);
+    virtual ~SampleRecorder();
+
+    // new records are appended to the file if it exists
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() { return (file_ != nullptr); }
+
+    // outputs, the same as the listener's
+    void setGyroSlot(const gyro_slot &slot) { gyroSlot_ = slot; }
+    void setGestureSlot(const gyro_slot &slot) { gestureSlot_ = slot; }
+    void setButtonSlot(const button_slot &slot) { buttonSlot_ = slot; }
+    void setFrameBeginSlot(const frame_slot &slot) { frameBeginSlot_ = slot; }
+    void setFrameEndSlot(const frame_slot &slot) { frameEndSlot_ = slot; }
+
+    // inputs, to be bound to the listener's outputs
+    void onGyroscope(ControllerId controller, int gx, int gy, const timespec &tp);
+    void onGesture(ControllerId controller, int gx, int gy, const timespec &tp);
+    void onButtons(int buttons, ControllerId controller);
+    void onFrameBegin();
+    void onFrameEnd();
+    void onDisconnect(ControllerId controller);
+
+    unsigned long getFrames() { return frames_; }
+
+    SampleRecorder(const SampleRecorder &) = delete;
+    SampleRecorder &operator = (const SampleRecorder &) = delete;
+
+protected:
+    gyro_slot gyroSlot_;
+    gyro_slot gestureSlot_;
+    button_slot buttonSlot_;
+    frame_slot frameBeginSlot_;
+    frame_slot frameEndSlot_;
+    Log &log_;
+    FILE *file_;
+    unsigned long frames_;
+    // protects the file, frames are written by all controller threads
+    boost::mutex mutex_;
+
+    void add(RecordType type, ControllerId controller, int x, int y, const timespec &tp);
+    void write(const Record *records, int count);
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_SAMPLE_RECORDER_HPP
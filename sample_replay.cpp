@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "sample_replay.hpp"
+#include <boost/format.hpp>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+namespace psmoveinput
+{
+
+// signals are checked every that many frames when replaying as fast as possible
+#define REPLAY_SIGNAL_CHECK     1024
+
+static timespec fromNs(long long ns)
+{
+    timespec tp;
+
+    tp.tv_sec = ns / 1000000000LL;
+    tp.tv_nsec = ns % 1000000000LL;
+    return tp;
+}
+
+SampleReplay::SampleReplay(Log &log) :
+    log_(log),
+    file_(nullptr),
+    signalFd_(-1),
+    stop_(false),
+    frames_(0)
+{
+}
+
+SampleReplay::~SampleReplay()
+{
+    close();
+}
+
+bool SampleReplay::open(const std::string &path)
+{
+    char magic[RECORD_MAGIC_SIZE];
+
+    close();
+
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr)
+    {
+        log_.write(boost::str(boost::format("SampleReplay: failed to open %1% (%2%)") % path % strerror(errno)).c_str(),
+                   LogLevel::ERROR);
+        return false;
+    }
+
+    if ((fread(magic, RECORD_MAGIC_SIZE, 1, file_) != 1) ||
+        (memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_SIZE) != 0))
+    {
+        log_.write(boost::str(boost::format("SampleReplay: %1% is not a psmoveinput recording") % path).c_str(),
+                   LogLevel::ERROR);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SampleReplay::close()
+{
+    if (file_ != nullptr)
+    {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool SampleReplay::run(bool realTime)
+{
+    Record records[RECORD_FRAME_SIZE + 1];
+    long long shift = 0;
+    bool first = true;
+
+    if (file_ == nullptr)
+    {
+        return false;
+    }
+
+    stop_ = false;
+    frames_ = 0;
+    log_.write(boost::str(boost::format("SampleReplay: replaying %1%")
+                          % (realTime ? "in real time" : "as fast as possible")).c_str());
+
+    while ((stop_.load() == false) && (fread(&records[0], sizeof (Record), 1, file_) == 1))
+    {
+        RecordType type = static_cast<RecordType>(records[0].type);
+        int count = 0;
+
+        if (type == RecordType::FRAME)
+        {
+            count = records[0].count;
+            if ((count > RECORD_FRAME_SIZE) ||
+                (fread(&records[1], sizeof (Record), count, file_) != static_cast<size_t>(count)))
+            {
+                log_.write("SampleReplay: recording is damaged", LogLevel::ERROR);
+                return false;
+            }
+        }
+        else if (type != RecordType::DISCONNECT)
+        {
+            log_.write("SampleReplay: recording is damaged", LogLevel::ERROR);
+            return false;
+        }
+
+        // recorded time points are moved to the time of replay
+        if (first == true)
+        {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+            shift = timespecDiffNs(now, fromNs(records[0].ns));
+            first = false;
+        }
+
+        if (realTime == true)
+        {
+            if (waitUntil(fromNs(records[0].ns + shift)) == false)
+            {
+                break;
+            }
+        }
+        else if (((frames_ % REPLAY_SIGNAL_CHECK) == 0) && (signalFd_ >= 0))
+        {
+            timespec timeout = {0, 0};
+            if (checkSignals(&timeout) == false)
+            {
+                break;
+            }
+        }
+
+        timeSlot_(fromNs(records[0].ns + shift));
+        if (type == RecordType::FRAME)
+        {
+            emitFrame(records + 1, count, shift);
+            frames_++;
+        }
+        else
+        {
+            disconnectCompleteSignal_(controllerId(records[0].controller));
+        }
+    }
+
+    log_.write(boost::str(boost::format("SampleReplay: %1% frames replayed") % frames_).c_str());
+    return true;
+}
+
+bool SampleReplay::waitUntil(const timespec &tp)
+{
+    while (stop_.load() == false)
+    {
+        timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+        long long left = timespecDiffNs(tp, now);
+        if (left <= 0)
+        {
+            return true;
+        }
+
+        // there is no way to sleep on the raw clock, so sleep relative to it
+        timespec timeout = fromNs(left);
+        if (checkSignals(&timeout) == false)
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool SampleReplay::checkSignals(const timespec *timeout)
+{
+    pollfd pfd;
+
+    pfd.fd = signalFd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int ret = ppoll(&pfd, (signalFd_ >= 0) ? 1 : 0, timeout, nullptr);
+    if ((ret > 0) && ((pfd.revents & POLLIN) != 0))
+    {
+        signalfd_siginfo info;
+        if (read(signalFd_, &info, sizeof (info)) == sizeof (info))
+        {
+            log_.write(boost::str(boost::format("Signal %1% received, stopping replay") % info.ssi_signo).c_str());
+        }
+        stop_ = true;
+        return false;
+    }
+
+    return true;
+}
+
+void SampleReplay::emitFrame(const Record *records, int count, long long shift)
+{
+    frameBeginSlot_();
+
+    for (int i = 0; i < count; i++)
+    {
+        const Record &record = records[i];
+        ControllerId id = controllerId(record.controller);
+
+        switch (static_cast<RecordType>(record.type))
+        {
+            case RecordType::GYRO:
+            {
+                gyroSlot_(id, record.x, record.y, fromNs(record.ns + shift));
+                break;
+            }
+            case RecordType::GESTURE:
+            {
+                gestureSlot_(id, record.x, record.y, fromNs(record.ns + shift));
+                break;
+            }
+            case RecordType::BUTTONS:
+            {
+                buttonSlot_(record.x, id);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    frameEndSlot_();
+}
+
+} // namespace psmoveinput
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_SAMPLE_REPLAY_HPP
+#define PSMOVEINPUT_SAMPLE_REPLAY_HPP
+
+#include "log.hpp"
+#include "psmove_listener.hpp"
+#include "sample_recorder.hpp"
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+namespace psmoveinput
+{
+
+// replay time of the frame, which is about to be fed to the outputs
+typedef StaticSlot<void (const timespec &)> time_slot;
+
+// SampleReplay feeds a file written by SampleRecorder to the same outputs
+// the listener has, so that the handler and the input device see exactly
+// what they saw when the file was recorded, with no controllers connected.
+// Sample timestamps are shifted to the time of replay, intervals between
+// them are kept as recorded.
+class SampleReplay
+{
+public:
+    SampleReplay(Log &log);
+    virtual ~SampleReplay();
+
+    bool open(const std::string &path);
+    void close();
+
+    // outputs, have to be set before run()
+    void setGyroSlot(const gyro_slot &slot) { gyroSlot_ = slot; }
+    void setGestureSlot(const gyro_slot &slot) { gestureSlot_ = slot; }
+    void setButtonSlot(const button_slot &slot) { buttonSlot_ = slot; }
+    void setFrameBeginSlot(const frame_slot &slot) { frameBeginSlot_ = slot; }
+    void setFrameEndSlot(const frame_slot &slot) { frameEndSlot_ = slot; }
+    // lets virtual clocks follow the recording
+    void setTimeSlot(const time_slot &slot) { timeSlot_ = slot; }
+    disconnect_complete_signal &getDisconnectCompleteSignal() { return disconnectCompleteSignal_; }
+    // replay stops once a signal is read from this descriptor
+    void setSignalFd(int fd) { signalFd_ = fd; }
+
+    // replay the whole file keeping recorded intervals between frames,
+    // or as fast as possible if realTime is false;
+    // returns false if the file turns out to be damaged
+    bool run(bool realTime);
+    void stop() { stop_ = true; }
+
+    unsigned long getFrames() { return frames_; }
+
+    SampleReplay(const SampleReplay &) = delete;
+    SampleReplay &operator = (const SampleReplay &) = delete;
+
+protected:
+    gyro_slot gyroSlot_;
+    gyro_slot gestureSlot_;
+    button_slot buttonSlot_;
+    frame_slot frameBeginSlot_;
+    frame_slot frameEndSlot_;
+    time_slot timeSlot_;
+    disconnect_complete_signal disconnectCompleteSignal_;
+    Log &log_;
+    FILE *file_;
+    int signalFd_;
+    std::atomic<bool> stop_;
+    unsigned long frames_;
+
+    // wait until given time point, returns false if interrupted by a signal
+    bool waitUntil(const timespec &tp);
+    bool checkSignals(const timespec *timeout);
+    void emitFrame(const Record *records, int count, long long shift);
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_SAMPLE_REPLAY_HPP
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2012 - 2024 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "sched.hpp"
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace psmoveinput
+{
+
+bool applySchedParams(const SchedParams &params, std::string &error)
+{
+    bool ok = true;
+
+    if (params.cpus.empty() == false)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : params.cpus)
+        {
+            if ((cpu >= 0) && (cpu < CPU_SETSIZE))
+            {
+                CPU_SET(cpu, &set);
+            }
+        }
+
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof (set), &set);
+        if (ret != 0)
+        {
+            error += "CPU affinity: ";
+            error += strerror(ret);
+            ok = false;
+        }
+    }
+
+    if (params.policy != SchedPolicy::OTHER)
+    {
+        int policy = (params.policy == SchedPolicy::FIFO) ? SCHED_FIFO : SCHED_RR;
+        sched_param sp;
+        memset(&sp, 0, sizeof (sp));
+        sp.sched_priority = params.priority;
+        if (sp.sched_priority < sched_get_priority_min(policy))
+        {
+            sp.sched_priority = sched_get_priority_min(policy);
+        }
+        else if (sp.sched_priority > sched_get_priority_max(policy))
+        {
+            sp.sched_priority = sched_get_priority_max(policy);
+        }
+
+        int ret = pthread_setschedparam(pthread_self(), policy, &sp);
+        if (ret != 0)
+        {
+            if (error.empty() == false)
+            {
+                error += ", ";
+            }
+            error += "real-time scheduling: ";
+            error += strerror(ret);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+bool lockMemory(std::string &error)
+{
+    /* Locking future pages makes every new mapping, e.g. stacks of threads
+       started later on, count against the memory lock limit. Once the limit
+       is hit, those mappings fail, so don't lock anything unless the limit
+       cannot get in the way. */
+    rlimit limit;
+    if ((geteuid() != 0) &&
+        ((getrlimit(RLIMIT_MEMLOCK, &limit) != 0) || (limit.rlim_cur != RLIM_INFINITY)))
+    {
+        error = "memory lock limit is too low, run as root or raise RLIMIT_MEMLOCK to unlimited";
+        return false;
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace psmoveinput
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2012 - 2024 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_SCHED_HPP
+#define PSMOVEINPUT_SCHED_HPP
+
+#include "common.hpp"
+#include <string>
+
+namespace psmoveinput
+{
+
+// apply scheduling policy, priority and CPU affinity to the calling thread;
+// whatever cannot be applied (e.g. without CAP_SYS_NICE) is left as it is,
+// false is returned and the problem is described in error
+bool applySchedParams(const SchedParams &params, std::string &error);
+
+// lock all current and future pages of the process in memory, so that
+// input threads never wait for their pages to be brought back;
+// skipped if the process is not allowed to lock as much memory as it needs
+bool lockMemory(std::string &error);
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_SCHED_HPP
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+
+#ifndef PSMOVEINPUT_SPSC_QUEUE_HPP
+#define PSMOVEINPUT_SPSC_QUEUE_HPP
+
+#include "bounded_queue.hpp"
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace psmoveinput
+{
+
+// Wait-free bounded ring for exactly one producer and one consumer thread.
+// Both ends only load the other end's position and store their own, so
+// neither push() nor pop() ever loops or takes a lock. The producer also
+// keeps track of the deepest the ring has been, which tells whether the
+// consumer keeps up.
+template <typename T>
+class SpscQueue
+{
+public:
+    // capacity is rounded up to the next power of two
+    explicit SpscQueue(size_t capacity) :
+        mask_(roundUp(capacity) - 1),
+        items_(new T[mask_ + 1]),
+        head_(0),
+        tail_(0),
+        highWater_(0)
+    {
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // producer side; returns false if the ring is full
+    bool push(const T &value)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t depth = tail - head_.load(std::memory_order_acquire);
+
+        if (depth > mask_)
+        {
+            return false;
+        }
+
+        items_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+
+        if (depth + 1 > highWater_.load(std::memory_order_relaxed))
+        {
+            highWater_.store(depth + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // consumer side; returns false if the ring is empty
+    bool pop(T &value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = items_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate number of queued elements, safe to call from any thread
+    size_t size() const
+    {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return (tail > head) ? (tail - head) : 0;
+    }
+
+    bool empty() const { return (size() == 0); }
+
+    // the largest number of queued elements seen so far
+    size_t getHighWater() const { return highWater_.load(std::memory_order_relaxed); }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator = (const SpscQueue &) = delete;
+
+protected:
+    static size_t roundUp(size_t n)
+    {
+        size_t ret = 2;
+        while (ret < n)
+        {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+    size_t mask_;
+    std::unique_ptr<T[]> items_;
+    // consumer and producer positions live on separate cache lines
+    char pad0_[QUEUE_CACHE_LINE];
+    std::atomic<size_t> head_;
+    char pad1_[QUEUE_CACHE_LINE - sizeof (std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+    std::atomic<size_t> highWater_;
+    char pad2_[QUEUE_CACHE_LINE - 2 * sizeof (std::atomic<size_t>)];
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_SPSC_QUEUE_HPP
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+
+#ifndef PSMOVEINPUT_STATIC_SLOT_HPP
+#define PSMOVEINPUT_STATIC_SLOT_HPP
+
+namespace psmoveinput
+{
+
+template <typename Signature>
+class StaticSlot;
+
+// StaticSlot is a single callback bound to a member function at compile time.
+// Invoking it costs one indirect call to a thunk, which calls the member
+// function directly: there is no locking, no slot list and no type-erased
+// functor, unlike boost::signals2. It is used on the per-sample path from
+// controller threads down to the input device, where the receivers are known
+// at startup. Slots have to be set before the threads invoking them start.
+// An unbound slot does nothing when invoked.
+template <typename... Args>
+class StaticSlot<void (Args...)>
+{
+public:
+    StaticSlot() : obj_(nullptr), fn_(nullptr) {}
+
+    // e.g. move_slot::bind<InputDevice, &InputDevice::reportMove>(device)
+    template <typename T, void (T::*Method)(Args...)>
+    static StaticSlot bind(T *obj)
+    {
+        StaticSlot slot;
+        slot.obj_ = obj;
+        slot.fn_ = &thunk<T, Method>;
+        return slot;
+    }
+
+    void operator ()(Args... args) const
+    {
+        if (fn_ != nullptr)
+        {
+            fn_(obj_, args...);
+        }
+    }
+
+    bool bound() const { return (fn_ != nullptr); }
+
+protected:
+    template <typename T, void (T::*Method)(Args...)>
+    static void thunk(void *obj, Args... args)
+    {
+        (static_cast<T*>(obj)->*Method)(args...);
+    }
+
+    void *obj_;
+    void (*fn_)(void *, Args...);
+};
+
+} // namespace psmoveinput
+
+#endif // PSMOVEINPUT_STATIC_SLOT_HPP
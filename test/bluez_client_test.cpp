@@ -0,0 +1,850 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "bluez_client.hpp"
+#include "gtest/gtest.h"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace bluez_client_test
+{
+
+namespace pi = psmoveinput;
+
+#define CONTROLLER_BTADDR   "00:06:f7:aa:bb:cc"
+#define CONTROLLER_PATH     "dev_00_06_F7_AA_BB_CC"
+#define HCI0_DEVICE         "/org/bluez/hci0/" CONTROLLER_PATH
+#define HCI1_DEVICE         "/org/bluez/hci1/" CONTROLLER_PATH
+
+// the reply timeout of clients under test, BlueZ mock answers right away
+#define REPLY_TIMEOUT       300 // ms
+// mocks give up on reading after that
+#define PEER_TIMEOUT        10  // s
+
+// D-Bus wire protocol, as much as the mocks need
+#define MSG_METHOD_CALL     1
+#define MSG_METHOD_RETURN   2
+#define MSG_ERROR           3
+#define FIELD_PATH          1
+#define FIELD_INTERFACE     2
+#define FIELD_MEMBER        3
+#define FIELD_ERROR_NAME    4
+#define FIELD_REPLY_SERIAL  5
+#define FIELD_DESTINATION   6
+#define FIELD_SENDER        7
+#define FIELD_SIGNATURE     8
+
+static void pad(std::string &buf, size_t alignment)
+{
+    while ((buf.size() % alignment) != 0)
+    {
+        buf.push_back('\0');
+    }
+}
+
+static void putUint32(std::string &buf, uint32_t value)
+{
+    pad(buf, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        buf.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+static uint32_t getUint32(const std::string &buf, size_t offset)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(buf[offset + i])) << (i * 8);
+    }
+    return value;
+}
+
+// message received by a mock
+struct Message
+{
+    int type;
+    int flags;
+    uint32_t serial;
+    uint32_t replySerial;
+    std::string path;
+    std::string interface;
+    std::string member;
+    std::string destination;
+    std::string sender;
+};
+
+// little endian message with header fields holding strings, object paths,
+// signatures or numbers, given as (code, type, value) and body already marshalled
+class MessageBuilder
+{
+public:
+    MessageBuilder(int type, uint32_t serial) : type_(type), serial_(serial) {}
+
+    MessageBuilder &field(char code, char type, const std::string &value)
+    {
+        pad(fields_, 8);
+        fields_.push_back(code);
+        fields_.push_back(1);
+        fields_.push_back(type);
+        fields_.push_back('\0');
+        if (type == 'g')
+        {
+            fields_.push_back(static_cast<char>(value.size()));
+        }
+        else
+        {
+            putUint32(fields_, value.size());
+        }
+        fields_ += value;
+        fields_.push_back('\0');
+        return *this;
+    }
+
+    MessageBuilder &field(char code, uint32_t value)
+    {
+        pad(fields_, 8);
+        fields_.push_back(code);
+        fields_.push_back(1);
+        fields_.push_back('u');
+        fields_.push_back('\0');
+        putUint32(fields_, value);
+        return *this;
+    }
+
+    MessageBuilder &body(const std::string &body)
+    {
+        body_ = body;
+        return *this;
+    }
+
+    std::string build()
+    {
+        std::string msg;
+        msg.push_back('l');
+        msg.push_back(static_cast<char>(type_));
+        msg.push_back(0);
+        msg.push_back(1);
+        putUint32(msg, body_.size());
+        putUint32(msg, serial_);
+        putUint32(msg, fields_.size());
+        msg += fields_;
+        pad(msg, 8);
+        return msg + body_;
+    }
+
+protected:
+    int type_;
+    uint32_t serial_;
+    std::string fields_;
+    std::string body_;
+};
+
+// blocking D-Bus connection of a mock, reading and writing whole messages
+class Peer
+{
+public:
+    Peer() : fd_(-1) {}
+    ~Peer() { close(); }
+
+    bool connect(const std::string &path)
+    {
+        sockaddr_un addr;
+
+        memset(&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof (addr.sun_path) - 1);
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        setTimeout();
+        return ((fd_ >= 0) && (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof (addr)) == 0));
+    }
+
+    void accept(int fd)
+    {
+        fd_ = fd;
+        setTimeout();
+    }
+
+    void close()
+    {
+        if (fd_ >= 0)
+        {
+            ::shutdown(fd_, SHUT_RDWR);
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    // makes a blocking read return
+    void shutdown() { ::shutdown(fd_, SHUT_RDWR); }
+
+    bool write(const std::string &data)
+    {
+        return (send(fd_, data.data(), data.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(data.size()));
+    }
+
+    bool readExact(std::string &buf, size_t len)
+    {
+        buf.clear();
+        while (buf.size() < len)
+        {
+            char data[1024];
+            ssize_t ret = recv(fd_, data, std::min(sizeof (data), len - buf.size()), 0);
+            if (ret <= 0)
+            {
+                return false;
+            }
+            buf.append(data, ret);
+        }
+        return true;
+    }
+
+    bool readLine(std::string &line)
+    {
+        line.clear();
+        while ((line.size() < 2) || (line.compare(line.size() - 2, 2, "\r\n") != 0))
+        {
+            char c;
+            if (recv(fd_, &c, 1, 0) != 1)
+            {
+                return false;
+            }
+            line.push_back(c);
+        }
+        return true;
+    }
+
+    bool read(Message &msg)
+    {
+        std::string header;
+        std::string fields;
+        std::string body;
+
+        if (readExact(header, 16) == false)
+        {
+            return false;
+        }
+        uint32_t bodyLen = getUint32(header, 4);
+        uint32_t fieldsLen = getUint32(header, 12);
+        if ((readExact(fields, (fieldsLen + 7) & ~7) == false) ||
+            (readExact(body, bodyLen) == false))
+        {
+            return false;
+        }
+
+        msg = Message();
+        msg.type = header[1];
+        msg.flags = header[2];
+        msg.serial = getUint32(header, 8);
+        size_t pos = 0;
+        while (pos < fieldsLen)
+        {
+            int code = fields[pos];
+            char type = fields[pos + 2];
+            pos += 4;
+            if (type == 'g')
+            {
+                pos += static_cast<unsigned char>(fields[pos]) + 2;
+            }
+            else if (type == 'u')
+            {
+                if (code == FIELD_REPLY_SERIAL)
+                {
+                    msg.replySerial = getUint32(fields, pos);
+                }
+                pos += 4;
+            }
+            else
+            {
+                uint32_t len = getUint32(fields, pos);
+                std::string value = fields.substr(pos + 4, len);
+                pos += 4 + len + 1;
+                switch (code)
+                {
+                case FIELD_PATH: msg.path = value; break;
+                case FIELD_INTERFACE: msg.interface = value; break;
+                case FIELD_MEMBER: msg.member = value; break;
+                case FIELD_DESTINATION: msg.destination = value; break;
+                case FIELD_SENDER: msg.sender = value; break;
+                }
+            }
+            pos = (pos + 7) & ~7;
+        }
+
+        return true;
+    }
+
+protected:
+    int fd_;
+
+    // a test going wrong must not hang waiting for a message
+    void setTimeout()
+    {
+        timeval tv;
+        tv.tv_sec = PEER_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+    }
+};
+
+// private bus daemon, which clients and mocks connect to
+class BusDaemon
+{
+public:
+    BusDaemon(const std::string &dir) : dir_(dir), pid_(-1) {}
+    ~BusDaemon() { stop(); }
+
+    // false if dbus-daemon is not installed
+    bool start()
+    {
+        std::string config = dir_ + "/bus.conf";
+        std::ofstream out(config);
+        out << "<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\"\n"
+               " \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+               "<busconfig>\n"
+               "  <type>session</type>\n"
+               "  <listen>unix:path=" << getSocket() << "</listen>\n"
+               "  <auth>EXTERNAL</auth>\n"
+               "  <policy context=\"default\">\n"
+               "    <allow send_destination=\"*\"/>\n"
+               "    <allow receive_sender=\"*\"/>\n"
+               "    <allow own=\"*\"/>\n"
+               "  </policy>\n"
+               "</busconfig>\n";
+        out.close();
+
+        unlink(getSocket().c_str());
+        pid_ = fork();
+        if (pid_ == 0)
+        {
+            std::string arg = "--config-file=" + config;
+            // complaints about resource limits it cannot raise are of no interest
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDERR_FILENO);
+            execlp("dbus-daemon", "dbus-daemon", "--nofork", arg.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        for (int i = 0; i < 200; i++)
+        {
+            struct stat st;
+            if (stat(getSocket().c_str(), &st) == 0)
+            {
+                return true;
+            }
+            if (waitpid(pid_, nullptr, WNOHANG) == pid_)
+            {
+                pid_ = -1;
+                return false;
+            }
+            usleep(10000);
+        }
+
+        stop();
+        return false;
+    }
+
+    void stop()
+    {
+        if (pid_ > 0)
+        {
+            kill(pid_, SIGTERM);
+            waitpid(pid_, nullptr, 0);
+            pid_ = -1;
+        }
+    }
+
+    std::string getSocket() { return dir_ + "/bus"; }
+    std::string getAddress() { return "unix:path=" + getSocket(); }
+
+protected:
+    std::string dir_;
+    pid_t pid_;
+};
+
+// org.bluez on a private bus: devices it knows about are disconnected,
+// calls on other object paths are answered with an error
+class MockBluez
+{
+public:
+    MockBluez() : serial_(0), silent_(false), thread_(nullptr) {}
+
+    ~MockBluez()
+    {
+        if (thread_ != nullptr)
+        {
+            peer_.shutdown();
+            thread_->join();
+            delete thread_;
+        }
+    }
+
+    void addDevice(const std::string &path) { devices_.push_back(path); }
+    // calls are never answered
+    void setSilent() { silent_ = true; }
+
+    // connect to the bus and own the name
+    bool start(BusDaemon &bus)
+    {
+        std::string line;
+
+        if ((peer_.connect(bus.getSocket()) == false) ||
+            (peer_.write(std::string("\0AUTH EXTERNAL 30\r\n", 19)) == false) ||
+            (peer_.readLine(line) == false) || (line.compare(0, 3, "OK ") != 0) ||
+            (peer_.write("BEGIN\r\n") == false))
+        {
+            return false;
+        }
+
+        // the uid sent above is "0", the bus refuses it unless we are root
+        if (call("/org/freedesktop/DBus", "Hello", "") == false)
+        {
+            return false;
+        }
+
+        // RequestName("org.bluez", DBUS_NAME_FLAG_DO_NOT_QUEUE)
+        std::string body;
+        putUint32(body, 9);
+        body += "org.bluez";
+        body.push_back('\0');
+        putUint32(body, 4);
+        if (call("/org/freedesktop/DBus", "RequestName", body) == false)
+        {
+            return false;
+        }
+
+        thread_ = new boost::thread(boost::ref(*this));
+        return true;
+    }
+
+    std::vector<Message> getCalls(unsigned int count)
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                if (calls_.size() >= count)
+                {
+                    return calls_;
+                }
+            }
+            usleep(10000);
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        return calls_;
+    }
+
+    void operator ()()
+    {
+        Message msg;
+
+        while (peer_.read(msg) == true)
+        {
+            if ((msg.type != MSG_METHOD_CALL) || (msg.interface != "org.bluez.Device1"))
+            {
+                continue;
+            }
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                calls_.push_back(msg);
+            }
+            if (silent_ == true)
+            {
+                continue;
+            }
+
+            MessageBuilder reply(MSG_METHOD_RETURN, ++serial_);
+            if (std::find(devices_.begin(), devices_.end(), msg.path) == devices_.end())
+            {
+                reply = MessageBuilder(MSG_ERROR, serial_);
+                reply.field(FIELD_ERROR_NAME, 's', "org.freedesktop.DBus.Error.UnknownObject");
+            }
+            reply.field(FIELD_REPLY_SERIAL, msg.serial).field(FIELD_DESTINATION, 's', msg.sender);
+            peer_.write(reply.build());
+        }
+    }
+
+protected:
+    Peer peer_;
+    uint32_t serial_;
+    bool silent_;
+    std::vector<std::string> devices_;
+    boost::thread *thread_;
+    boost::mutex mutex_;
+    std::vector<Message> calls_;
+
+    // method call to the bus, waits for the reply
+    bool call(const std::string &path, const std::string &member, const std::string &body)
+    {
+        MessageBuilder builder(MSG_METHOD_CALL, ++serial_);
+        builder.field(FIELD_PATH, 'o', path)
+               .field(FIELD_INTERFACE, 's', "org.freedesktop.DBus")
+               .field(FIELD_MEMBER, 's', member)
+               .field(FIELD_DESTINATION, 's', "org.freedesktop.DBus");
+        if (body.empty() == false)
+        {
+            builder.field(FIELD_SIGNATURE, 'g', "su").body(body);
+        }
+        if (peer_.write(builder.build()) == false)
+        {
+            return false;
+        }
+
+        Message msg;
+        while (peer_.read(msg) == true)
+        {
+            if (msg.replySerial == serial_)
+            {
+                return (msg.type == MSG_METHOD_RETURN);
+            }
+        }
+        return false;
+    }
+};
+
+// not a bus at all: says hello, then answers every call with a message
+// whose header lies about the lengths of its fields
+class BrokenBus
+{
+public:
+    BrokenBus(const std::string &path) : thread_(nullptr)
+    {
+        sockaddr_un addr;
+
+        memset(&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof (addr.sun_path) - 1);
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof (addr));
+        listen(fd_, 2);
+        thread_ = new boost::thread(boost::ref(*this));
+    }
+
+    ~BrokenBus()
+    {
+        shutdown(fd_, SHUT_RDWR);
+        thread_->join();
+        delete thread_;
+        close(fd_);
+    }
+
+    void operator ()()
+    {
+        // the client connects again once it has given up on the first connection
+        for (int i = 0; i < 2; i++)
+        {
+            Peer peer;
+            std::string line;
+            Message msg;
+
+            int client = accept(fd_, nullptr, nullptr);
+            if (client < 0)
+            {
+                return;
+            }
+            peer.accept(client);
+            if ((peer.readExact(line, 1) == false) || (peer.readLine(line) == false))
+            {
+                continue;
+            }
+            peer.write("OK 0123456789abcdef0123456789abcdef\r\n");
+            if ((peer.readLine(line) == false) || (peer.read(msg) == false))
+            {
+                continue;
+            }
+            peer.write(MessageBuilder(MSG_METHOD_RETURN, 1).field(FIELD_REPLY_SERIAL, msg.serial).build());
+
+            while (peer.read(msg) == true)
+            {
+                // the string is said to be much longer than the fields
+                std::string reply = MessageBuilder(MSG_METHOD_RETURN, 2)
+                                    .field(FIELD_REPLY_SERIAL, msg.serial)
+                                    .field(FIELD_DESTINATION, 's', ":1.1")
+                                    .build();
+                // length of the destination string
+                reply[28] = '\xF0';
+                reply[29] = '\xFF';
+                reply[30] = '\xFF';
+                reply[31] = '\x7F';
+                peer.write(reply);
+            }
+        }
+    }
+
+protected:
+    int fd_;
+    boost::thread *thread_;
+};
+
+// collects the addresses handed over to the fallback
+class Fallback
+{
+public:
+    void operator ()(const std::string &btaddr)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        calls_.push_back(btaddr);
+    }
+
+    std::vector<std::string> wait(unsigned int count, int timeout)
+    {
+        for (int elapsed = 0; elapsed < timeout; elapsed += 10)
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                if (calls_.size() >= count)
+                {
+                    break;
+                }
+            }
+            usleep(10000);
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        return calls_;
+    }
+
+protected:
+    boost::mutex mutex_;
+    std::vector<std::string> calls_;
+};
+
+class BluezClientTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        char dir[] = "/tmp/psmoveinput-bluez-XXXXXX";
+        ASSERT_TRUE(mkdtemp(dir) != nullptr);
+        root_ = dir;
+
+        // two adapters
+        mkdir((root_ + "/class").c_str(), 0755);
+        mkdir((root_ + "/class/bluetooth").c_str(), 0755);
+        mkdir((root_ + "/class/bluetooth/hci0").c_str(), 0755);
+        mkdir((root_ + "/class/bluetooth/hci1").c_str(), 0755);
+
+        bus_ = new BusDaemon(root_);
+    }
+
+    virtual void TearDown()
+    {
+        delete bus_;
+        std::string cmd = "rm -rf " + root_;
+        system(cmd.c_str());
+    }
+
+protected:
+    std::string root_;
+    BusDaemon *bus_;
+    Fallback fallback_;
+
+    // the controller is connected to hci1
+    void addConnection()
+    {
+        std::string dir = root_ + "/class/bluetooth/hci1:11";
+        mkdir(dir.c_str(), 0755);
+        dir += "/0005:054C:03D5.0001";
+        mkdir(dir.c_str(), 0755);
+        std::ofstream uevent(dir + "/uevent");
+        uevent << "DRIVER=sony\nHID_ID=0005:0000054C:000003D5\nHID_UNIQ=" CONTROLLER_BTADDR "\n";
+    }
+
+    bool startBus()
+    {
+        if (bus_->start() == false)
+        {
+            std::cout << "[ SKIPPED  ] dbus-daemon is not available" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void setFallback(pi::BluezClient &client)
+    {
+        client.setFallback(boost::ref(fallback_));
+    }
+};
+
+// the call is made on the adapter the controller is connected to, and BlueZ answers it
+TEST_F(BluezClientTest, Disconnect)
+{
+    if (startBus() == false)
+    {
+        return;
+    }
+    MockBluez bluez;
+    bluez.addDevice(HCI1_DEVICE);
+    ASSERT_EQ(true, bluez.start(*bus_));
+    addConnection();
+
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+    ASSERT_EQ(true, client.open(bus_->getAddress()));
+    ASSERT_EQ(true, client.isOpen());
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+
+    std::vector<Message> calls = bluez.getCalls(1);
+    ASSERT_EQ(1, calls.size());
+    ASSERT_EQ(HCI1_DEVICE, calls[0].path);
+    // a reply is expected
+    ASSERT_EQ(0, calls[0].flags);
+    ASSERT_EQ("org.bluez.Device1", calls[0].interface);
+    ASSERT_EQ("Disconnect", calls[0].member);
+    ASSERT_EQ("org.bluez", calls[0].destination);
+    ASSERT_EQ(0, fallback_.wait(1, 2 * REPLY_TIMEOUT).size());
+
+    client.close();
+    ASSERT_EQ(false, client.isOpen());
+    ASSERT_EQ(false, client.disconnect(CONTROLLER_BTADDR));
+}
+
+// without a connection in sysfs adapters are tried in turn until one of them succeeds
+TEST_F(BluezClientTest, UnknownAdapter)
+{
+    if (startBus() == false)
+    {
+        return;
+    }
+    MockBluez bluez;
+    bluez.addDevice(HCI1_DEVICE);
+    ASSERT_EQ(true, bluez.start(*bus_));
+
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+    ASSERT_EQ(true, client.open(bus_->getAddress()));
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+
+    std::vector<Message> calls = bluez.getCalls(2);
+    ASSERT_EQ(2, calls.size());
+    ASSERT_EQ(HCI0_DEVICE, calls[0].path);
+    ASSERT_EQ(HCI1_DEVICE, calls[1].path);
+    ASSERT_EQ(0, fallback_.wait(1, 2 * REPLY_TIMEOUT).size());
+}
+
+// BlueZ failing to disconnect the controller leaves it to the fallback
+TEST_F(BluezClientTest, ErrorFallsBack)
+{
+    if (startBus() == false)
+    {
+        return;
+    }
+    MockBluez bluez;
+    ASSERT_EQ(true, bluez.start(*bus_));
+    addConnection();
+
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+    ASSERT_EQ(true, client.open(bus_->getAddress()));
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+
+    std::vector<std::string> fallbacks = fallback_.wait(1, 2000);
+    ASSERT_EQ(1, fallbacks.size());
+    ASSERT_EQ(CONTROLLER_BTADDR, fallbacks[0]);
+    ASSERT_EQ(1, bluez.getCalls(1).size());
+}
+
+// so does BlueZ not answering in time
+TEST_F(BluezClientTest, TimeoutFallsBack)
+{
+    if (startBus() == false)
+    {
+        return;
+    }
+    MockBluez bluez;
+    bluez.addDevice(HCI1_DEVICE);
+    bluez.setSilent();
+    ASSERT_EQ(true, bluez.start(*bus_));
+    addConnection();
+
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+    ASSERT_EQ(true, client.open(bus_->getAddress()));
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+    ASSERT_EQ(1, bluez.getCalls(1).size());
+    ASSERT_EQ(1, fallback_.wait(1, 4 * REPLY_TIMEOUT).size());
+}
+
+// the bus restarted since the client has connected to it is connected to again
+TEST_F(BluezClientTest, Reconnect)
+{
+    if (startBus() == false)
+    {
+        return;
+    }
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+    ASSERT_EQ(true, client.open(bus_->getAddress()));
+
+    bus_->stop();
+    ASSERT_EQ(true, bus_->start());
+    MockBluez bluez;
+    bluez.addDevice(HCI1_DEVICE);
+    ASSERT_EQ(true, bluez.start(*bus_));
+    addConnection();
+
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+    ASSERT_EQ(1, bluez.getCalls(1).size());
+    ASSERT_EQ(0, fallback_.wait(1, 2 * REPLY_TIMEOUT).size());
+}
+
+// without the bus everything goes to the fallback
+TEST_F(BluezClientTest, NoBus)
+{
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+
+    ASSERT_EQ(false, client.open("unix:path=" + root_ + "/nobus"));
+    ASSERT_EQ(true, client.isOpen());
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+    ASSERT_EQ(1, fallback_.wait(1, 2000).size());
+    ASSERT_EQ(false, client.open("tcp:host=localhost,port=0"));
+}
+
+// malformed replies neither crash the client nor make it read past the data received
+TEST_F(BluezClientTest, BrokenReply)
+{
+    BrokenBus bus(root_ + "/bus");
+    pi::BluezClient client(root_, REPLY_TIMEOUT);
+    setFallback(client);
+
+    ASSERT_EQ(true, client.open("unix:path=" + root_ + "/bus"));
+    ASSERT_EQ(true, client.disconnect(CONTROLLER_BTADDR));
+    ASSERT_EQ(1, fallback_.wait(1, 4000).size());
+    client.close();
+}
+
+} // namespace bluez_client_test
@@ -66,6 +66,9 @@ TEST(ConfigTest, CommandLine)
     ASSERT_STREQ("/var/log/testlog", config.getLogFileName());
     ASSERT_EQ(psmoveinput::OpMode::CLIENT, config.getOpMode());
     ASSERT_EQ(true, config.getForeground());
+    ASSERT_STREQ("", config.getRecordFileName());
+    ASSERT_STREQ("", config.getReplayFileName());
+    ASSERT_EQ(false, config.getReplayFast());
 
     // mess up command line a bit
     psmoveinput::Config invalid_config;
@@ -82,7 +85,7 @@ TEST(ConfigTest, CommandLine)
 
 TEST(ConfigTest, LongOptions)
 {
-    const char *argv[12];
+    const char *argv[17];
     psmoveinput::Config config;
     std::string config_name = TEST_CONFIG_PATH;
     config_name += "test_config.conf";
@@ -106,8 +109,14 @@ TEST(ConfigTest, LongOptions)
     // log file location
     argv[10] = "--logfile";
     argv[11] = "/var/log/testlog";
-
-    config.parse(12, const_cast<char**>(argv));
+    // sample recording and replay
+    argv[12] = "--record";
+    argv[13] = "/tmp/record.bin";
+    argv[14] = "--replay";
+    argv[15] = "/tmp/replay.bin";
+    argv[16] = "--replay-fast";
+
+    config.parse(17, const_cast<char**>(argv));
     ASSERT_EQ(true, config.isOK());
     ASSERT_STREQ("/var/run/testpidfile", config.getPidFileName());
     ASSERT_STREQ(config_name.c_str(), config.getConfigFileName());
@@ -115,6 +124,9 @@ TEST(ConfigTest, LongOptions)
     ASSERT_STREQ("/var/log/testlog", config.getLogFileName());
     ASSERT_EQ(psmoveinput::OpMode::CLIENT, config.getOpMode());
     ASSERT_EQ(true, config.getForeground());
+    ASSERT_STREQ("/tmp/record.bin", config.getRecordFileName());
+    ASSERT_STREQ("/tmp/replay.bin", config.getReplayFileName());
+    ASSERT_EQ(true, config.getReplayFast());
 }
 
 TEST(ConfigTest, CorrectConfig)
@@ -144,10 +156,38 @@ TEST(ConfigTest, CorrectConfig)
     // check operation mode
     ASSERT_EQ(psmoveinput::OpMode::CLIENT, config.getOpMode());
 
+    // check controller read mode
+    ASSERT_EQ(psmoveinput::ReadMode::POLL, config.getReadMode());
+
+    // check sensor frame mode
+    ASSERT_EQ(psmoveinput::FrameMode::BOTH_HALVES, config.getFrameMode());
+
+    // check thread model
+    ASSERT_EQ(psmoveinput::ThreadModel::REACTOR, config.getThreadModel());
+
+    // check output pipeline settings
+    ASSERT_EQ(psmoveinput::OutputMode::PIPELINE, config.getOutputMode());
+    ASSERT_EQ(64, config.getOutputQueueSize());
+    ASSERT_EQ(psmoveinput::OverflowPolicy::BLOCK, config.getOverflowPolicy());
+
+    // check scheduling settings; invalid CPU list is ignored,
+    // log writer never gets real-time priority
+    psmoveinput::SchedParams sched = config.getControllerSched();
+    ASSERT_EQ(psmoveinput::SchedPolicy::FIFO, sched.policy);
+    ASSERT_EQ(40, sched.priority);
+    ASSERT_EQ(std::vector<int>({1, 3, 4}), sched.cpus);
+    sched = config.getOutputSched();
+    ASSERT_EQ(psmoveinput::SchedPolicy::FIFO, sched.policy);
+    ASSERT_EQ(std::vector<int>({2}), sched.cpus);
+    sched = config.getLogSched();
+    ASSERT_EQ(psmoveinput::SchedPolicy::OTHER, sched.policy);
+    ASSERT_EQ(0, sched.cpus.size());
+    ASSERT_EQ(true, config.getLockMemory());
+
     // check timeouts
     ASSERT_EQ(100, config.getPollTimeout());
     ASSERT_EQ(500, config.getConnTimeout());
-    ASSERT_EQ(20, config.getDisconnectTimeout());
+    ASSERT_EQ(250, config.getDisconnectTimeout());
     ASSERT_EQ(1000, config.getLedTimeout());
     ASSERT_EQ(300, config.getGestureTimeout());
 
@@ -239,6 +279,43 @@ TEST(ConfigTest, CorrectConfig)
             ASSERT_TRUE(false);
         }
     }
+
+    // controller pool
+    ASSERT_EQ(4, config.getControllerCount());
+    ASSERT_EQ(4, config.getControllerSettings().size());
+    ASSERT_EQ(psmoveinput::ControllerRole::POINTER, config.getRole(psmoveinput::ControllerId::FIRST));
+    ASSERT_EQ(psmoveinput::ControllerRole::GESTURE, config.getRole(psmoveinput::ControllerId::SECOND));
+    ASSERT_EQ(psmoveinput::ControllerRole::POINTER, config.getRole(psmoveinput::controllerId(2)));
+    ASSERT_EQ(psmoveinput::ControllerRole::KEYS, config.getRole(psmoveinput::controllerId(3)));
+    // coefficients not set for a controller are taken from MOVE_COEFF_X/Y
+    coeffs = config.getMoveCoeffs(psmoveinput::controllerId(2));
+    ASSERT_EQ(0.5, coeffs.cx);
+    ASSERT_EQ(1.5, coeffs.cy);
+    coeffs = config.getMoveCoeffs(psmoveinput::controllerId(3));
+    ASSERT_EQ(1, coeffs.cx);
+    ASSERT_EQ(1.5, coeffs.cy);
+    psmoveinput::key_map keymap3 = config.getKeyMap(psmoveinput::controllerId(2));
+    ASSERT_EQ(1, keymap3.size());
+    ASSERT_EQ(Btn_CROSS, keymap3[0].pscode);
+    ASSERT_EQ(KEY_A, keymap3[0].lincode);
+    psmoveinput::key_map keymap4 = config.getKeyMap(psmoveinput::controllerId(3));
+    ASSERT_EQ(2, keymap4.size());
+    for (psmoveinput::KeyMapEntry entry : keymap4)
+    {
+        if (entry.pscode == Btn_T)
+        {
+            ASSERT_EQ(KEY_B, entry.lincode);
+        }
+        else if (entry.pscode == BTN_GESTURE_UP)
+        {
+            ASSERT_EQ(KEY_C, entry.lincode);
+        }
+        else
+        {
+            ASSERT_TRUE(false);
+        }
+    }
+    ASSERT_EQ(0, config.getKeyMap(psmoveinput::controllerId(4)).size());
 }
 
 TEST(ConfigTest, IncorrectConfig)
@@ -273,6 +350,22 @@ TEST(ConfigTest, DoubleSettings)
     ASSERT_EQ(false, config.isOK());
 }
 
+TEST(ConfigTest, ZeroTimeout)
+{
+    const char *argv[3];
+    psmoveinput::Config config;
+    std::string temp;
+
+    argv[0] = "test";
+    argv[1] = "-c";
+    temp = TEST_CONFIG_PATH;
+    temp += "zero_timeout.conf";
+    argv[2] = temp.c_str();
+
+    config.parse(3, const_cast<char**>(argv));
+    ASSERT_EQ(false, config.isOK());
+}
+
 TEST(ConfigTest, TildeExpansion)
 {
     const char *argv[5];
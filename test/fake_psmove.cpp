@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "fake_psmove.hpp"
+#include "common.hpp"
+#include <psmoveapi/psmove.h>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// an open connection to a simulated controller
+struct _PSMove
+{
+    int index;
+    // connections opened before the controller went away stay dead
+    unsigned int generation;
+    // values of the report returned by the last psmove_poll()
+    int gx;
+    int gz;
+    unsigned int buttons;
+};
+
+namespace fake_psmove
+{
+
+namespace pi = psmoveinput;
+
+struct Controller
+{
+    ControllerParams params;
+    ControllerStats stats;
+    bool present;
+    unsigned int generation;
+    // connections open at the moment
+    int handles;
+    // reports sent but not read yet
+    int backlog;
+    // the time reports have been produced up to
+    timespec produced;
+    // nothing is sent until then
+    timespec stalledUntil;
+};
+
+static boost::mutex mutex;
+static std::vector<Controller> controllers;
+
+static void now(timespec &tp)
+{
+    clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+}
+
+// let the controller send everything it would have sent by now
+static void advance(Controller &controller)
+{
+    timespec tp;
+    long long period = 1000000000LL / controller.params.rate;
+
+    now(tp);
+    if (pi::timespecDiffNs(tp, controller.stalledUntil) < 0)
+    {
+        controller.produced = tp;
+        return;
+    }
+    if (pi::timespecDiffNs(controller.stalledUntil, controller.produced) > 0)
+    {
+        controller.produced = controller.stalledUntil;
+    }
+
+    long long count = pi::timespecDiffNs(tp, controller.produced) / period;
+    if (count <= 0)
+    {
+        return;
+    }
+
+    controller.produced = pi::timespecAddNs(controller.produced, count * period);
+    controller.stats.sent += count;
+    controller.backlog += count;
+    if (controller.backlog > FAKE_PSMOVE_BACKLOG)
+    {
+        controller.stats.lost += controller.backlog - FAKE_PSMOVE_BACKLOG;
+        controller.backlog = FAKE_PSMOVE_BACKLOG;
+    }
+}
+
+// contents of report number seq of controller index
+static void makeReport(const Controller &controller, int index, unsigned long seq, PSMove *move)
+{
+    const ControllerParams &params = controller.params;
+
+    switch (params.motion)
+    {
+        case Motion::CONSTANT:
+        {
+            move->gx = params.amplitude;
+            move->gz = params.amplitude;
+            break;
+        }
+        case Motion::CIRCLE:
+        {
+            double angle = 2.0 * M_PI * static_cast<double>(seq % params.rate) / params.rate;
+            move->gx = static_cast<int>(params.amplitude * cos(angle));
+            move->gz = static_cast<int>(params.amplitude * sin(angle));
+            break;
+        }
+        case Motion::RANDOM:
+        {
+            // hash of the report number, so every run sees the same motion
+            unsigned long long x = (seq + 1) * 0x9e3779b97f4a7c15ULL + index;
+            x ^= x >> 31;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            int range = 2 * params.amplitude + 1;
+            move->gx = static_cast<int>(x % range) - params.amplitude;
+            move->gz = static_cast<int>((x >> 32) % range) - params.amplitude;
+            break;
+        }
+        default:
+        {
+            move->gx = 0;
+            move->gz = 0;
+            break;
+        }
+    }
+
+    move->buttons = 0;
+    if ((params.buttonPeriod > 0) && (((seq / params.buttonPeriod) % 2) == 1))
+    {
+        move->buttons = Btn_CROSS;
+    }
+}
+
+// the controller behind an open connection, nullptr if it has gone
+static Controller *find(PSMove *move)
+{
+    if ((move == nullptr) || (move->index >= static_cast<int>(controllers.size())))
+    {
+        return nullptr;
+    }
+
+    Controller &controller = controllers[move->index];
+    if ((controller.present == false) || (controller.generation != move->generation))
+    {
+        return nullptr;
+    }
+
+    return &controller;
+}
+
+void reset()
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    controllers.clear();
+}
+
+int addController(const ControllerParams &params)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    Controller controller;
+
+    memset(&controller, 0, sizeof (controller));
+    controller.params = params;
+    if ((controller.params.rate <= 0) || (controller.params.rate > FAKE_PSMOVE_MAX_RATE))
+    {
+        controller.params.rate = FAKE_PSMOVE_MAX_RATE;
+    }
+    controller.present = true;
+    now(controller.produced);
+    controllers.push_back(controller);
+
+    return controllers.size() - 1;
+}
+
+void disconnect(int index)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    Controller &controller = controllers.at(index);
+
+    controller.present = false;
+    controller.generation++;
+    controller.handles = 0;
+    controller.backlog = 0;
+}
+
+void reconnect(int index)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    Controller &controller = controllers.at(index);
+
+    controller.present = true;
+    controller.backlog = 0;
+    now(controller.produced);
+}
+
+void stall(int index, int ms)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    Controller &controller = controllers.at(index);
+    timespec tp;
+
+    advance(controller);
+    now(tp);
+    controller.stalledUntil = pi::timespecAddNs(tp, ms * 1000000LL);
+}
+
+ControllerStats getStats(int index)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    return controllers.at(index).stats;
+}
+
+std::string getSerial(int index)
+{
+    char serial[32];
+
+    snprintf(serial, sizeof (serial), "00:00:00:00:00:%02x", index);
+    return serial;
+}
+
+} // namespace fake_psmove
+
+using namespace fake_psmove;
+
+// psmoveapi functions called by psmoveinput
+
+void psmove_set_remote_config(enum PSMove_RemoteConfig)
+{
+}
+
+int psmove_count_connected(void)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    int count = 0;
+
+    for (const Controller &controller : controllers)
+    {
+        if (controller.present == true)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// like psmoveapi does, ids are given to controllers present at the moment in order
+PSMove *psmove_connect_by_id(int id)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    for (unsigned int i = 0; i < controllers.size(); i++)
+    {
+        Controller &controller = controllers[i];
+        if ((controller.present == true) && (id-- == 0))
+        {
+            PSMove *move = new PSMove();
+            move->index = i;
+            move->generation = controller.generation;
+            controller.stats.connections++;
+            // reports sent while nobody was listening are gone
+            if (controller.handles == 0)
+            {
+                controller.backlog = 0;
+                now(controller.produced);
+            }
+            controller.handles++;
+            return move;
+        }
+    }
+
+    return nullptr;
+}
+
+enum PSMove_Connection_Type psmove_connection_type(PSMove *move)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    if (move->index < static_cast<int>(controllers.size()))
+    {
+        return (controllers[move->index].params.usb == true) ? Conn_USB : Conn_Bluetooth;
+    }
+
+    return Conn_Unknown;
+}
+
+char *psmove_get_serial(PSMove *move)
+{
+    // the caller frees it
+    return strdup(fake_psmove::getSerial(move->index).c_str());
+}
+
+void psmove_disconnect(PSMove *move)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    Controller *controller = find(move);
+
+    if ((controller != nullptr) && (controller->handles > 0))
+    {
+        controller->handles--;
+    }
+    delete move;
+}
+
+enum PSMove_Bool psmove_has_calibration(PSMove *)
+{
+    return PSMove_False;
+}
+
+int psmove_poll(PSMove *move)
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    Controller *controller = find(move);
+
+    if (controller == nullptr)
+    {
+        return 0;
+    }
+
+    advance(*controller);
+    if (controller->backlog == 0)
+    {
+        return 0;
+    }
+
+    // the oldest report kept is returned
+    unsigned long seq = controller->stats.sent - controller->backlog;
+    controller->backlog--;
+    controller->stats.read++;
+    makeReport(*controller, move->index, seq, move);
+
+    return 1;
+}
+
+unsigned int psmove_get_buttons(PSMove *move)
+{
+    return move->buttons;
+}
+
+void psmove_get_gyroscope(PSMove *move, int *gx, int *gy, int *gz)
+{
+    *gx = move->gx;
+    *gy = 0;
+    *gz = move->gz;
+}
+
+void psmove_get_gyroscope_frame(PSMove *move, enum PSMove_Frame, float *gx, float *gy, float *gz)
+{
+    *gx = static_cast<float>(move->gx);
+    *gy = 0.0f;
+    *gz = static_cast<float>(move->gz);
+}
+
+// both halves of a simulated report are the same
+void psmove_get_half_frame(PSMove *move, enum PSMove_Sensor, enum PSMove_Frame, int *gx, int *gy, int *gz)
+{
+    psmove_get_gyroscope(move, gx, gy, gz);
+}
+
+void psmove_set_leds(PSMove *, unsigned char, unsigned char, unsigned char)
+{
+}
+
+enum PSMove_Update_Result psmove_update_leds(PSMove *)
+{
+    return Update_Success;
+}
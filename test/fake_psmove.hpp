@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef PSMOVEINPUT_FAKE_PSMOVE_HPP
+#define PSMOVEINPUT_FAKE_PSMOVE_HPP
+
+#include <string>
+
+// fake_psmove.cpp implements the part of psmoveapi used by psmoveinput with
+// simulated controllers. It is linked instead of psmoveapi, so the listener
+// runs unchanged with no hardware attached. Controllers send reports at
+// their own rate regardless of whether anybody reads them; like hidraw,
+// only the most recent FAKE_PSMOVE_BACKLOG reports are kept.
+
+namespace fake_psmove
+{
+
+#define FAKE_PSMOVE_MAX_RATE    1000
+#define FAKE_PSMOVE_BACKLOG     64
+
+enum class Motion : unsigned char
+{
+    STILL = 0,      // gyroscope reports zeros
+    CONSTANT,       // gyroscope reports amplitude on x and z axes
+    CIRCLE,         // sine and cosine with period of one second
+    RANDOM          // pseudo-random values within amplitude, the same every run
+};
+
+struct ControllerParams
+{
+    int rate;           // reports per second, up to FAKE_PSMOVE_MAX_RATE
+    Motion motion;
+    int amplitude;
+    // Btn_CROSS is held for that many reports, then released for as many;
+    // never pressed if 0
+    int buttonPeriod;
+    bool usb;           // connected via USB, i.e. ignored by psmoveinput
+};
+
+struct ControllerStats
+{
+    unsigned long sent;     // reports produced by the controller
+    unsigned long read;     // reports returned by psmove_poll()
+    unsigned long lost;     // reports dropped from the full backlog
+    int connections;        // times psmove_connect_by_id() opened it
+};
+
+// forget all controllers
+void reset();
+// add a controller, which becomes visible to psmove_count_connected() right
+// away; its serial number is 00:00:00:00:00:<index in hex>; returns the index
+int addController(const ControllerParams &params);
+// the controller goes away; open handles see no more reports
+void disconnect(int index);
+// the controller comes back with the same serial number
+void reconnect(int index);
+// the controller sends nothing for given number of milliseconds,
+// then carries on as if nothing has happened
+void stall(int index, int ms);
+ControllerStats getStats(int index);
+std::string getSerial(int index);
+
+} // namespace fake_psmove
+
+#endif // PSMOVEINPUT_FAKE_PSMOVE_HPP
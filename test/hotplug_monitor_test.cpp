@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "hotplug_monitor.hpp"
+#include "gtest/gtest.h"
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace hotplug_monitor_test
+{
+
+namespace pi = psmoveinput;
+
+#define BT_DEVPATH  "/devices/bt/0005:054C:03D5.0001/hidraw/hidraw3"
+#define USB_DEVPATH "/devices/usb/0003:054C:03D5.0002/hidraw/hidraw4"
+#define KBD_DEVPATH "/devices/usb/0003:046D:C31C.0003/hidraw/hidraw5"
+
+class HotplugMonitorTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        char dir[] = "/tmp/psmoveinput-sysfs-XXXXXX";
+        ASSERT_TRUE(mkdtemp(dir) != nullptr);
+        root_ = dir;
+
+        addDevice(BT_DEVPATH, "HID_ID=0005:0000054C:000003D5\nHID_UNIQ=00:06:F7:AA:BB:CC\n");
+        addDevice(USB_DEVPATH, "HID_ID=0003:0000054C:000003D5\nHID_UNIQ=\n");
+        addDevice(KBD_DEVPATH, "HID_ID=0003:0000046D:0000C31C\n");
+        monitor_ = new pi::HotplugMonitor(root_);
+    }
+
+    virtual void TearDown()
+    {
+        delete monitor_;
+        std::string cmd = "rm -rf " + root_;
+        system(cmd.c_str());
+    }
+
+protected:
+    std::string root_;
+    pi::HotplugMonitor *monitor_;
+
+    void addDevice(const std::string &devpath, const char *uevent)
+    {
+        std::string path = root_;
+        std::string dir = devpath + "/device";
+        size_t pos = 0;
+
+        while (pos != std::string::npos)
+        {
+            pos = dir.find('/', pos + 1);
+            path = root_ + dir.substr(0, pos);
+            mkdir(path.c_str(), 0755);
+        }
+        std::ofstream file(path + "/uevent");
+        file << uevent;
+    }
+
+    // message in the format sent by the kernel
+    std::string kernelMessage(const std::string &action, const std::string &devpath)
+    {
+        std::string msg = action + "@" + devpath;
+        msg.push_back('\0');
+        addProperty(msg, "ACTION=" + action);
+        addProperty(msg, "DEVPATH=" + devpath);
+        addProperty(msg, "SUBSYSTEM=hidraw");
+        addProperty(msg, "DEVNAME=" + devpath.substr(devpath.rfind('/') + 1));
+        return msg;
+    }
+
+    void addProperty(std::string &msg, const std::string &prop)
+    {
+        msg += prop;
+        msg.push_back('\0');
+    }
+};
+
+TEST_F(HotplugMonitorTest, KernelEvents)
+{
+    pi::HotplugMonitor::Event event;
+    std::string msg;
+
+    msg = kernelMessage("add", BT_DEVPATH);
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::ADD, event.action);
+    ASSERT_EQ("/dev/hidraw3", event.device);
+    ASSERT_EQ("00:06:f7:aa:bb:cc", event.uniq);
+    ASSERT_EQ(true, event.bluetooth);
+
+    msg = kernelMessage("add", USB_DEVPATH);
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::ADD, event.action);
+    ASSERT_EQ(false, event.bluetooth);
+
+    // other HID devices are of no interest
+    msg = kernelMessage("add", KBD_DEVPATH);
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::NONE, event.action);
+
+    // removal is recognized even though sysfs entry is already gone
+    std::string cmd = "rm -rf " + root_ + "/devices/bt";
+    system(cmd.c_str());
+    msg = kernelMessage("remove", BT_DEVPATH);
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::REMOVE, event.action);
+    ASSERT_EQ("00:06:f7:aa:bb:cc", event.uniq);
+    ASSERT_EQ(true, event.bluetooth);
+
+    // unknown and already removed devices
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::NONE, event.action);
+    msg = kernelMessage("remove", KBD_DEVPATH);
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::NONE, event.action);
+
+    // garbage
+    msg = "garbage";
+    ASSERT_EQ(false, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::NONE, event.action);
+}
+
+TEST_F(HotplugMonitorTest, UdevEvents)
+{
+    pi::HotplugMonitor::Event event;
+    std::string props;
+    unsigned int header[10];
+
+    addProperty(props, "ACTION=add");
+    addProperty(props, "DEVPATH=" BT_DEVPATH);
+    addProperty(props, "SUBSYSTEM=hidraw");
+    addProperty(props, "DEVNAME=/dev/hidraw3");
+
+    // udev header: prefix, magic, header size, properties offset and length, filters
+    memset(header, 0, sizeof (header));
+    memcpy(header, "libudev", 8);
+    header[2] = htonl(0xfeedcafe);
+    header[3] = sizeof (header);
+    header[4] = sizeof (header);
+    header[5] = props.size();
+    std::string msg(reinterpret_cast<char*>(header), sizeof (header));
+    msg += props;
+
+    ASSERT_EQ(true, monitor_->parse(msg.data(), msg.size(), event));
+    ASSERT_EQ(pi::HotplugMonitor::Action::ADD, event.action);
+    ASSERT_EQ("/dev/hidraw3", event.device);
+    ASSERT_EQ("00:06:f7:aa:bb:cc", event.uniq);
+
+    // properties beyond the end of the message
+    header[5] = props.size() + 1;
+    msg.replace(0, sizeof (header), reinterpret_cast<char*>(header), sizeof (header));
+    ASSERT_EQ(false, monitor_->parse(msg.data(), msg.size(), event));
+}
+
+} // namespace hotplug_monitor_test
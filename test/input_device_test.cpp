@@ -25,6 +25,7 @@
 #include "gtest/gtest.h"
 #include <boost/thread/thread.hpp>
 #include <fcntl.h>
+#include <unistd.h>
 #include <iostream>
 #include <cstdio>
 
@@ -359,4 +360,106 @@ TEST_F(InputDeviceTest, MWheel)
     ASSERT_EQ(-1, event->value);
 }
 
+TEST_F(InputDeviceTest, Frame)
+{
+    event_vector *events;
+
+    // empty frame does not produce any events
+    input_device_->beginFrame();
+    input_device_->endFrame();
+    boost::this_thread::sleep(boost::posix_time::millisec(100));
+    events = dev_listener_->getAllEvents();
+    ASSERT_EQ(0, events->size());
+    delete events;
+
+    // events reported within a frame are not sent until the frame ends,
+    // motion along the same axis is summed up
+    input_device_->beginFrame();
+    input_device_->reportMove(3, 0);
+    input_device_->reportMove(4, -2);
+    input_device_->reportKey(KEY_A, true);
+    input_device_->reportMWheel(1);
+    boost::this_thread::sleep(boost::posix_time::millisec(100));
+    events = dev_listener_->getAllEvents();
+    ASSERT_EQ(0, events->size());
+    delete events;
+
+    input_device_->endFrame();
+    boost::this_thread::sleep(boost::posix_time::millisec(100));
+    events = dev_listener_->getAllEvents();
+    ASSERT_EQ(4, events->size());
+    ASSERT_EQ(EV_REL, (*events)[0]->type);
+    ASSERT_EQ(REL_X, (*events)[0]->code);
+    ASSERT_EQ(7, (*events)[0]->value);
+    ASSERT_EQ(EV_REL, (*events)[1]->type);
+    ASSERT_EQ(REL_Y, (*events)[1]->code);
+    ASSERT_EQ(-2, (*events)[1]->value);
+    ASSERT_EQ(EV_KEY, (*events)[2]->type);
+    ASSERT_EQ(KEY_A, (*events)[2]->code);
+    ASSERT_EQ(1, (*events)[2]->value);
+    ASSERT_EQ(EV_REL, (*events)[3]->type);
+    ASSERT_EQ(REL_WHEEL, (*events)[3]->code);
+    ASSERT_EQ(1, (*events)[3]->value);
+    delete events;
+
+    // press and release of the same key within a frame are both delivered
+    input_device_->beginFrame();
+    input_device_->reportKey(KEY_B, true);
+    input_device_->reportKey(KEY_B, false);
+    input_device_->endFrame();
+    boost::this_thread::sleep(boost::posix_time::millisec(100));
+    events = dev_listener_->getAllEvents();
+    ASSERT_EQ(6, events->size());
+    ASSERT_EQ(KEY_B, (*events)[4]->code);
+    ASSERT_EQ(1, (*events)[4]->value);
+    ASSERT_EQ(KEY_B, (*events)[5]->code);
+    ASSERT_EQ(0, (*events)[5]->value);
+    delete events;
+}
+
+// frames written to a plain descriptor need no uinput at all
+TEST(FdInputDeviceTest, Frame)
+{
+    psmoveinput::Log log(psmoveinput::LogParams("dummylog", psmoveinput::LogLevel::INFO));
+    input_event events[8];
+    int fds[2];
+
+    ASSERT_EQ(0, pipe(fds));
+    {
+        psmoveinput::InputDevice device("testinput", fds[1], log);
+
+        device.beginFrame();
+        device.reportMove(3, -2);
+        device.reportKey(KEY_A, true);
+        device.endFrame();
+        // outside of a frame every event is a frame of its own
+        device.reportKey(KEY_A, false);
+    }
+
+    // the device closes its end of the pipe
+    ASSERT_EQ(static_cast<ssize_t>(6 * sizeof (input_event)), read(fds[0], events, sizeof (events)));
+    close(fds[0]);
+    ASSERT_EQ(REL_X, events[0].code);
+    ASSERT_EQ(3, events[0].value);
+    ASSERT_EQ(REL_Y, events[1].code);
+    ASSERT_EQ(-2, events[1].value);
+    ASSERT_EQ(KEY_A, events[2].code);
+    ASSERT_EQ(1, events[2].value);
+    ASSERT_EQ(EV_SYN, events[3].type);
+    ASSERT_EQ(KEY_A, events[4].code);
+    ASSERT_EQ(0, events[4].value);
+    ASSERT_EQ(EV_SYN, events[5].type);
+}
+
+// frames the descriptor does not take are counted
+TEST(FdInputDeviceTest, Dropped)
+{
+    psmoveinput::Log log(psmoveinput::LogParams("dummylog", psmoveinput::LogLevel::INFO));
+    psmoveinput::InputDevice device("testinput", open("/dev/null", O_RDONLY), log);
+
+    device.reportMove(1, 1);
+    device.reportKey(KEY_A, true);
+    ASSERT_EQ(2UL, device.getDroppedFrames());
+}
+
 } // namespace psmoveinput_test
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "latency_histogram.hpp"
+#include "gtest/gtest.h"
+#include <boost/thread/thread.hpp>
+
+namespace psmoveinput_test
+{
+
+namespace pi = psmoveinput;
+
+TEST(LatencyHistogram, Percentiles)
+{
+    pi::LatencyHistogram histogram;
+
+    ASSERT_EQ(0, histogram.getCount());
+    ASSERT_EQ(0, histogram.getPercentile(0.5));
+
+    // small values are counted exactly
+    for (int i = 1; i <= 50; i++)
+    {
+        histogram.record(i);
+    }
+    ASSERT_EQ(50, histogram.getCount());
+    ASSERT_EQ(25, histogram.getPercentile(0.5));
+    ASSERT_EQ(50, histogram.getPercentile(1.0));
+    ASSERT_EQ(50, histogram.getMax());
+
+    // large ones are within bucket precision
+    histogram.reset();
+    for (int i = 0; i < 990; i++)
+    {
+        histogram.record(1000000);
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        histogram.record(20000000);
+    }
+    unsigned long long p50 = histogram.getPercentile(0.5);
+    ASSERT_GE(p50, 1000000);
+    ASSERT_LE(p50, 1000000 + 1000000 / LATENCY_SUB_COUNT);
+    ASSERT_LE(histogram.getPercentile(0.99), 1000000 + 1000000 / LATENCY_SUB_COUNT);
+    ASSERT_EQ(20000000, histogram.getPercentile(0.999));
+    ASSERT_EQ(20000000, histogram.getMax());
+
+    // out of range values do not break anything
+    histogram.record(-1);
+    histogram.record(1LL << 62);
+    ASSERT_EQ(1002, histogram.getCount());
+    ASSERT_EQ(1ULL << 62, histogram.getMax());
+    ASSERT_EQ(0, histogram.getPercentile(0.0));
+}
+
+static void record(pi::LatencyHistogram *histogram, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        histogram->record(i % 1000);
+    }
+}
+
+TEST(LatencyHistogram, Threads)
+{
+    pi::LatencyHistogram histogram;
+    boost::thread t1(record, &histogram, 100000);
+    boost::thread t2(record, &histogram, 100000);
+
+    t1.join();
+    t2.join();
+    ASSERT_EQ(200000, histogram.getCount());
+    ASSERT_EQ(999, histogram.getMax());
+}
+
+} // namespace psmoveinput_test
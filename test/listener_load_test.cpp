@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "psmove_listener.hpp"
+#include "fake_psmove.hpp"
+#include "gtest/gtest.h"
+#include <boost/bind/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <iostream>
+
+using namespace boost::placeholders;
+
+namespace listener_load_test
+{
+
+namespace pi = psmoveinput;
+namespace fake = fake_psmove;
+
+// amplitude of the constant motion of simulated controllers
+#define LOAD_AMPLITUDE      100
+#define LOAD_BUTTON_PERIOD  50
+
+// counts everything the listener hands over, per controller
+class LoadSink
+{
+public:
+    LoadSink()
+    {
+        for (int i = 0; i < MAX_CONTROLLERS; i++)
+        {
+            samples_[i] = 0;
+            sumX_[i] = 0;
+            buttons_[i] = 0;
+            disconnects_[i] = 0;
+        }
+    }
+
+    void onGyroscope(pi::ControllerId controller, int gx, int, const timespec &)
+    {
+        int index = pi::controllerIndex(controller);
+        samples_[index]++;
+        sumX_[index] += gx;
+    }
+
+    void onButtons(int, pi::ControllerId controller)
+    {
+        buttons_[pi::controllerIndex(controller)]++;
+    }
+
+    void onFrame() {}
+
+    void onDisconnect(pi::ControllerId controller)
+    {
+        disconnects_[pi::controllerIndex(controller)]++;
+    }
+
+    std::atomic<unsigned long> samples_[MAX_CONTROLLERS];
+    std::atomic<long long> sumX_[MAX_CONTROLLERS];
+    std::atomic<unsigned long> buttons_[MAX_CONTROLLERS];
+    std::atomic<int> disconnects_[MAX_CONTROLLERS];
+};
+
+class ListenerLoadTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        fake::reset();
+        log_ = new pi::Log(pi::LogParams("dummylog", pi::LogLevel::INFO));
+        listener_ = nullptr;
+        thread_ = nullptr;
+    }
+
+    virtual void TearDown()
+    {
+        stop();
+        delete log_;
+        fake::reset();
+    }
+
+protected:
+    pi::Log *log_;
+    pi::PSMoveListener *listener_;
+    boost::thread *thread_;
+    LoadSink sink_;
+
+    // add count controllers moving at constant speed and start the listener
+    // with as many slots; remote controllers are looked for every 20 ms
+    void start(pi::ThreadModel threadModel, int count, int rate, int disconnectTimeout)
+    {
+        pi::ListenerParams params;
+        fake::ControllerParams controller = {rate, fake::Motion::CONSTANT, LOAD_AMPLITUDE, LOAD_BUTTON_PERIOD, false};
+
+        for (int i = 0; i < count; i++)
+        {
+            fake::addController(controller);
+        }
+
+        params.mode = pi::OpMode::CLIENT;
+        params.pollTimeout = 2;
+        params.connectTimeout = 20;
+        params.disconnectTimeout = disconnectTimeout;
+        params.ledTimeout = 4000;
+        params.gestureTimeout = 100;
+        params.readMode = pi::ReadMode::POLL;
+        params.frameMode = pi::FrameMode::SECOND_HALF;
+        params.threadModel = threadModel;
+        params.outputMode = pi::OutputMode::DIRECT;
+        params.outputQueueSize = 256;
+        params.overflowPolicy = pi::OverflowPolicy::DROP;
+        params.controllerSched.policy = pi::SchedPolicy::OTHER;
+        params.controllerSched.priority = 0;
+        params.outputSched = params.controllerSched;
+        params.lockMemory = false;
+        params.roles.assign(count, pi::ControllerRole::POINTER);
+
+        listener_ = new pi::PSMoveListener(*log_, params);
+        listener_->setGyroSlot(pi::gyro_slot::bind<LoadSink, &LoadSink::onGyroscope>(&sink_));
+        listener_->setButtonSlot(pi::button_slot::bind<LoadSink, &LoadSink::onButtons>(&sink_));
+        listener_->setFrameBeginSlot(pi::frame_slot::bind<LoadSink, &LoadSink::onFrame>(&sink_));
+        listener_->setFrameEndSlot(pi::frame_slot::bind<LoadSink, &LoadSink::onFrame>(&sink_));
+        listener_->getDisconnectCompleteSignal().connect(boost::bind(&LoadSink::onDisconnect, &sink_, _1));
+        thread_ = new boost::thread(&pi::PSMoveListener::run, listener_);
+    }
+
+    void stop()
+    {
+        if (thread_ != nullptr)
+        {
+            listener_->stop();
+            thread_->join();
+            delete thread_;
+            thread_ = nullptr;
+        }
+        delete listener_;
+        listener_ = nullptr;
+    }
+
+    // wait up to timeout ms for the condition to come true
+    bool waitFor(const boost::function<bool ()> &condition, int timeout)
+    {
+        for (int elapsed = 0; elapsed < timeout; elapsed += 5)
+        {
+            if (condition() == true)
+            {
+                return true;
+            }
+            boost::this_thread::sleep(boost::posix_time::millisec(5));
+        }
+
+        return condition();
+    }
+
+    bool samplesFlowing(int index)
+    {
+        unsigned long samples = sink_.samples_[index];
+        return waitFor([this, index, samples]() { return sink_.samples_[index] > samples + 10; }, 2000);
+    }
+
+    // every report read has reached the sink, and not too many have been lost
+    void checkThroughput(pi::ThreadModel threadModel, int count, int duration)
+    {
+        start(threadModel, count, FAKE_PSMOVE_MAX_RATE, 500);
+        for (int i = 0; i < count; i++)
+        {
+            ASSERT_TRUE(samplesFlowing(i));
+        }
+        unsigned long before = 0;
+        for (int i = 0; i < count; i++)
+        {
+            before += sink_.samples_[i];
+        }
+        boost::this_thread::sleep(boost::posix_time::millisec(duration));
+        stop();
+
+        unsigned long total = 0;
+        for (int i = 0; i < count; i++)
+        {
+            fake::ControllerStats stats = fake::getStats(i);
+
+            EXPECT_EQ(stats.read, sink_.samples_[i].load());
+            EXPECT_EQ(-LOAD_AMPLITUDE * static_cast<long long>(stats.read), sink_.sumX_[i].load());
+            // Btn_CROSS changes state every LOAD_BUTTON_PERIOD reports
+            EXPECT_NEAR(stats.read / LOAD_BUTTON_PERIOD, static_cast<double>(sink_.buttons_[i].load()), 2);
+            // controllers run at 1 kHz, loaded CI machines are given a lot of slack
+            EXPECT_GT(stats.read, static_cast<unsigned long>(duration / 2));
+            EXPECT_LE(stats.lost, stats.sent / 10);
+            EXPECT_EQ(0, sink_.disconnects_[i].load());
+            total += stats.read;
+        }
+        std::cout << "[ LOAD     ] " << count << " controllers, " << (total - before) * 1000 / duration
+                  << " samples/s" << std::endl;
+    }
+};
+
+TEST_F(ListenerLoadTest, ThroughputPerController)
+{
+    checkThroughput(pi::ThreadModel::PER_CONTROLLER, 8, 1000);
+}
+
+TEST_F(ListenerLoadTest, ThroughputReactor)
+{
+    checkThroughput(pi::ThreadModel::REACTOR, 8, 1000);
+}
+
+TEST_F(ListenerLoadTest, ThroughputAllSlots)
+{
+    checkThroughput(pi::ThreadModel::REACTOR, MAX_CONTROLLERS, 1000);
+}
+
+// controller going away is noticed by the watchdog, the others are not
+// affected, and the controller takes its slot back once it returns
+TEST_F(ListenerLoadTest, DisconnectReconnect)
+{
+    for (pi::ThreadModel threadModel : {pi::ThreadModel::PER_CONTROLLER, pi::ThreadModel::REACTOR})
+    {
+        start(threadModel, 2, FAKE_PSMOVE_MAX_RATE, 100);
+        ASSERT_TRUE(samplesFlowing(0));
+        ASSERT_TRUE(samplesFlowing(1));
+
+        fake::disconnect(0);
+        ASSERT_TRUE(waitFor([this]() { return sink_.disconnects_[0] == 1; }, 2000));
+        EXPECT_EQ(0, sink_.disconnects_[1].load());
+        EXPECT_TRUE(samplesFlowing(1));
+
+        fake::reconnect(0);
+        EXPECT_TRUE(samplesFlowing(0));
+        EXPECT_TRUE(samplesFlowing(1));
+        EXPECT_EQ(0, sink_.disconnects_[1].load());
+
+        stop();
+        fake::reset();
+        sink_.disconnects_[0] = 0;
+    }
+}
+
+// short stall is within the watchdog timeout, so the controller is kept
+TEST_F(ListenerLoadTest, ShortStall)
+{
+    start(pi::ThreadModel::PER_CONTROLLER, 1, FAKE_PSMOVE_MAX_RATE, 300);
+    ASSERT_TRUE(samplesFlowing(0));
+
+    fake::stall(0, 100);
+    boost::this_thread::sleep(boost::posix_time::millisec(150));
+    EXPECT_TRUE(samplesFlowing(0));
+    EXPECT_EQ(0, sink_.disconnects_[0].load());
+    EXPECT_EQ(1, fake::getStats(0).connections);
+}
+
+// long stall makes the watchdog drop the controller, which is
+// connected again as soon as it sends something
+TEST_F(ListenerLoadTest, LongStall)
+{
+    start(pi::ThreadModel::REACTOR, 1, FAKE_PSMOVE_MAX_RATE, 100);
+    ASSERT_TRUE(samplesFlowing(0));
+
+    fake::stall(0, 400);
+    ASSERT_TRUE(waitFor([this]() { return sink_.disconnects_[0] == 1; }, 2000));
+    EXPECT_TRUE(samplesFlowing(0));
+    EXPECT_GE(fake::getStats(0).connections, 2);
+}
+
+// reports the listener does not read in time are lost, not queued forever
+TEST_F(ListenerLoadTest, Backlog)
+{
+    fake::ControllerParams params = {FAKE_PSMOVE_MAX_RATE, fake::Motion::STILL, 0, 0, false};
+    int index = fake::addController(params);
+    PSMove *move = psmove_connect_by_id(0);
+    int count = 0;
+
+    ASSERT_TRUE(move != nullptr);
+    boost::this_thread::sleep(boost::posix_time::millisec(200));
+    while (psmove_poll(move))
+    {
+        count++;
+    }
+    psmove_disconnect(move);
+
+    fake::ControllerStats stats = fake::getStats(index);
+    // a report or two may arrive while the backlog is being read
+    EXPECT_NEAR(FAKE_PSMOVE_BACKLOG, count, 2);
+    EXPECT_EQ(stats.sent, stats.read + stats.lost);
+    EXPECT_GT(stats.lost, 0UL);
+}
+
+// controllers connected via USB are never picked up
+TEST_F(ListenerLoadTest, UsbIgnored)
+{
+    fake::ControllerParams params = {FAKE_PSMOVE_MAX_RATE, fake::Motion::CONSTANT, LOAD_AMPLITUDE, 0, true};
+    fake::addController(params);
+    start(pi::ThreadModel::REACTOR, 1, FAKE_PSMOVE_MAX_RATE, 100);
+
+    // the Bluetooth one takes the only slot, the USB one is looked at once
+    ASSERT_TRUE(samplesFlowing(0));
+    boost::this_thread::sleep(boost::posix_time::millisec(100));
+    EXPECT_EQ(0UL, fake::getStats(0).read);
+    EXPECT_EQ(1, fake::getStats(0).connections);
+}
+
+// the USB controller stays known as ineligible while a Bluetooth one comes
+// and goes, so it is not opened again
+TEST_F(ListenerLoadTest, UsbCachedAcrossReconnect)
+{
+    fake::ControllerParams params = {FAKE_PSMOVE_MAX_RATE, fake::Motion::CONSTANT, LOAD_AMPLITUDE, 0, true};
+    fake::addController(params);
+    start(pi::ThreadModel::REACTOR, 1, FAKE_PSMOVE_MAX_RATE, 100);
+    ASSERT_TRUE(samplesFlowing(0));
+    EXPECT_EQ(1, fake::getStats(0).connections);
+
+    for (int i = 1; i <= 2; i++)
+    {
+        fake::disconnect(1);
+        ASSERT_TRUE(waitFor([this, i]() { return sink_.disconnects_[0] == i; }, 2000));
+        // the listener keeps looking for controllers meanwhile
+        boost::this_thread::sleep(boost::posix_time::millisec(100));
+        fake::reconnect(1);
+        EXPECT_TRUE(samplesFlowing(0));
+    }
+
+    EXPECT_EQ(1, fake::getStats(0).connections);
+    EXPECT_EQ(0UL, fake::getStats(0).read);
+    EXPECT_EQ(3, fake::getStats(1).connections);
+}
+
+} // namespace listener_load_test
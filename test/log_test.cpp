@@ -21,7 +21,13 @@
 
 
 #include "log.hpp"
+#include "file_log.hpp"
 #include "gtest/gtest.h"
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
 
 namespace psmoveinput_test
 {
@@ -33,7 +39,7 @@ class TestLogBackend : public pi::LogBackend
 public:
     TestLogBackend() {}
     virtual void init(const pi::LogParams &params) { params_ = params; }
-    virtual void write(const char *msg) { lastmsg_ = msg; }
+    virtual void write(const char *msg, pi::LogLevel) { lastmsg_ = msg; }
 
     std::string getLastMessage() { return lastmsg_; }
     pi::LogParams &getParams() { return params_; }
@@ -114,4 +120,202 @@ TEST(Log, WriteInfo)
     ASSERT_STREQ("informational message", backend->getLastMessage().c_str());
 }
 
+static int evaluations = 0;
+
+static const char *buildMessage(const char *msg)
+{
+    evaluations++;
+    return msg;
+}
+
+TEST(Log, LazyWrite)
+{
+    TestLogBackend *backend = new TestLogBackend();
+    pi::LogParams initParams{std::string("testfile"), pi::LogLevel::ERROR};
+    pi::Log log(initParams);
+
+    // nothing gets written without backends
+    ASSERT_FALSE(log.enabled(pi::LogLevel::FATAL));
+
+    log.addBackend(backend);
+    ASSERT_TRUE(log.enabled(pi::LogLevel::FATAL));
+    ASSERT_TRUE(log.enabled(pi::LogLevel::ERROR));
+    ASSERT_FALSE(log.enabled(pi::LogLevel::INFO));
+
+    // messages of enabled levels are built and written
+    evaluations = 0;
+    LOG_WRITE(log, pi::LogLevel::ERROR, buildMessage("error message"));
+    ASSERT_EQ(1, evaluations);
+    ASSERT_STREQ("error message", backend->getLastMessage().c_str());
+
+    // filtered out messages are not even built
+    LOG_WRITE(log, pi::LogLevel::INFO, buildMessage("informational message"));
+    ASSERT_EQ(1, evaluations);
+    ASSERT_STREQ("error message", backend->getLastMessage().c_str());
+}
+
+static std::vector<std::string> readLines(const char *filename)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(filename);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+TEST(FileLog, AsyncWrite)
+{
+    const char *filename = "/tmp/psmoveinput_filelog_test.log";
+    std::remove(filename);
+
+    {
+        pi::Log log(pi::LogParams(filename, pi::LogLevel::INFO));
+        log.addBackend(new pi::FileLog());
+
+        log.write("first message");
+        log.write("second message", pi::LogLevel::ERROR);
+        // fatal message forces everything written so far to reach the file
+        log.write("fatal message", pi::LogLevel::FATAL);
+
+        std::vector<std::string> lines = readLines(filename);
+        ASSERT_EQ(3, lines.size());
+        // each line starts with a timestamp
+        ASSERT_NE(std::string::npos, lines[0].find(": first message"));
+        ASSERT_NE(std::string::npos, lines[1].find(": second message"));
+        ASSERT_NE(std::string::npos, lines[2].find(": fatal message"));
+
+        // long messages are truncated to the record size
+        std::string longmsg(LOG_RECORD_SIZE * 2, 'x');
+        log.write(longmsg.c_str());
+    }
+
+    // destroying the log writes out the rest of the queue
+    std::vector<std::string> lines = readLines(filename);
+    ASSERT_EQ(4, lines.size());
+    ASSERT_NE(std::string::npos, lines[3].find(std::string(LOG_RECORD_SIZE - 1, 'x')));
+    ASSERT_EQ(std::string::npos, lines[3].find(std::string(LOG_RECORD_SIZE, 'x')));
+
+    std::remove(filename);
+}
+
+#define NUM_LOG_THREADS 4
+#define NUM_LOG_MESSAGES 20000
+
+TEST(FileLog, Overflow)
+{
+    const char *filename = "/tmp/psmoveinput_filelog_overflow.log";
+    std::remove(filename);
+    unsigned long dropped = 0;
+
+    {
+        pi::FileLog *backend = new pi::FileLog(16);
+        pi::Log log(pi::LogParams(filename, pi::LogLevel::INFO));
+        log.addBackend(backend);
+
+        // flood a tiny queue from several threads; writers never block,
+        // so some messages get dropped, but each one is accounted for
+        boost::thread *threads[NUM_LOG_THREADS];
+        for (int i = 0; i < NUM_LOG_THREADS; i++)
+        {
+            threads[i] = new boost::thread([&log]()
+            {
+                for (int j = 0; j < NUM_LOG_MESSAGES; j++)
+                {
+                    log.write("message");
+                }
+            });
+        }
+        for (int i = 0; i < NUM_LOG_THREADS; i++)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        backend->flush();
+        dropped = backend->getDropped();
+    }
+
+    unsigned long written = 0;
+    unsigned long reported = 0;
+    for (const std::string &line : readLines(filename))
+    {
+        unsigned long count = 0;
+        if (line.find(": message") != std::string::npos)
+        {
+            written++;
+        }
+        else if (std::sscanf(line.c_str(), "%*d.%*d: %lu log messages dropped", &count) == 1)
+        {
+            reported += count;
+        }
+    }
+
+    ASSERT_EQ(NUM_LOG_THREADS * NUM_LOG_MESSAGES, written + dropped);
+    ASSERT_EQ(dropped, reported);
+
+    std::remove(filename);
+}
+
+#define NUM_FATAL_MESSAGES 100
+
+TEST(FileLog, FatalNotDropped)
+{
+    const char *filename = "/tmp/psmoveinput_filelog_fatal.log";
+    std::remove(filename);
+    unsigned long dropped = 0;
+
+    {
+        pi::FileLog *backend = new pi::FileLog(16);
+        pi::Log log(pi::LogParams(filename, pi::LogLevel::INFO));
+        log.addBackend(backend);
+
+        // keep the tiny queue full while fatal messages are logged
+        std::atomic<bool> stop(false);
+        boost::thread *threads[NUM_LOG_THREADS];
+        for (int i = 0; i < NUM_LOG_THREADS; i++)
+        {
+            threads[i] = new boost::thread([&log, &stop]()
+            {
+                while (stop.load() == false)
+                {
+                    log.write("message");
+                }
+            });
+        }
+        for (int i = 0; i < NUM_FATAL_MESSAGES; i++)
+        {
+            log.write("fatal message", pi::LogLevel::FATAL);
+        }
+        stop.store(true);
+        for (int i = 0; i < NUM_LOG_THREADS; i++)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        backend->flush();
+        dropped = backend->getDropped();
+    }
+
+    unsigned long fatal = 0;
+    for (const std::string &line : readLines(filename))
+    {
+        if (line.find(": fatal message") != std::string::npos)
+        {
+            fatal++;
+        }
+    }
+
+    // the queue did overflow, but none of the fatal messages were lost
+    ASSERT_LT(0, dropped);
+    ASSERT_EQ(NUM_FATAL_MESSAGES, fatal);
+
+    std::remove(filename);
+}
+
 } // namespace psmoveinput_test
@@ -21,6 +21,7 @@
 #include "psmove_handler.hpp"
 #include "gtest/gtest.h"
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/bind/placeholders.hpp>
 #include <vector>
 
@@ -43,9 +44,15 @@ public:
     TestListener() {}
     virtual ~TestListener() {}
 
-    void onKey(int key, bool pressed) { keyEvents_.push_back(KeyEvt(key, pressed)); }
+    // handler has no global lock, so keys of different controllers may be reported concurrently
+    void onKey(int key, bool pressed)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        keyEvents_.push_back(KeyEvt(key, pressed));
+    }
 
     std::vector<KeyEvt> keyEvents_;
+    boost::mutex mutex_;
 };
 
 #define NUM_KEY_EVTS    40000
@@ -98,9 +105,7 @@ public:
         psmoveinput::key_map keymap2{{Btn_CROSS, KEY_2}};
         psmoveinput::MoveCoeffs coeffs{1.0, 1.0};
         handler_ = new psmoveinput::PSMoveHandler(keymap1, keymap2, coeffs, 0, 0, *dummyLog_);
-        handler_->getKeySignal().connect(boost::bind(&TestListener::onKey,
-                                                     &listener_,
-                                                     _1, _2));
+        handler_->setKeySlot(psmoveinput::key_slot::bind<TestListener, &TestListener::onKey>(&listener_));
     }
 
     virtual void TearDown()
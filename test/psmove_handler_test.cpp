@@ -23,11 +23,13 @@
 #include "psmove_handler.hpp"
 #include "gtest/gtest.h"
 #include <boost/bind.hpp>
-#include <boost/thread/thread.hpp>
 
 namespace psmovehandler_test
 {
 
+// time moves only when the test says so
+typedef psmoveinput::PSMoveHandlerT<psmoveinput::ManualClock> TestHandler;
+
 class TestListener
 {
 public:
@@ -35,11 +37,13 @@ public:
         dx_(0),
         dy_(0),
         disconnect_(false),
-        mwheel_value_(0)
+        mwheel_value_(0),
+        totalDx_(0),
+        totalDy_(0)
     {
     }
     virtual ~TestListener() {}
-    void onMove(int dx, int dy) { dx_ = dx; dy_ = dy; }
+    void onMove(int dx, int dy) { dx_ = dx; dy_ = dy; totalDx_ += dx; totalDy_ += dy; }
     void onKey(int code, bool pressed) { keys_.push_back(std::make_pair(code, pressed)); }
     void onDisconnect(psmoveinput::ControllerId id) { disconnect_ = true; id_ = id; }
     void onMWheel(int value) { mwheel_value_ = value; }
@@ -50,6 +54,8 @@ public:
     bool disconnect_;
     psmoveinput::ControllerId id_;
     int mwheel_value_;
+    int totalDx_;
+    int totalDy_;
 };
 
 class PSMoveHandlerTest : public testing::Test
@@ -69,17 +75,12 @@ public:
                                      {BTN_GESTURE_RIGHT, KEY_R},
                                      {BTN_GESTURE_DOWN, KEY_D}};
         psmoveinput::MoveCoeffs coeffs{0.5, 2.0};
-        handler_ = new psmoveinput::PSMoveHandler(keymap1, keymap2, coeffs, 100, 50, *dummyLog_);
-        handler_->getMoveSignal().connect(boost::bind(&TestListener::onMove,
-                                                      &listener_,
-                                                      _1, _2));
-        handler_->getKeySignal().connect(boost::bind(&TestListener::onKey,
-                                                     &listener_,
-                                                     _1, _2));
+        handler_ = new TestHandler(keymap1, keymap2, coeffs, 100, 50, *dummyLog_);
+        handler_->setMoveSlot(psmoveinput::move_slot::bind<TestListener, &TestListener::onMove>(&listener_));
+        handler_->setKeySlot(psmoveinput::key_slot::bind<TestListener, &TestListener::onKey>(&listener_));
         handler_->getDisconnectSignal().connect(boost::bind(&TestListener::onDisconnect,
                                                             &listener_, _1));
-        handler_->getMWheelSignal().connect(boost::bind(&TestListener::onMWheel,
-                                                        &listener_, _1));
+        handler_->setMWheelSlot(psmoveinput::mwheel_slot::bind<TestListener, &TestListener::onMWheel>(&listener_));
     }
 
     virtual void TearDown()
@@ -89,7 +90,7 @@ public:
     }
 
 protected:
-    psmoveinput::PSMoveHandler *handler_;
+    TestHandler *handler_;
     TestListener listener_;
     psmoveinput::Log *dummyLog_;
 };
@@ -102,7 +103,7 @@ TEST_F(PSMoveHandlerTest, Gyroscope)
     ASSERT_EQ(0, listener_.dx_);
     ASSERT_EQ(0, listener_.dy_);
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGyroscope(-40, 20);
     // dx should be calculated in the following way:
     // dx = -40 (gyroscope value) * 10 (time delta) * 0.5 (x coeff)
@@ -114,7 +115,7 @@ TEST_F(PSMoveHandlerTest, Gyroscope)
     ASSERT_TRUE(listener_.dy_ <= 440);
     ASSERT_TRUE(listener_.dy_ >= 400);
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     // these gyroscope values should produce only x axis move report
     // since y axis should be filtered by handler's move threshold value
     handler_->onGyroscope(30, 1);
@@ -123,6 +124,34 @@ TEST_F(PSMoveHandlerTest, Gyroscope)
     ASSERT_EQ(0, listener_.dy_);
 }
 
+TEST_F(PSMoveHandlerTest, GyroscopeTimestamps)
+{
+    timespec tp{100, 995000000};
+
+    handler_->onGyroscope(10, 30, tp);
+    ASSERT_EQ(0, listener_.dx_);
+    ASSERT_EQ(0, listener_.dy_);
+
+    // samples carrying their own timestamps are integrated over the exact time delta,
+    // even if it crosses a second boundary:
+    // dx = -40 * 10 (ms) * 0.5, dy = 20 * 10 (ms) * 2.0
+    tp.tv_sec = 101;
+    tp.tv_nsec = 5000000;
+    handler_->onGyroscope(-40, 20, tp);
+    ASSERT_EQ(-200, listener_.dx_);
+    ASSERT_EQ(400, listener_.dy_);
+
+    // two half-frames of the same report, 5 ms apart
+    tp.tv_nsec = 10000000;
+    handler_->onGyroscope(80, 40, tp);
+    ASSERT_EQ(200, listener_.dx_);
+    ASSERT_EQ(400, listener_.dy_);
+    tp.tv_nsec = 15000000;
+    handler_->onGyroscope(-80, -40, tp);
+    ASSERT_EQ(-200, listener_.dx_);
+    ASSERT_EQ(-400, listener_.dy_);
+}
+
 TEST_F(PSMoveHandlerTest, Gestures)
 {
     handler_->onGesture(1, 1);
@@ -130,7 +159,7 @@ TEST_F(PSMoveHandlerTest, Gestures)
     // it is just for the timestamp taking
     ASSERT_EQ(0, listener_.keys_.size());
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGesture(20, 1);
     // handler should calculate approximately 20 * 10 * 0.5 = 100 pixels on x axis,
     // which is above the gesture threshold of 50 pixels and report KEY_R
@@ -138,14 +167,14 @@ TEST_F(PSMoveHandlerTest, Gestures)
     ASSERT_EQ(true, listener_.keys_[0].second);
     // on y axis it should be 1 * 10 * 2 = 20, which is below 50 pixel threshold
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     // emulate controller movement in the same direction
     handler_->onGesture(30, 0);
     // handler should not report anything, KEY_R should still be pressed
     ASSERT_EQ(KEY_R, listener_.keys_.back().first);
     ASSERT_EQ(true, listener_.keys_.back().second);
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGesture(0, -50);
     // this time handler should get approximately 50 * 10 * 2 = 1000 pixels on y axis
     // and report KEY_D, while KEY_R should be released
@@ -170,7 +199,7 @@ TEST_F(PSMoveHandlerTest, Gestures)
     ASSERT_TRUE(key_r_found);
 
     handler_->onGesture(0, 0);
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
 
     // now emulate two gestures: the second short time after the first,
     // while the first is still active
@@ -178,12 +207,12 @@ TEST_F(PSMoveHandlerTest, Gestures)
     handler_->onGesture(20, 0);
     ASSERT_EQ(KEY_R, listener_.keys_.back().first);
     ASSERT_EQ(true, listener_.keys_.back().second);
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGesture(20, -50);
     ASSERT_EQ(2, listener_.keys_.size());
     ASSERT_EQ(KEY_D, listener_.keys_.back().first);
     ASSERT_EQ(true, listener_.keys_.back().second);
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGesture(-20, -50);
     // gesture "up" is no longer active, so KEY_R should be released,
     // but KEY_D should remain pressed
@@ -243,6 +272,31 @@ TEST_F(PSMoveHandlerTest, IncorrectButtons)
     ASSERT_EQ(0, listener_.keys_.size());
 }
 
+TEST_F(PSMoveHandlerTest, SimultaneousButtons)
+{
+    // several buttons changing at once are reported in button code order,
+    // unmapped ones are skipped
+    handler_->onButtons(Btn_START | Btn_CROSS | Btn_SELECT, psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(2, listener_.keys_.size());
+    ASSERT_EQ((Btn_START < Btn_CROSS) ? KEY_ENTER : KEY_X, listener_.keys_[0].first);
+    ASSERT_EQ((Btn_START < Btn_CROSS) ? KEY_X : KEY_ENTER, listener_.keys_[1].first);
+    ASSERT_EQ(true, listener_.keys_[0].second);
+    ASSERT_EQ(true, listener_.keys_[1].second);
+
+    // one button released and another one pressed
+    handler_->onButtons(Btn_START, psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(3, listener_.keys_.size());
+    ASSERT_EQ(KEY_X, listener_.keys_[2].first);
+    ASSERT_EQ(false, listener_.keys_[2].second);
+
+    handler_->onButtons(Btn_CROSS, psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(5, listener_.keys_.size());
+    ASSERT_EQ((Btn_START < Btn_CROSS) ? KEY_ENTER : KEY_X, listener_.keys_[3].first);
+    ASSERT_EQ((Btn_START < Btn_CROSS) ? false : true, listener_.keys_[3].second);
+    ASSERT_EQ((Btn_START < Btn_CROSS) ? KEY_X : KEY_ENTER, listener_.keys_[4].first);
+    ASSERT_EQ((Btn_START < Btn_CROSS) ? true : false, listener_.keys_[4].second);
+}
+
 TEST_F(PSMoveHandlerTest, HandlerReset)
 {
     // report single key press
@@ -286,11 +340,43 @@ TEST_F(PSMoveHandlerTest, HandlerReset)
     ASSERT_EQ(0, listener_.keys_.size());
 }
 
+TEST_F(PSMoveHandlerTest, ControllerReset)
+{
+    handler_->onButtons(Btn_CROSS | Btn_START, psmoveinput::ControllerId::FIRST);
+    handler_->onButtons(Btn_CROSS, psmoveinput::ControllerId::SECOND);
+    listener_.keys_.clear();
+
+    // keys held by the controller are released, other controllers are not affected
+    handler_->reset(psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(2, listener_.keys_.size());
+    for (std::pair<int, bool> key : listener_.keys_)
+    {
+        ASSERT_TRUE((key.first == KEY_X) || (key.first == KEY_ENTER));
+        ASSERT_EQ(false, key.second);
+    }
+
+    listener_.keys_.clear();
+    handler_->onButtons(0, psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(0, listener_.keys_.size());
+    handler_->onButtons(0, psmoveinput::ControllerId::SECOND);
+    ASSERT_EQ(1, listener_.keys_.size());
+    ASSERT_EQ(KEY_SPACE, listener_.keys_.back().first);
+    ASSERT_EQ(false, listener_.keys_.back().second);
+
+    // special keys are not released
+    handler_->onButtons(Btn_TRIANGLE, psmoveinput::ControllerId::FIRST);
+    listener_.disconnect_ = false;
+    listener_.keys_.clear();
+    handler_->reset(psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(false, listener_.disconnect_);
+    ASSERT_EQ(0, listener_.keys_.size());
+}
+
 TEST_F(PSMoveHandlerTest, MWheel)
 {
     handler_->onButtons(Btn_SQUARE, psmoveinput::ControllerId::FIRST);
     ASSERT_EQ(1, listener_.mwheel_value_);
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onButtons(0, psmoveinput::ControllerId::FIRST);
     handler_->onButtons(Btn_CIRCLE, psmoveinput::ControllerId::FIRST);
     ASSERT_EQ(-1, listener_.mwheel_value_);
@@ -309,13 +395,9 @@ public:
                                      {BTN_GESTURE_LEFT, KEY_L},
                                      {Btn_T, KEY_PSMOVE_GESTURE_TRIGGER}};
         psmoveinput::MoveCoeffs coeffs{1.0, 1.0};
-        handler_ = new psmoveinput::PSMoveHandler(keymap1, keymap2, coeffs, 0, 40, *dummyLog_);
-        handler_->getMoveSignal().connect(boost::bind(&TestListener::onMove,
-                                                      &listener_,
-                                                      _1, _2));
-        handler_->getKeySignal().connect(boost::bind(&TestListener::onKey,
-                                                     &listener_,
-                                                     _1, _2));
+        handler_ = new TestHandler(keymap1, keymap2, coeffs, 0, 40, *dummyLog_);
+        handler_->setMoveSlot(psmoveinput::move_slot::bind<TestListener, &TestListener::onMove>(&listener_));
+        handler_->setKeySlot(psmoveinput::key_slot::bind<TestListener, &TestListener::onKey>(&listener_));
     }
 };
 
@@ -327,7 +409,7 @@ TEST_F(PSMoveHandlerTriggerTest, MoveTrigger)
     ASSERT_EQ(0, listener_.dx_);
     ASSERT_EQ(0, listener_.dy_);
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     // without move trigger button pressed gyroscope data should not
     // be handled
     handler_->onGyroscope(-40, 20);
@@ -336,7 +418,7 @@ TEST_F(PSMoveHandlerTriggerTest, MoveTrigger)
 
     // press trigger button
     handler_->onButtons(Btn_MOVE, psmoveinput::ControllerId::FIRST);
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGyroscope(20, 20);
     ASSERT_NE(0, listener_.dx_);
     ASSERT_NE(0, listener_.dy_);
@@ -345,25 +427,80 @@ TEST_F(PSMoveHandlerTriggerTest, MoveTrigger)
     listener_.dy_ = 0;
 
     // release trigger button
-    boost::this_thread::sleep(boost::posix_time::millisec(5));
+    handler_->getClock().advanceMs(5);
     handler_->onButtons(0, psmoveinput::ControllerId::FIRST);
     handler_->onGyroscope(20, 20);
     ASSERT_EQ(0, listener_.dx_);
     ASSERT_EQ(0, listener_.dy_);
 }
 
+TEST_F(PSMoveHandlerTriggerTest, SubPixelMovement)
+{
+    timespec tp{10, 999800000};
+
+    handler_->onButtons(Btn_MOVE, psmoveinput::ControllerId::FIRST);
+    handler_->onGyroscope(1, -3, tp);
+
+    // samples arriving every 0.4 ms move the pointer by 0.4 pixels on x axis
+    // and -1.2 pixels on y axis; each of them used to be truncated to zero,
+    // now the fractional part is carried over until it adds up to whole pixels
+    for (int i = 0; i < 10; i++)
+    {
+        tp.tv_nsec += 400000;
+        if (tp.tv_nsec >= 1000000000)
+        {
+            tp.tv_sec++;
+            tp.tv_nsec -= 1000000000;
+        }
+        handler_->onGyroscope(1, -3, tp);
+    }
+    ASSERT_EQ(4, listener_.totalDx_);
+    ASSERT_EQ(-12, listener_.totalDy_);
+
+    // gap longer than a second is integrated as is
+    tp.tv_sec += 2;
+    handler_->onGyroscope(1, 0, tp);
+    ASSERT_EQ(2000, listener_.dx_);
+
+    // residuals are dropped while move trigger is released
+    listener_.totalDx_ = 0;
+    tp.tv_nsec += 700000;
+    handler_->onGyroscope(1, 0, tp);
+    handler_->onButtons(0, psmoveinput::ControllerId::FIRST);
+    tp.tv_nsec += 700000;
+    handler_->onGyroscope(1, 0, tp);
+    handler_->onButtons(Btn_MOVE, psmoveinput::ControllerId::FIRST);
+    tp.tv_nsec += 700000;
+    handler_->onGyroscope(1, 0, tp);
+    ASSERT_EQ(0, listener_.totalDx_);
+}
+
+TEST_F(PSMoveHandlerTriggerTest, VirtualTime)
+{
+    // an hour of samples arriving every millisecond takes no time to handle
+    handler_->onButtons(Btn_MOVE, psmoveinput::ControllerId::FIRST);
+    handler_->onGyroscope(2, -1);
+    for (int i = 0; i < 3600000; i++)
+    {
+        handler_->getClock().advanceMs(1);
+        handler_->onGyroscope(2, -1);
+    }
+    ASSERT_EQ(7200000, listener_.totalDx_);
+    ASSERT_EQ(-3600000, listener_.totalDy_);
+}
+
 TEST_F(PSMoveHandlerTriggerTest, GestureTrigger)
 {
     handler_->onGesture(1, 1);
     // no key reports, only timestamp taken by the handler
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     handler_->onGesture(-10, 3);
     // although x axis movement (-10 * 10 * 1 = -100) is above the threshold value (40),
     // no key should be reported without gesture trigger pressed
     ASSERT_EQ(0, listener_.keys_.size());
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
     // press trigger button
     handler_->onButtons(Btn_T, psmoveinput::ControllerId::SECOND);
     handler_->onGesture(-7, 2);
@@ -371,7 +508,7 @@ TEST_F(PSMoveHandlerTriggerTest, GestureTrigger)
     ASSERT_EQ(KEY_L, listener_.keys_.back().first);
     ASSERT_EQ(true, listener_.keys_.back().second);
 
-    boost::this_thread::sleep(boost::posix_time::millisec(10));
+    handler_->getClock().advanceMs(10);
 
     // release the trigger; this should immediately release all pressed
     // gesture keys
@@ -385,4 +522,69 @@ TEST_F(PSMoveHandlerTriggerTest, GestureTrigger)
     ASSERT_EQ(0, listener_.keys_.size());
 }
 
+class PSMoveHandlerPoolTest : public PSMoveHandlerTest
+{
+public:
+    virtual void SetUp()
+    {
+        dummyLog_ = new psmoveinput::Log(psmoveinput::LogParams("dummylog",
+                                                                psmoveinput::LogLevel::INFO));
+        psmoveinput::controller_settings controllers{
+            {psmoveinput::ControllerRole::POINTER, {{Btn_CROSS, KEY_X}}, {1.0, 1.0}},
+            {psmoveinput::ControllerRole::GESTURE, {{BTN_GESTURE_LEFT, KEY_L}}, {1.0, 1.0}},
+            {psmoveinput::ControllerRole::POINTER, {{Btn_CROSS, KEY_A}}, {0.5, 2.0}},
+            {psmoveinput::ControllerRole::KEYS, {{Btn_CROSS, KEY_B},
+                                                 {Btn_MOVE, KEY_PSMOVE_DISCONNECT}}, {1.0, 1.0}}};
+        handler_ = new TestHandler(controllers, 0, 40, *dummyLog_);
+        handler_->setMoveSlot(psmoveinput::move_slot::bind<TestListener, &TestListener::onMove>(&listener_));
+        handler_->setKeySlot(psmoveinput::key_slot::bind<TestListener, &TestListener::onKey>(&listener_));
+        handler_->getDisconnectSignal().connect(boost::bind(&TestListener::onDisconnect,
+                                                            &listener_, _1));
+    }
+};
+
+TEST_F(PSMoveHandlerPoolTest, Keys)
+{
+    ASSERT_EQ(4, handler_->getControllerCount());
+
+    // same button is mapped to different keys on each controller
+    handler_->onButtons(Btn_CROSS, psmoveinput::controllerId(2));
+    ASSERT_EQ(KEY_A, listener_.keys_.back().first);
+    ASSERT_EQ(true, listener_.keys_.back().second);
+    handler_->onButtons(Btn_CROSS, psmoveinput::controllerId(3));
+    ASSERT_EQ(KEY_B, listener_.keys_.back().first);
+    handler_->onButtons(Btn_CROSS, psmoveinput::ControllerId::FIRST);
+    ASSERT_EQ(KEY_X, listener_.keys_.back().first);
+    handler_->onButtons(0, psmoveinput::controllerId(2));
+    ASSERT_EQ(KEY_A, listener_.keys_.back().first);
+    ASSERT_EQ(false, listener_.keys_.back().second);
+    ASSERT_EQ(4, listener_.keys_.size());
+
+    // special keys report the controller they come from
+    handler_->onButtons(Btn_MOVE, psmoveinput::controllerId(3));
+    ASSERT_EQ(true, listener_.disconnect_);
+    ASSERT_EQ(psmoveinput::controllerId(3), listener_.id_);
+
+    // controllers outside of the pool are ignored
+    listener_.keys_.clear();
+    handler_->onButtons(Btn_CROSS, psmoveinput::controllerId(4));
+    ASSERT_EQ(0, listener_.keys_.size());
+}
+
+TEST_F(PSMoveHandlerPoolTest, Coefficients)
+{
+    timespec tp{100, 0};
+
+    // each pointer controller integrates its own motion with its own coefficients
+    handler_->onGyroscope(psmoveinput::ControllerId::FIRST, 10, 10, tp);
+    handler_->onGyroscope(psmoveinput::controllerId(2), 10, 10, tp);
+    tp.tv_nsec = 10000000;
+    handler_->onGyroscope(psmoveinput::ControllerId::FIRST, 10, 10, tp);
+    ASSERT_EQ(100, listener_.dx_);
+    ASSERT_EQ(100, listener_.dy_);
+    handler_->onGyroscope(psmoveinput::controllerId(2), 10, 10, tp);
+    ASSERT_EQ(50, listener_.dx_);
+    ASSERT_EQ(200, listener_.dy_);
+}
+
 } // namespace psmovehandler_test
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "sample_recorder.hpp"
+#include "sample_replay.hpp"
+#include "gtest/gtest.h"
+#include <boost/bind/bind.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace boost::placeholders;
+
+namespace sample_replay_test
+{
+
+namespace pi = psmoveinput;
+
+// remembers everything handed over to it as text
+class TestSink
+{
+public:
+    void onGyroscope(pi::ControllerId controller, int gx, int gy, const timespec &tp)
+    {
+        add("gyro", controller, gx, gy, &tp);
+    }
+
+    void onGesture(pi::ControllerId controller, int gx, int gy, const timespec &tp)
+    {
+        add("gesture", controller, gx, gy, &tp);
+    }
+
+    void onButtons(int buttons, pi::ControllerId controller)
+    {
+        add("buttons", controller, buttons, 0, nullptr);
+    }
+
+    void onFrameBegin() { events_.push_back("begin"); }
+    void onFrameEnd() { events_.push_back("end"); }
+
+    void onDisconnect(pi::ControllerId controller)
+    {
+        add("disconnect", controller, 0, 0, nullptr);
+    }
+
+    void onTime(const timespec &tp) { times_.push_back(tp); }
+
+    std::vector<std::string> events_;
+    std::vector<timespec> times_;
+
+protected:
+    // sample times are compared relative to the first one
+    timespec first_;
+    bool haveFirst_ = false;
+
+    void add(const char *what, pi::ControllerId controller, int x, int y, const timespec *tp)
+    {
+        char buf[128];
+        long long ns = 0;
+
+        if (tp != nullptr)
+        {
+            if (haveFirst_ == false)
+            {
+                first_ = *tp;
+                haveFirst_ = true;
+            }
+            ns = pi::timespecDiffNs(*tp, first_);
+        }
+        snprintf(buf, sizeof (buf), "%s %d %d %d %lld", what, pi::controllerIndex(controller), x, y, ns);
+        events_.push_back(buf);
+    }
+};
+
+template <typename T>
+void bindSink(T &source, TestSink &sink)
+{
+    source.setGyroSlot(pi::gyro_slot::bind<TestSink, &TestSink::onGyroscope>(&sink));
+    source.setGestureSlot(pi::gyro_slot::bind<TestSink, &TestSink::onGesture>(&sink));
+    source.setButtonSlot(pi::button_slot::bind<TestSink, &TestSink::onButtons>(&sink));
+    source.setFrameBeginSlot(pi::frame_slot::bind<TestSink, &TestSink::onFrameBegin>(&sink));
+    source.setFrameEndSlot(pi::frame_slot::bind<TestSink, &TestSink::onFrameEnd>(&sink));
+}
+
+class SampleReplayTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        char name[] = "/tmp/psmoveinput-record-XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_TRUE(fd >= 0);
+        close(fd);
+        unlink(name);
+        path_ = name;
+
+        log_ = new pi::Log(pi::LogParams("dummylog", pi::LogLevel::INFO));
+    }
+
+    virtual void TearDown()
+    {
+        unlink(path_.c_str());
+        delete log_;
+    }
+
+protected:
+    std::string path_;
+    pi::Log *log_;
+    TestSink recorded_;
+
+    // record two frames of the gyro controller, a gesture and a disconnect,
+    // frames being apart for given number of milliseconds
+    void record(int intervalMs)
+    {
+        pi::SampleRecorder recorder(*log_);
+        timespec tp;
+
+        ASSERT_EQ(true, recorder.open(path_));
+        bindSink(recorder, recorded_);
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+        recorder.onFrameBegin();
+        recorder.onGyroscope(pi::ControllerId::FIRST, 10, -20, pi::timespecAddNs(tp, -2000000));
+        recorder.onGyroscope(pi::ControllerId::FIRST, 11, -21, tp);
+        recorder.onButtons(0x10, pi::ControllerId::FIRST);
+        recorder.onFrameEnd();
+
+        usleep(intervalMs * 1000);
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+        recorder.onFrameBegin();
+        recorder.onGesture(pi::ControllerId::SECOND, 300, 400, tp);
+        recorder.onFrameEnd();
+        recorder.onDisconnect(pi::ControllerId::SECOND);
+        recorded_.onDisconnect(pi::ControllerId::SECOND);
+
+        ASSERT_EQ(2, recorder.getFrames());
+    }
+
+    // replay the recording and return the time it took in ms
+    long replay(bool realTime, TestSink &sink)
+    {
+        pi::SampleReplay replay(*log_);
+        timespec start, end;
+
+        EXPECT_EQ(true, replay.open(path_));
+        bindSink(replay, sink);
+        replay.getDisconnectCompleteSignal().connect(boost::bind(&TestSink::onDisconnect, &sink, _1));
+        replay.setTimeSlot(pi::time_slot::bind<TestSink, &TestSink::onTime>(&sink));
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        EXPECT_EQ(true, replay.run(realTime));
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        EXPECT_EQ(2, replay.getFrames());
+
+        return pi::timespecDiffMs(end, start);
+    }
+};
+
+TEST_F(SampleReplayTest, Fast)
+{
+    TestSink replayed;
+
+    record(200);
+    ASSERT_EQ(9, recorded_.events_.size());
+    ASSERT_EQ("gyro 0 10 -20 0", recorded_.events_[1]);
+    ASSERT_EQ("gyro 0 11 -21 2000000", recorded_.events_[2]);
+
+    // everything comes out in the same order with the same intervals
+    ASSERT_LT(replay(false, replayed), 100);
+    ASSERT_EQ(recorded_.events_, replayed.events_);
+
+    // while virtual time moves as it did during recording
+    ASSERT_EQ(3, replayed.times_.size());
+    ASSERT_GE(pi::timespecDiffMs(replayed.times_[1], replayed.times_[0]), 200);
+}
+
+TEST_F(SampleReplayTest, RealTime)
+{
+    TestSink replayed;
+
+    record(100);
+    ASSERT_GE(replay(true, replayed), 90);
+    ASSERT_EQ(recorded_.events_, replayed.events_);
+}
+
+TEST_F(SampleReplayTest, Append)
+{
+    TestSink replayed;
+
+    record(0);
+    // recording again adds to the file
+    {
+        pi::SampleRecorder recorder(*log_);
+        timespec tp;
+
+        ASSERT_EQ(true, recorder.open(path_));
+        clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+        recorder.onGyroscope(pi::ControllerId::FIRST, 1, 2, tp);
+    }
+
+    pi::SampleReplay replay(*log_);
+    ASSERT_EQ(true, replay.open(path_));
+    bindSink(replay, replayed);
+    ASSERT_EQ(true, replay.run(false));
+    ASSERT_EQ(3, replay.getFrames());
+    ASSERT_EQ("end", replayed.events_.back());
+    ASSERT_EQ("gyro 0 1 2", replayed.events_[replayed.events_.size() - 2].substr(0, 10));
+}
+
+TEST_F(SampleReplayTest, Damaged)
+{
+    TestSink replayed;
+    pi::SampleReplay replay(*log_);
+
+    // not a recording at all
+    FILE *file = fopen(path_.c_str(), "wb");
+    fputs("garbage garbage garbage", file);
+    fclose(file);
+    ASSERT_EQ(false, replay.open(path_));
+
+    // recording cut short in the middle of a frame
+    unlink(path_.c_str());
+    record(0);
+    truncate(path_.c_str(), RECORD_MAGIC_SIZE + 2 * sizeof (pi::Record));
+    ASSERT_EQ(true, replay.open(path_));
+    bindSink(replay, replayed);
+    ASSERT_EQ(false, replay.run(false));
+    ASSERT_EQ(true, replayed.events_.empty());
+}
+
+} // namespace sample_replay_test
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 Mikhail Sapozhnikov
+ *
+ * This file is part of psmoveinput.
+ *
+ * psmoveinput is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * psmoveinput is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with psmoveinput.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "spsc_queue.hpp"
+#include "gtest/gtest.h"
+#include <boost/thread/thread.hpp>
+
+namespace psmoveinput_test
+{
+
+namespace pi = psmoveinput;
+
+TEST(SpscQueue, Overflow)
+{
+    pi::SpscQueue<int> queue(3);
+    int value = 0;
+
+    // capacity is rounded up to the power of two
+    ASSERT_EQ(4, queue.capacity());
+    ASSERT_EQ(true, queue.empty());
+    ASSERT_EQ(false, queue.pop(value));
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(true, queue.push(i));
+    }
+    // full queue does not accept more elements
+    ASSERT_EQ(false, queue.push(4));
+    ASSERT_EQ(4, queue.size());
+    ASSERT_EQ(4, queue.getHighWater());
+
+    ASSERT_EQ(true, queue.pop(value));
+    ASSERT_EQ(0, value);
+    ASSERT_EQ(true, queue.push(4));
+
+    for (int i = 1; i <= 4; i++)
+    {
+        ASSERT_EQ(true, queue.pop(value));
+        ASSERT_EQ(i, value);
+    }
+    ASSERT_EQ(false, queue.pop(value));
+    ASSERT_EQ(4, queue.getHighWater());
+}
+
+#define SPSC_TEST_COUNT 1000000
+
+TEST(SpscQueue, ProducerConsumer)
+{
+    pi::SpscQueue<int> queue(64);
+    long long sum = 0;
+    int expected = 0;
+    bool ordered = true;
+
+    boost::thread producer([&queue]()
+    {
+        for (int i = 0; i < SPSC_TEST_COUNT; i++)
+        {
+            while (queue.push(i) == false)
+            {
+                boost::this_thread::yield();
+            }
+        }
+    });
+
+    // every element arrives exactly once and in order
+    while (expected < SPSC_TEST_COUNT)
+    {
+        int value;
+        if (queue.pop(value) == true)
+        {
+            if (value != expected)
+            {
+                ordered = false;
+            }
+            sum += value;
+            expected++;
+        }
+        else
+        {
+            // let the producer run on machines with a single CPU
+            boost::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    ASSERT_EQ(true, ordered);
+    ASSERT_EQ(static_cast<long long>(SPSC_TEST_COUNT) * (SPSC_TEST_COUNT - 1) / 2, sum);
+    ASSERT_EQ(true, queue.empty());
+    ASSERT_GE(64, queue.getHighWater());
+}
+
+} // namespace psmoveinput_test